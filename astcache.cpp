@@ -0,0 +1,723 @@
+// astcache.cpp
+#include "astcache.h"
+#include "node.h"
+#include "parser.hpp" // 包含 token 定义
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <typeinfo>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/xxhash.h>
+
+namespace {
+
+const char MAGIC[4] = { 'S', 'Y', 'A', 'C' };
+
+// 节点种类的编号，写进了缓存文件，只能在末尾追加
+enum class Tag : uint8_t {
+    CompUnit, VarDecl, FuncDecl, Integer, Float, Ident, MethodCall,
+    BinaryExpr, LogicalBinaryExpr, UnaryExpr, LogicalUnaryExpr, Assignment,
+    Block, ExprStmt, ReturnStmt, IfStmt, WhileStmt, BreakStmt, ContinueStmt,
+    ParallelFor,
+    Count
+};
+
+// 运算符和类型的固定编号：表中的下标
+const int OPERATORS[] = {
+    TPLUS, TMINUS, TMUL, TDIV, TMOD,
+    TCEQ, TCNE, TCLT, TCLE, TCGT, TCGE, TAND, TOR, TNOT
+};
+const int TYPES[] = {
+    TINTTYPE, TFLOATTYPE, TVOIDTYPE, TINT4TYPE, TINT8TYPE, TFLOAT4TYPE, TFLOAT8TYPE
+};
+
+template <size_t N> int codeOf(const int (&table)[N], int token) {
+    for (size_t i = 0; i < N; i++) {
+        if (table[i] == token) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+class Writer {
+public:
+    std::string out;
+
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+    void signedVarint(long long value) {
+        varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+    void raw(const void *data, size_t size) { out.append((const char *)data, size); }
+    void tag(Tag t) { out.push_back((char)t); }
+};
+
+class Reader {
+public:
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    Reader(const char *data, size_t size) : p(data), end(data + size) { }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) {
+                break;
+            }
+            uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+    long long signedVarint() {
+        uint64_t value = varint();
+        return (long long)(value >> 1) ^ -(long long)(value & 1);
+    }
+    bool raw(void *data, size_t size) {
+        if ((size_t)(end - p) < size) {
+            ok = false;
+            return false;
+        }
+        memcpy(data, p, size);
+        p += size;
+        return true;
+    }
+};
+
+///////////////////////////////////////////////////
+// 写入：显式栈后序遍历
+
+class Encoder {
+public:
+    Writer names;
+    Writer nodes;
+    bool ok = true;
+
+    size_t nameCount() const { return index.size(); }
+
+    void encode(const NCompUnit& unit) {
+        std::vector<Pending> work;
+        std::vector<const Node*> children;
+        work.push_back({&unit, classify(&unit), false});
+        while (!work.empty() && ok) {
+            Pending item = work.back();
+            work.pop_back();
+            if (item.ready) {
+                emit(item.node, item.tag);
+                continue;
+            }
+            if (item.tag == Tag::Count) {
+                // 缓存格式不认识的节点，这棵树不缓存
+                ok = false;
+                break;
+            }
+            item.ready = true;
+            work.push_back(item);
+            children.clear();
+            childrenOf(item.node, item.tag, children);
+            for (size_t i = children.size(); i-- > 0; ) {
+                work.push_back({children[i], classify(children[i]), false});
+            }
+        }
+    }
+
+private:
+    // ready 为 true 表示子节点都已写出，轮到节点自己
+    struct Pending {
+        const Node *node;
+        Tag tag;
+        bool ready;
+    };
+
+    std::unordered_map<std::string, uint32_t> index;
+
+    // 按节点的确切类型分类，只做一次；比逐个 dynamic_cast 快得多
+    static Tag classify(const Node *node) {
+        const std::type_info& type = typeid(*node);
+        if (type == typeid(NIdent)) return Tag::Ident;
+        if (type == typeid(NInteger)) return Tag::Integer;
+        if (type == typeid(NBinaryExpr)) return Tag::BinaryExpr;
+        if (type == typeid(NLogicalBinaryExpr)) return Tag::LogicalBinaryExpr;
+        if (type == typeid(NAssignment)) return Tag::Assignment;
+        if (type == typeid(NExprStmt)) return Tag::ExprStmt;
+        if (type == typeid(NMethodCall)) return Tag::MethodCall;
+        if (type == typeid(NBlock)) return Tag::Block;
+        if (type == typeid(NVarDecl)) return Tag::VarDecl;
+        if (type == typeid(NIfStmt)) return Tag::IfStmt;
+        if (type == typeid(NReturnStmt)) return Tag::ReturnStmt;
+        if (type == typeid(NFloat)) return Tag::Float;
+        if (type == typeid(NUnaryExpr)) return Tag::UnaryExpr;
+        if (type == typeid(NLogicalUnaryExpr)) return Tag::LogicalUnaryExpr;
+        if (type == typeid(NWhileStmt)) return Tag::WhileStmt;
+        if (type == typeid(NParallelFor)) return Tag::ParallelFor;
+        if (type == typeid(NBreakStmt)) return Tag::BreakStmt;
+        if (type == typeid(NContinueStmt)) return Tag::ContinueStmt;
+        if (type == typeid(NFuncDecl)) return Tag::FuncDecl;
+        if (type == typeid(NCompUnit)) return Tag::CompUnit;
+        return Tag::Count;
+    }
+
+    uint32_t intern(const std::string& name) {
+        auto it = index.find(name);
+        if (it != index.end()) {
+            return it->second;
+        }
+        uint32_t id = index.size();
+        index[name] = id;
+        names.varint(name.size());
+        names.raw(name.data(), name.size());
+        return id;
+    }
+
+    void op(int token) {
+        int code = codeOf(OPERATORS, token);
+        ok = ok && code >= 0;
+        nodes.varint(code);
+    }
+
+    // 子节点按构造函数参数的顺序，Decoder 从栈顶反着取
+    static void childrenOf(const Node *node, Tag tag, std::vector<const Node*>& out) {
+        switch (tag) {
+            case Tag::CompUnit: {
+                auto p = static_cast<const NCompUnit*>(node);
+                out.insert(out.end(), p->decls.begin(), p->decls.end());
+                break;
+            }
+            case Tag::VarDecl: {
+                auto p = static_cast<const NVarDecl*>(node);
+                out.push_back(&p->id);
+                if (p->assignmentExpr) {
+                    out.push_back(p->assignmentExpr);
+                }
+                break;
+            }
+            case Tag::FuncDecl: {
+                auto p = static_cast<const NFuncDecl*>(node);
+                out.push_back(&p->id);
+                out.insert(out.end(), p->arguments.begin(), p->arguments.end());
+                out.push_back(&p->block);
+                break;
+            }
+            case Tag::MethodCall: {
+                auto p = static_cast<const NMethodCall*>(node);
+                out.push_back(&p->id);
+                out.insert(out.end(), p->arguments.begin(), p->arguments.end());
+                break;
+            }
+            case Tag::BinaryExpr: {
+                auto p = static_cast<const NBinaryExpr*>(node);
+                out.push_back(&p->lhs);
+                out.push_back(&p->rhs);
+                break;
+            }
+            case Tag::LogicalBinaryExpr: {
+                auto p = static_cast<const NLogicalBinaryExpr*>(node);
+                out.push_back(&p->lhs);
+                out.push_back(&p->rhs);
+                break;
+            }
+            case Tag::UnaryExpr:
+                out.push_back(&static_cast<const NUnaryExpr*>(node)->expr);
+                break;
+            case Tag::LogicalUnaryExpr:
+                out.push_back(&static_cast<const NLogicalUnaryExpr*>(node)->expr);
+                break;
+            case Tag::Assignment: {
+                auto p = static_cast<const NAssignment*>(node);
+                out.push_back(&p->lhs);
+                out.push_back(&p->rhs);
+                break;
+            }
+            case Tag::Block: {
+                auto p = static_cast<const NBlock*>(node);
+                out.insert(out.end(), p->statements.begin(), p->statements.end());
+                break;
+            }
+            case Tag::ExprStmt:
+                out.push_back(&static_cast<const NExprStmt*>(node)->expression);
+                break;
+            case Tag::ReturnStmt:
+                out.push_back(&static_cast<const NReturnStmt*>(node)->expression);
+                break;
+            case Tag::IfStmt: {
+                auto p = static_cast<const NIfStmt*>(node);
+                out.push_back(&p->condition);
+                out.push_back(&p->trueBlock);
+                if (p->falseBlock) {
+                    out.push_back(p->falseBlock);
+                }
+                break;
+            }
+            case Tag::WhileStmt: {
+                auto p = static_cast<const NWhileStmt*>(node);
+                out.push_back(&p->condition);
+                out.push_back(&p->block);
+                break;
+            }
+            case Tag::ParallelFor: {
+                auto p = static_cast<const NParallelFor*>(node);
+                out.push_back(&p->init);
+                out.push_back(&p->condition);
+                out.push_back(&p->step);
+                out.push_back(&p->block);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void emit(const Node *node, Tag tag) {
+        nodes.tag(tag);
+        switch (tag) {
+            case Tag::Ident: {
+                auto p = static_cast<const NIdent*>(node);
+                // 不是类型的标识符 type 为 -1，存成 0
+                int type = p->type == -1 ? -1 : codeOf(TYPES, p->type);
+                ok = ok && (p->type == -1 || type >= 0);
+                nodes.varint(type + 1);
+                nodes.varint(intern(p->name));
+                break;
+            }
+            case Tag::Integer:
+                nodes.signedVarint(static_cast<const NInteger*>(node)->value);
+                break;
+            case Tag::Float:
+                nodes.raw(&static_cast<const NFloat*>(node)->value, sizeof(double));
+                break;
+            case Tag::BinaryExpr:
+                op(static_cast<const NBinaryExpr*>(node)->op);
+                break;
+            case Tag::LogicalBinaryExpr:
+                op(static_cast<const NLogicalBinaryExpr*>(node)->op);
+                break;
+            case Tag::UnaryExpr:
+                op(static_cast<const NUnaryExpr*>(node)->op);
+                break;
+            case Tag::LogicalUnaryExpr:
+                op(static_cast<const NLogicalUnaryExpr*>(node)->op);
+                break;
+            case Tag::MethodCall:
+                nodes.varint(static_cast<const NMethodCall*>(node)->arguments.size());
+                break;
+            case Tag::Block:
+                nodes.varint(static_cast<const NBlock*>(node)->statements.size());
+                break;
+            case Tag::IfStmt:
+                nodes.varint(static_cast<const NIfStmt*>(node)->falseBlock != NULL);
+                break;
+            case Tag::WhileStmt: {
+                auto p = static_cast<const NWhileStmt*>(node);
+                nodes.varint(p->pragmas.size());
+                for (auto& pragma : p->pragmas) {
+                    nodes.varint(intern(pragma));
+                }
+                break;
+            }
+            case Tag::ParallelFor: {
+                auto p = static_cast<const NParallelFor*>(node);
+                nodes.varint(p->reductions.size());
+                for (auto& reduction : p->reductions) {
+                    nodes.varint(intern(reduction.op));
+                    nodes.varint(intern(reduction.name));
+                }
+                break;
+            }
+            case Tag::VarDecl: {
+                auto p = static_cast<const NVarDecl*>(node);
+                nodes.varint(p->isConst | (p->assignmentExpr != NULL) << 1 | p->isExtern << 2);
+                break;
+            }
+            case Tag::FuncDecl: {
+                auto p = static_cast<const NFuncDecl*>(node);
+                nodes.varint(p->arguments.size());
+                nodes.varint(p->isPrototype);
+                break;
+            }
+            case Tag::CompUnit:
+                nodes.varint(static_cast<const NCompUnit*>(node)->decls.size());
+                break;
+            default:
+                // Assignment、ExprStmt、ReturnStmt、break、continue 只有子节点
+                break;
+        }
+    }
+};
+
+///////////////////////////////////////////////////
+// 读取：节点建好后压栈，父节点从栈顶取走自己的子节点。
+// 文件可能损坏，取子节点前先检查个数和类型；运算符和类型也只接受
+// 语法分析可能产生的组合，代码生成不必防备别的情况
+
+// 栈上的节点是不是 T 类，按种类判断，不用 dynamic_cast
+template <class T> bool holds(Tag tag);
+template <> bool holds<NExpr>(Tag tag) { return tag >= Tag::Integer && tag <= Tag::Assignment; }
+template <> bool holds<NStmt>(Tag tag) {
+    return tag == Tag::VarDecl || tag == Tag::FuncDecl || (tag >= Tag::Block && tag <= Tag::ParallelFor);
+}
+template <> bool holds<NDecl>(Tag tag) { return tag == Tag::VarDecl || tag == Tag::FuncDecl; }
+template <> bool holds<NVarDecl>(Tag tag) { return tag == Tag::VarDecl; }
+template <> bool holds<NIdent>(Tag tag) { return tag == Tag::Ident; }
+template <> bool holds<NBlock>(Tag tag) { return tag == Tag::Block; }
+
+class Decoder {
+public:
+    Reader& in;
+    std::vector<std::string> names;
+    std::vector<Node*> stack;
+    std::vector<Tag> tags;          // stack 上各节点的种类
+    bool ok = true;
+
+    explicit Decoder(Reader& in) : in(in) { }
+    ~Decoder() {
+        for (Node *node : stack) {
+            Node::deleteTree(node);
+        }
+    }
+
+    NCompUnit *decode() {
+        while (in.ok && ok && in.p != in.end) {
+            uint8_t tag = *in.p++;
+            Node *node = tag < (uint8_t)Tag::Count ? make((Tag)tag) : NULL;
+            if (!node || !in.ok) {
+                delete node;
+                return NULL;
+            }
+            stack.push_back(node);
+            tags.push_back((Tag)tag);
+        }
+        if (!in.ok || !ok || stack.size() != 1 || tags[0] != Tag::CompUnit) {
+            return NULL;
+        }
+        NCompUnit *unit = static_cast<NCompUnit*>(stack[0]);
+        stack.clear();
+        return unit;
+    }
+
+private:
+    // 从栈顶数第 depth 个（1 是栈顶）节点，不是 T 类时失败
+    template <class T> T *peek(size_t depth) {
+        if (depth > stack.size() || !holds<T>(tags[tags.size() - depth])) {
+            ok = false;
+            return NULL;
+        }
+        return static_cast<T*>(stack[stack.size() - depth]);
+    }
+    // 栈顶的 count 个节点依次作为 T 类取出
+    template <class T> std::vector<T*> peekList(size_t depth, uint64_t count) {
+        std::vector<T*> out;
+        if (count > stack.size()) {
+            ok = false;
+            return out;
+        }
+        for (uint64_t i = count; i > 0 && ok; i--) {
+            out.push_back(peek<T>(depth + i - 1));
+        }
+        return out;
+    }
+    // 子节点都检查通过后才从栈上移走，交给新节点
+    void drop(size_t count) {
+        stack.resize(stack.size() - count);
+        tags.resize(tags.size() - count);
+    }
+
+    const std::string *name() {
+        uint64_t i = in.varint();
+        ok = ok && i < names.size();
+        return ok ? &names[i] : NULL;
+    }
+    int op(std::initializer_list<int> allowed) {
+        uint64_t code = in.varint();
+        int token = code < sizeof(OPERATORS) / sizeof(OPERATORS[0]) ? OPERATORS[code] : -1;
+        ok = ok && std::find(allowed.begin(), allowed.end(), token) != allowed.end();
+        return token;
+    }
+
+    Node *make(Tag tag);
+};
+
+Node *Decoder::make(Tag tag) {
+    switch (tag) {
+        case Tag::Integer:
+            return new NInteger(in.signedVarint());
+        case Tag::Float: {
+            double value = 0;
+            in.raw(&value, sizeof(value));
+            return new NFloat(value);
+        }
+        case Tag::Ident: {
+            uint64_t type = in.varint();
+            const std::string *id = name();
+            if (!ok || type > sizeof(TYPES) / sizeof(TYPES[0])) return NULL;
+            return new NIdent(*id, type == 0 ? -1 : TYPES[type - 1]);
+        }
+        case Tag::BinaryExpr: {
+            int token = op({ TPLUS, TMINUS, TMUL, TDIV, TMOD });
+            NExpr *lhs = peek<NExpr>(2);
+            NExpr *rhs = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(2);
+            return new NBinaryExpr(*lhs, token, *rhs);
+        }
+        case Tag::LogicalBinaryExpr: {
+            int token = op({ TCEQ, TCNE, TCLT, TCLE, TCGT, TCGE, TAND, TOR });
+            NExpr *lhs = peek<NExpr>(2);
+            NExpr *rhs = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(2);
+            return new NLogicalBinaryExpr(*lhs, token, *rhs);
+        }
+        case Tag::UnaryExpr: {
+            int token = op({ TMINUS });
+            NExpr *expr = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(1);
+            return new NUnaryExpr(token, *expr);
+        }
+        case Tag::LogicalUnaryExpr: {
+            int token = op({ TNOT });
+            NExpr *expr = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(1);
+            return new NLogicalUnaryExpr(token, *expr);
+        }
+        case Tag::Assignment: {
+            NIdent *lhs = peek<NIdent>(2);
+            NExpr *rhs = peek<NExpr>(1);
+            if (!ok || lhs->type != -1) return NULL;
+            drop(2);
+            return new NAssignment(*lhs, *rhs);
+        }
+        case Tag::MethodCall: {
+            uint64_t count = in.varint();
+            std::vector<NExpr*> arguments = peekList<NExpr>(1, count);
+            NIdent *id = peek<NIdent>(count + 1);
+            if (!ok || id->type != -1) return NULL;
+            drop(count + 1);
+            return new NMethodCall(*id, arguments);
+        }
+        case Tag::Block: {
+            uint64_t count = in.varint();
+            std::vector<NStmt*> statements = peekList<NStmt>(1, count);
+            if (!ok) return NULL;
+            drop(count);
+            NBlock *block = new NBlock();
+            block->statements = statements;
+            return block;
+        }
+        case Tag::ExprStmt: {
+            NExpr *expr = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(1);
+            return new NExprStmt(*expr);
+        }
+        case Tag::ReturnStmt: {
+            NExpr *expr = peek<NExpr>(1);
+            if (!ok) return NULL;
+            drop(1);
+            return new NReturnStmt(*expr);
+        }
+        case Tag::IfStmt: {
+            uint64_t hasElse = in.varint();
+            if (hasElse > 1) return NULL;
+            NBlock *falseBlock = hasElse ? peek<NBlock>(1) : NULL;
+            NBlock *trueBlock = peek<NBlock>(1 + hasElse);
+            NExpr *condition = peek<NExpr>(2 + hasElse);
+            if (!ok) return NULL;
+            drop(2 + hasElse);
+            return falseBlock ? new NIfStmt(*condition, *trueBlock, *falseBlock) : new NIfStmt(*condition, *trueBlock);
+        }
+        case Tag::WhileStmt: {
+            uint64_t count = in.varint();
+            std::vector<std::string> pragmas;
+            for (uint64_t i = 0; i < count && ok && in.ok; i++) {
+                const std::string *pragma = name();
+                if (pragma && LoopHints().parse(*pragma)) {
+                    pragmas.push_back(*pragma);
+                } else {
+                    ok = false;
+                }
+            }
+            NExpr *condition = peek<NExpr>(2);
+            NBlock *block = peek<NBlock>(1);
+            if (!ok) return NULL;
+            drop(2);
+            NWhileStmt *loop = new NWhileStmt(*condition, *block);
+            loop->pragmas = pragmas;
+            // 与语法分析时的顺序一致：离 while 最近的 #pragma 先生效
+            for (size_t i = pragmas.size(); i-- > 0; ) {
+                loop->hints.parse(pragmas[i]);
+            }
+            return loop;
+        }
+        case Tag::ParallelFor: {
+            uint64_t count = in.varint();
+            std::vector<Reduction> reductions;
+            for (uint64_t i = 0; i < count && ok && in.ok; i++) {
+                const std::string *op = name();
+                const std::string *var = name();
+                if (op && var && (*op == "+" || *op == "*" || *op == "min" || *op == "max")) {
+                    reductions.push_back({*op, *var});
+                } else {
+                    ok = false;
+                }
+            }
+            NExpr *init = peek<NExpr>(4);
+            NExpr *condition = peek<NExpr>(3);
+            NExpr *step = peek<NExpr>(2);
+            NBlock *block = peek<NBlock>(1);
+            if (!ok) return NULL;
+            drop(4);
+            NParallelFor *loop = new NParallelFor(*init, *condition, *step, *block);
+            loop->reductions = reductions;
+            return loop;
+        }
+        case Tag::VarDecl: {
+            uint64_t flags = in.varint();
+            bool hasInit = flags & 2;
+            NExpr *init = hasInit ? peek<NExpr>(1) : NULL;
+            NIdent *id = peek<NIdent>(1 + hasInit);
+            // 语法上常量必须有初值，extern 变量既不是常量也没有初值，变量不能是 void
+            if (!ok || flags > 4 || flags == 1 || id->type == -1 || id->type == TVOIDTYPE) return NULL;
+            drop(1 + hasInit);
+            NVarDecl *decl = new NVarDecl(flags & 1, *id, init);
+            decl->isExtern = flags & 4;
+            return decl;
+        }
+        case Tag::FuncDecl: {
+            uint64_t count = in.varint();
+            uint64_t prototype = in.varint();
+            NBlock *block = peek<NBlock>(1);
+            std::vector<NVarDecl*> arguments = peekList<NVarDecl>(2, count);
+            NIdent *id = peek<NIdent>(count + 2);
+            // 原型的函数体是空语句块
+            if (!ok || id->type == -1 || prototype > 1 || (prototype && !block->statements.empty())) return NULL;
+            drop(count + 2);
+            NFuncDecl *decl = new NFuncDecl(*id, arguments, *block);
+            decl->isPrototype = prototype;
+            return decl;
+        }
+        case Tag::CompUnit: {
+            uint64_t count = in.varint();
+            std::vector<NDecl*> decls = peekList<NDecl>(1, count);
+            if (!ok) return NULL;
+            drop(count);
+            NCompUnit *unit = new NCompUnit();
+            unit->decls = decls;
+            return unit;
+        }
+        case Tag::BreakStmt:
+            return new NBreakStmt();
+        case Tag::ContinueStmt:
+            return new NContinueStmt();
+        default:
+            return NULL;
+    }
+}
+
+} // namespace
+
+std::string astCachePath(const std::string& dir, const std::string& source) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ast", (unsigned long long)llvm::xxHash64(source));
+    return dir + "/" + name;
+}
+
+NCompUnit *loadAstCache(const std::string& path, const std::string& source) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return NULL;
+    }
+    file.seekg(0, std::ios::end);
+    std::string data(file.tellg(), '\0');
+    file.seekg(0);
+    if (!file.read(&data[0], data.size())) {
+        return NULL;
+    }
+
+    uint64_t checksum;
+    if (data.size() < sizeof(checksum)) {
+        return NULL;
+    }
+    llvm::StringRef body(data.data(), data.size() - sizeof(checksum));
+    memcpy(&checksum, body.end(), sizeof(checksum));
+    if (checksum != llvm::xxHash64(body)) {
+        return NULL;
+    }
+
+    Reader in(body.data(), body.size());
+    char magic[sizeof(MAGIC)];
+    uint64_t hash;
+    if (!in.raw(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        in.varint() != AST_CACHE_VERSION || !in.raw(&hash, sizeof(hash)) ||
+        in.varint() != source.size() || hash != llvm::xxHash64(source)) {
+        return NULL;
+    }
+    Decoder decoder(in);
+    uint64_t count = in.varint();
+    // 每个名字至少占一个字节，挡住损坏的个数
+    if (count > (uint64_t)(in.end - in.p)) {
+        return NULL;
+    }
+    decoder.names.resize(count);
+    for (auto& name : decoder.names) {
+        uint64_t size = in.varint();
+        if (!in.ok || size > (uint64_t)(in.end - in.p)) {
+            return NULL;
+        }
+        name.assign(in.p, size);
+        in.p += size;
+    }
+    return decoder.decode();
+}
+
+bool saveAstCache(const std::string& path, const std::string& source, const NCompUnit& unit) {
+    Encoder encoder;
+    encoder.encode(unit);
+    if (!encoder.ok) {
+        return false;
+    }
+    Writer w;
+    w.raw(MAGIC, sizeof(MAGIC));
+    w.varint(AST_CACHE_VERSION);
+    uint64_t hash = llvm::xxHash64(source);
+    w.raw(&hash, sizeof(hash));
+    w.varint(source.size());
+    w.varint(encoder.nameCount());
+    w.raw(encoder.names.out.data(), encoder.names.out.size());
+    w.raw(encoder.nodes.out.data(), encoder.nodes.out.size());
+    uint64_t checksum = llvm::xxHash64(w.out);
+    w.raw(&checksum, sizeof(checksum));
+
+    std::string dir = path.substr(0, path.rfind('/'));
+    mkdir(dir.c_str(), 0777);
+    std::string temp = path + "." + std::to_string(getpid());
+    {
+        std::ofstream file(temp, std::ios::binary);
+        if (!file.write(w.out.data(), w.out.size())) {
+            unlink(temp.c_str());
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
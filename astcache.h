@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+class NCompUnit;
+
+// 语法树的磁盘缓存（--ast-cache <目录>）：同一份源码换着选项反复编译时，
+// 跳过词法和语法分析，直接从 <目录>/<源码哈希>.ast 重建语法树。
+//
+// 文件格式：
+//   "SYAC" 版本号 源码哈希(8 字节) 源码长度
+//   名字表：个数，每个名字是长度 + 字节
+//   节点：按后序排列，子节点都在父节点之前，每个节点是 1 字节的种类加上
+//         种类自己的数据（子节点个数、运算符、名字表下标、常量等），
+//         读取时用一个栈即可还原，子节点不需要显式的下标
+//   校验和(8 字节)：前面全部内容的哈希
+// 除两个哈希和浮点常量外都是变长整数（LEB128），有符号整数先做 zigzag。
+// 运算符和类型按本文件的固定编号存放，与 bison 生成的 token 值无关；
+// 节点或编号的含义变化时要增加 AST_CACHE_VERSION。
+const unsigned AST_CACHE_VERSION = 2;
+
+std::string astCachePath(const std::string& dir, const std::string& source);
+// 命中时返回重建的语法树；文件不存在、版本或源码不符、内容损坏时返回 NULL
+NCompUnit *loadAstCache(const std::string& path, const std::string& source);
+// 先写临时文件再改名，并发的编译不会读到写了一半的缓存
+bool saveAstCache(const std::string& path, const std::string& source, const NCompUnit& unit);
@@ -0,0 +1,79 @@
+#!/bin/bash
+# 生成代码的质量对比：每个 .sy 程序分别用本编译器（JIT 运行、生成目标文件后链接运行）
+# 和 clang（借 sysy.h 当作 C 编译）构建，喂同一份输入（同名的 .in 文件），
+# 检查输出完全一致，再报告各自的运行时间以及与 clang 的比值。
+#   bench/bench.sh [程序.sy ...]      不给参数时跑 bench/ 下全部程序
+# 环境变量：PARSER（默认 ../parser）、CC（默认 clang）、OPT（默认 -O2）、REPEAT（默认 3，取最短）
+# JIT 的时间包含解析、优化和编译；任何一种方式输出与 clang 不同时退出码为 1。
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+PARSER=${PARSER:-$here/../parser}
+CC=${CC:-clang}
+OPT=${OPT:--O2}
+REPEAT=${REPEAT:-3}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# best <名字> <输入> <命令...>：运行 REPEAT 次，打印最短的墙钟时间（微秒），
+# 最后一次的输出留在 $work/<名字>.out；命令失败时返回 1
+best() {
+	local tag=$1 input=$2 shortest= start end t
+	shift 2
+	for ((i = 0; i < REPEAT; i++)); do
+		start=$(date +%s%N)
+		"$@" < "$input" > "$work/$tag.out" 2> "$work/$tag.err" || return 1
+		end=$(date +%s%N)
+		t=$(( (end - start) / 1000 ))
+		if [ -z "$shortest" ] || [ "$t" -lt "$shortest" ]; then
+			shortest=$t
+		fi
+	done
+	echo "$shortest"
+}
+
+# ms <微秒>、ratio <微秒> <微秒>
+# printf 的参数整体加括号：否则有的 awk 把 b > 0 里的 > 当成输出重定向，写出名为 0 的文件
+ms() { awk -v t="$1" 'BEGIN { printf "%.1f", t / 1000 }'; }
+ratio() { awk -v a="$1" -v b="$2" 'BEGIN { printf("%.2fx", b > 0 ? a / b : 0) }'; }
+
+if [ $# -eq 0 ]; then
+	set -- "$here"/*.sy
+fi
+
+failed=0
+printf "%-12s %10s %10s %7s %10s %7s  %s\n" program "clang ms" "jit ms" ratio "aot ms" ratio status
+for prog in "$@"; do
+	name=$(basename "$prog" .sy)
+	input=${prog%.sy}.in
+	[ -f "$input" ] || input=/dev/null
+	status=ok
+
+	if ! "$CC" $OPT -w -x c -include "$here/sysy.h" "$prog" -o "$work/$name.clang"; then
+		printf "%-12s clang 编译失败\n" "$name"
+		failed=1
+		continue
+	fi
+	clang=$(best clang "$input" "$work/$name.clang") || status="clang 运行失败"
+
+	jit=$(best jit "$input" "$PARSER" --run $OPT -fint32 "$prog") || status="jit 运行失败"
+	cmp -s "$work/clang.out" "$work/jit.out" || status="jit 输出不同"
+
+	aot=
+	if "$PARSER" $OPT -fint32 -o "$work/$name.o" "$prog" && "$CC" "$work/$name.o" -o "$work/$name.aot"; then
+		aot=$(best aot "$input" "$work/$name.aot") || status="aot 运行失败"
+		cmp -s "$work/clang.out" "$work/aot.out" || status="aot 输出不同"
+	else
+		status="aot 编译失败"
+	fi
+
+	if [ "$status" != ok ]; then
+		failed=1
+		printf "%-12s %s\n" "$name" "$status"
+		continue
+	fi
+	printf "%-12s %10s %10s %7s %10s %7s  %s\n" "$name" \
+		"$(ms "$clang")" "$(ms "$jit")" "$(ratio "$jit" "$clang")" \
+		"$(ms "$aot")" "$(ratio "$aot" "$clang")" "$status"
+done
+exit $failed
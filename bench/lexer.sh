@@ -0,0 +1,63 @@
+#!/bin/bash
+# flex 生成的词法分析器与手写的 SIMD 词法分析器（lexer.cpp）的吞吐量对比。
+# 把 bench/ 下的程序加上行注释、块注释和缩进拼成大文件，先检查两边输出的 token 序列
+# （编号、行号、值）完全一致，再各分析 REPEAT 遍，报告每秒 token 数。
+#   bench/lexer.sh [源文件 ...]   不给参数时用 bench/*.sy 生成
+# 环境变量：FLEX、SIMD（默认 ../lexbench-flex、../lexbench-simd）、SIZE（生成的文件大小，
+# 单位 MB，默认 64）、REPEAT（默认 3，取最短）；SYSY_LEXER=sse2 / scalar 让 SIMD 一侧不用 AVX2
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+FLEX=${FLEX:-$here/../lexbench-flex}
+SIMD=${SIMD:-$here/../lexbench-simd}
+SIZE=${SIZE:-64}
+REPEAT=${REPEAT:-3}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+if [ $# -eq 0 ]; then
+	set -- "$here"/*.sy
+fi
+
+# 一份样本：每个程序前加一段块注释，每行末尾加行注释，缩进换成制表符和空格的混合
+for prog in "$@"; do
+	printf '/*\n * %s\n * 这段注释只用来给词法分析器增加负担。\n */\n' "$(basename "$prog")"
+	sed -e 's/^    /\t  /' -e 's/;$/; \/\/ 行尾注释/' "$prog"
+	printf '\n'
+done > "$work/unit.sy"
+
+unit=$(stat -c %s "$work/unit.sy")
+copies=$(( SIZE * 1000000 / unit + 1 ))
+for ((i = 0; i < copies; i++)); do
+	cat "$work/unit.sy"
+done > "$work/big.sy"
+
+failed=0
+"$FLEX" --dump "$work/unit.sy" > "$work/flex.tokens" || failed=1
+"$SIMD" --dump "$work/unit.sy" > "$work/simd.tokens" || failed=1
+if [ $failed -ne 0 ] || ! cmp -s "$work/flex.tokens" "$work/simd.tokens"; then
+	echo "token 序列不一致：" >&2
+	diff "$work/flex.tokens" "$work/simd.tokens" | head -20 >&2
+	exit 1
+fi
+
+# best <分析器>：分析 REPEAT 遍大文件，打印耗时最短的一遍的结果行
+best() {
+	local lexer=$1 line t shortest= result=
+	for ((i = 0; i < REPEAT; i++)); do
+		line=$("$lexer" "$work/big.sy") || return 1
+		t=$(echo "$line" | awk '{ print $5 }')
+		if [ -z "$shortest" ] || awk -v a="$t" -v b="$shortest" 'BEGIN { exit !(a < b) }'; then
+			shortest=$t
+			result=$line
+		fi
+	done
+	echo "$result"
+}
+
+echo "输入：$(stat -c %s "$work/big.sy") 字节"
+flex=$(best "$FLEX") || { echo "flex 运行失败" >&2; exit 1; }
+simd=$(best "$SIMD") || { echo "simd 运行失败" >&2; exit 1; }
+printf "%-6s %s\n" flex "$flex" simd "$simd"
+awk -v a="$(echo "$flex" | awk '{ print $5 }')" -v b="$(echo "$simd" | awk '{ print $5 }')" \
+	'BEGIN { printf("加速比 %.2fx\n", b > 0 ? a / b : 0) }'
@@ -0,0 +1,50 @@
+#!/bin/sh
+# 语言服务器反复收到带语法错误的整篇修改（didChange），常驻内存不应增长，与 make soak 相同的检查。
+# 文档里的错误落在表达式、嵌套的 if / while、parallel for 的头部、没写完的函数体和顶层，
+# 每次都要释放错误恢复丢掉的节点和出错的块里已经读完的声明。
+# 服务器每处理一条消息在 stderr 记一行日志，末尾是当时的 RSS；取预热后和最后一次比较。
+#   PARSER   编译器，默认 ./parser
+#   RUNS     修改次数，默认 20000
+#   SLACK_KB 允许增长的常驻内存，默认 4096（与 --soak 相同）
+PARSER=${PARSER:-./parser}
+RUNS=${RUNS:-20000}
+SLACK_KB=${SLACK_KB:-4096}
+
+awk -v runs="$RUNS" '
+function send(body) {
+    printf "Content-Length: %d\r\n\r\n%s", length(body), body
+}
+function change(version, text) {
+    send("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"file:///soak.sy\",\"version\":" version "},\"contentChanges\":[{\"text\":\"" text "\"}]}}")
+}
+BEGIN {
+    good = "int g = 1;\\nint f(int a) {\\n  while (a < 10) { a = a + g; }\\n  return a;\\n}\\n"
+    bad[0] = good "int h(int a) {\\n  if (a > 0) { while (a < 10) { a = a + (2 * ; } }\\n  return f(a, );\\n}\\n"
+    bad[1] = good "int h(int a) {\\n  parallel for (a = 0; a < ; a = a + 1) { }\\n  int4 v = int4(a, a;\\n  return a;\\n}\\n"
+    bad[2] = good "int h(int a) {\\n  if (a) { { a = f(a + 1); }\\n"
+    bad[3] = good "int k = f(1) +;\\nint h(int a) { return a; }\\nvoid v;\\n"
+    send("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}")
+    send("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"file:///soak.sy\",\"languageId\":\"sysy\",\"version\":0,\"text\":\"" good "\"}}}")
+    for (i = 1; i <= runs; i++) {
+        change(i, bad[i % 4])
+    }
+    send("{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"shutdown\"}")
+    send("{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}")
+}' | "$PARSER" --lsp 2>&1 >/dev/null | awk -v runs="$RUNS" -v slack="$SLACK_KB" '
+/RSS [0-9]+ KB/ {
+    rss = $(NF - 1)
+    if (++n == int(runs / 10) + 1) {
+        baseline = rss
+    }
+}
+END {
+    if (n < runs) {
+        print "lsp-soak: the server answered " n " of " runs + 1 " messages"
+        exit 1
+    }
+    print "lsp-soak: " runs " changes, RSS " baseline " KB after warm-up, " rss " KB at the end"
+    if (rss - baseline > slack) {
+        print "lsp-soak: resident memory grew by " rss - baseline " KB"
+        exit 1
+    }
+}'
@@ -0,0 +1,69 @@
+#!/bin/bash
+# parallel for 的加速比：每个 bench/parallel/*.sy 程序用 JIT 分别以 1、2、4 …… 个线程运行
+# （SYSY_THREADS），检查输出与单线程一致，报告时间和相对单线程的加速比。
+#   bench/parallel.sh [程序.sy ...]   不给参数时跑 bench/parallel/ 下全部程序
+# 环境变量：PARSER（默认 ../parser）、OPT（默认 -O2）、REPEAT（默认 3，取最短）、
+# THREADS（默认从 1 翻倍到 CPU 数）
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+PARSER=${PARSER:-$here/../parser}
+OPT=${OPT:--O2}
+REPEAT=${REPEAT:-3}
+if [ -z "${THREADS:-}" ]; then
+	THREADS=
+	for ((t = 1; t < $(nproc); t *= 2)); do
+		THREADS="$THREADS $t"
+	done
+	THREADS="$THREADS $(nproc)"
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# best <线程数> <输入> <程序>：运行 REPEAT 次，打印最短的墙钟时间（微秒），
+# 最后一次的输出留在 $work/<线程数>.out；运行失败时返回 1
+best() {
+	local threads=$1 input=$2 prog=$3 shortest= start end t
+	for ((i = 0; i < REPEAT; i++)); do
+		start=$(date +%s%N)
+		SYSY_THREADS=$threads "$PARSER" --run $OPT -fint32 "$prog" < "$input" > "$work/$threads.out" 2> "$work/$threads.err" || return 1
+		end=$(date +%s%N)
+		t=$(( (end - start) / 1000 ))
+		if [ -z "$shortest" ] || [ "$t" -lt "$shortest" ]; then
+			shortest=$t
+		fi
+	done
+	echo "$shortest"
+}
+
+if [ $# -eq 0 ]; then
+	set -- "$here"/parallel/*.sy
+fi
+
+failed=0
+printf "%-12s %8s %10s %8s  %s\n" program threads "ms" speedup status
+for prog in "$@"; do
+	name=$(basename "$prog" .sy)
+	input=${prog%.sy}.in
+	[ -f "$input" ] || input=/dev/null
+	serial=
+	for threads in $THREADS; do
+		status=ok
+		t=$(best "$threads" "$input" "$prog") || status="运行失败"
+		if [ -z "$serial" ]; then
+			serial=$t
+			cp "$work/$threads.out" "$work/serial.out"
+		elif ! cmp -s "$work/serial.out" "$work/$threads.out"; then
+			status="输出与单线程不同"
+		fi
+		if [ "$status" != ok ]; then
+			failed=1
+			printf "%-12s %8s  %s\n" "$name" "$threads" "$status"
+			continue
+		fi
+		printf "%-12s %8s %10s %8s  %s\n" "$name" "$threads" \
+			"$(awk -v t="$t" 'BEGIN { printf "%.1f", t / 1000 }')" \
+			"$(awk -v a="$serial" -v b="$t" 'BEGIN { printf("%.2fx", b > 0 ? a / b : 0) }')" "$status"
+	done
+done
+exit $failed
@@ -0,0 +1,71 @@
+#!/bin/bash
+# 手写的递归下降语法分析器（rdparser.cpp，默认）与 bison 生成的 yyparse（--bison）的解析时间对比。
+# 把 bench/ 下的程序拼成大文件，先检查两边 --emit-dot 写出的语法树完全一致，
+# 再各用 -fsyntax-only 分析 REPEAT 遍，报告去掉启动时间后的毫秒数和每秒分析的字节数。
+#   bench/parser.sh [源文件 ...]   不给参数时用 bench/*.sy 生成
+# 环境变量：PARSER（默认 ../parser）、SIZE（生成的文件大小，单位 MB，默认 16）、REPEAT（默认 3，取最短）
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+PARSER=${PARSER:-$here/../parser}
+SIZE=${SIZE:-16}
+REPEAT=${REPEAT:-3}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+if [ $# -eq 0 ]; then
+	set -- "$here"/*.sy
+fi
+
+# 同名函数在一个文件里重复出现也能通过语法分析，这里不做语义检查
+cat "$@" > "$work/unit.sy"
+unit=$(stat -c %s "$work/unit.sy")
+copies=$(( SIZE * 1000000 / unit + 1 ))
+for ((i = 0; i < copies; i++)); do
+	cat "$work/unit.sy"
+done > "$work/big.sy"
+echo 'int main() { return 0; }' > "$work/empty.sy"
+
+failed=0
+"$PARSER" --emit-dot -o "$work/rd.dot" "$work/unit.sy" || failed=1
+"$PARSER" --bison --emit-dot -o "$work/bison.dot" "$work/unit.sy" || failed=1
+if [ $failed -ne 0 ] || ! cmp -s "$work/rd.dot" "$work/bison.dot"; then
+	echo "两个语法分析器建出的语法树不一致：" >&2
+	diff "$work/rd.dot" "$work/bison.dot" | head -20 >&2
+	exit 1
+fi
+
+# best <文件> [选项 ...]：运行 REPEAT 遍 -fsyntax-only，打印最短的一遍的纳秒数
+best() {
+	local file=$1 start t shortest=
+	shift
+	for ((i = 0; i < REPEAT; i++)); do
+		start=$(date +%s%N)
+		"$PARSER" "$@" -fsyntax-only "$file" || return 1
+		t=$(( $(date +%s%N) - start ))
+		if [ -z "$shortest" ] || [ "$t" -lt "$shortest" ]; then
+			shortest=$t
+		fi
+	done
+	echo "$shortest"
+}
+
+# report <名字> [选项 ...]：扣掉同样选项下分析一个空程序的时间（启动、初始化 LLVM），只留解析本身
+report() {
+	local name=$1 total startup
+	shift
+	total=$(best "$work/big.sy" "$@") || { echo "$name 运行失败" >&2; exit 1; }
+	startup=$(best "$work/empty.sy" "$@") || { echo "$name 运行失败" >&2; exit 1; }
+	echo $(( total > startup ? total - startup : 1 ))
+}
+
+bytes=$(stat -c %s "$work/big.sy")
+echo "输入：$bytes 字节"
+rd=$(report rdparser)
+bison=$(report bison --bison)
+for row in "rdparser $rd" "bison $bison"; do
+	set -- $row
+	awk -v name="$1" -v ns="$2" -v bytes="$bytes" \
+		'BEGIN { printf "%-9s %8.1f ms %8.1f MB/s\n", name, ns / 1e6, bytes / ns * 1e3 }'
+done
+awk -v a="$bison" -v b="$rd" 'BEGIN { printf "加速比 %.2fx\n", a / b }'
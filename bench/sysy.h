@@ -0,0 +1,12 @@
+/* 把 SysY 程序当作 C 编译的垫片：bench.sh 用 clang -x c -include sysy.h 编译 .sy 文件。
+   运行时函数与 corefn.cpp 在模块里生成的版本行为一致，int 按 -fint32 取 32 位 */
+#include <stdio.h>
+
+static int getint(void) { long long v = 0; scanf("%lld", &v); return (int)v; }
+static int getch(void) { return getchar(); }
+static void putint(int v) { printf("%d", v); }
+static void putch(int c) { putchar(c); }
+static void echo(int v) { printf("%d\n", v); }
+
+/* 本编译器的 float 按 double 生成 */
+#define float double
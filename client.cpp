@@ -0,0 +1,84 @@
+// client.cpp: 编译服务器的瘦客户端，用法与 parser 相同
+//   sysyc [--socket <路径>] [--time] [parser 的选项] [源文件]
+// 把当前目录、参数和自己的 stdin / stdout / stderr 交给服务器，
+// 等它编译完成后以同样的退出码退出。
+#include "daemon.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <sys/time.h>
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    struct timeval started, finished;
+    gettimeofday(&started, NULL);
+
+    const char *path = getenv("SYSY_DAEMON_SOCKET");
+    if (!path) {
+        path = DEFAULT_DAEMON_SOCKET;
+    }
+    bool showTime = false;
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return 2;
+    }
+    vector<string> fields;
+    fields.push_back(cwd);
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            path = argv[++i];
+        } else if (arg == "--time") {
+            showTime = true;
+        } else {
+            fields.push_back(arg);
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        cerr << "无法连接编译服务器 " << path << "，请先运行 parser --daemon " << path << endl;
+        return 2;
+    }
+
+    int fds[3] = { 0, 1, 2 };
+    if (!sendRequest(sock, fields, fds)) {
+        cerr << "发送请求失败" << endl;
+        return 2;
+    }
+
+    string reply;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(sock, buffer, sizeof(buffer))) > 0) {
+        reply.append(buffer, n);
+    }
+    close(sock);
+
+    istringstream in(reply);
+    string key;
+    int status = -1;
+    double wall = 0, user = 0, sys = 0;
+    long maxrss = 0;
+    in >> key >> status >> key >> wall >> key >> user >> key >> sys >> key >> maxrss;
+    if (!in) {
+        cerr << "编译服务器没有返回结果" << endl;
+        return 2;
+    }
+    if (showTime) {
+        gettimeofday(&finished, NULL);
+        double total = (finished.tv_sec - started.tv_sec) * 1000.0 + (finished.tv_usec - started.tv_usec) / 1000.0;
+        fprintf(stderr, "编译 %.3f ms（用户态 %.3f ms，内核态 %.3f ms，峰值内存 %ld KB），客户端总计 %.3f ms\n",
+            wall, user, sys, maxrss, total);
+    }
+    return status;
+}
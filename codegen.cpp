@@ -1,13 +1,42 @@
 #include "node.h"
 #include "codegen.h"
 #include "parser.hpp"
+#include "jit.h"
+#include "consteval.h"
+#include "narrow.h"
+#include "profile.h"
+#include "multiversion.h"
+#include "memoize.h"
+#include "remarks.h"
+#include "target.h"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Target/TargetMachine.h>
 
 using namespace std;
 
+// 关闭 verbose 时的跟踪输出去处：没有 streambuf，写入直接被丢弃
+static std::ostream nullStream(NULL);
+// emitBitcode 写进位码的模块标志，值是 intBits
+static const char *IntBitsFlag = "sysy.int-bits";
+
+std::ostream& CodeGenContext::log()
+{
+	return verbose ? std::cout : nullStream;
+}
+
 /* Compile the AST into a module */
 void CodeGenContext::generateCode(NCompUnit& root)
 {
-	std::cout << "Generating code...\n";
+	log() << "Generating code...\n";
 	
 	/* Create the top level interpreter function to call as entry */
 	// esun: must create a main bb though there is main func
@@ -23,433 +52,1455 @@ void CodeGenContext::generateCode(NCompUnit& root)
 	// ReturnInst::Create(MyContext, bblock);
 	// popBlock();
 	
-	/* Print the bytecode in a human-readable format 
-	   to see if our program compiled properly
-	 */
-	std::cout << "Code is generated.\n";
+	finishCode();
+}
+
+/* Compile one top-level declaration, used by the pipelined driver
+   while the parser is still working on the rest of the file */
+void CodeGenContext::generateDecl(NDecl& decl)
+{
+	log() << "Generating code for " << typeid(decl).name() << endl;
+	decl.codeGen(*this);
+}
+
+void CodeGenContext::finishCode()
+{
+	log() << "Code is generated.\n";
 	// module->dump();
+	// 在链接之前：链接后没被用到的函数会被删掉
+	if (memoize && errors == 0) {
+		memoizeFunctions(*module, memoized);
+	}
+	if (!linkInputs.empty() && errors == 0) {
+		linkModules();
+	}
+	// 插桩在优化之前，函数被内联后仍按源程序里的函数计时
+	if (profile && errors == 0) {
+		instrumentProfile(*module);
+	}
+	if (!multiversion.empty() && errors == 0) {
+		if (!multiversionFunctions(*module, multiversion, target)) {
+			errors++;
+		}
+	}
+	if (verifyModule(*module, &errs())) {
+		error("generated module is broken");
+	}
+	else if (optLevel > 0 && errors == 0) {
+		optimize();
+	}
+}
 
+/* Print the bytecode in a human-readable format */
+void CodeGenContext::printCode(raw_ostream& out)
+{
 	legacy::PassManager pm;
-	// TODO:
-	pm.add(createPrintModulePass(outs()));
+	pm.add(createPrintModulePass(out));
 	pm.run(*module);
 }
 
-/* Executes the AST by running the main function */
-GenericValue CodeGenContext::runCode() {
-	std::cout << "Running code...\n";
-	ExecutionEngine *ee = EngineBuilder( unique_ptr<Module>(module) ).create();
-	if (!ee) {
-		std:cerr << "Failed to create Execution Engine." << std::endl;
-		exit(1);
+void CodeGenContext::optimize()
+{
+	std::unique_ptr<TargetMachine> machine = createTargetMachine(target);
+	if (machine) {
+		// 向量化等要知道目标 CPU 的寄存器宽度和代价模型
+		module->setTargetTriple(machine->getTargetTriple().str());
+		module->setDataLayout(machine->createDataLayout());
 	}
-	ee->finalizeObject();
-	// init all global variables
-	ee->runStaticConstructorsDestructors(false);
+	LoopAnalysisManager lam;
+	FunctionAnalysisManager fam;
+	CGSCCAnalysisManager cgam;
+	ModuleAnalysisManager mam;
+	PassBuilder builder(machine.get());
+	if (narrowInts) {
+		builder.registerVectorizerStartEPCallback([](FunctionPassManager& passes, OptimizationLevel) {
+			passes.addPass(NarrowIntegersPass());
+			passes.addPass(InstCombinePass());
+		});
+	}
+	builder.registerModuleAnalyses(mam);
+	builder.registerCGSCCAnalyses(cgam);
+	builder.registerFunctionAnalyses(fam);
+	builder.registerLoopAnalyses(lam);
+	builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+	OptimizationLevel level = optLevel == 1 ? OptimizationLevel::O1 :
+		optLevel == 2 ? OptimizationLevel::O2 : OptimizationLevel::O3;
+	// 链接后整个程序都在模块里，用 LTO 流水线跨文件内联；-c 时用链接前的流水线，
+	// 留着外部函数等链接后再决定去留
+	ModulePassManager passes = !linkInputs.empty() ? builder.buildLTODefaultPipeline(level, nullptr) :
+		separate ? builder.buildLTOPreLinkDefaultPipeline(level) :
+		builder.buildPerModuleDefaultPipeline(level);
+	// 优化备注经诊断处理器收进 remarks，跑完流水线换回原来的处理器
+	std::unique_ptr<DiagnosticHandler> previous;
+	if (remarks) {
+		previous = llvmContext.getDiagnosticHandler();
+		llvmContext.setDiagnosticHandler(remarks->handler());
+	}
+	passes.run(*module, mam);
+	if (remarks) {
+		llvmContext.setDiagnosticHandler(std::move(previous));
+	}
+	log() << "Optimized at -O" << optLevel << ".\n";
+}
 
-	// find a function named main
-	Function *mainFunction = module->getFunction("main");
-	if (!mainFunction) {
-		std::cerr << "Function main not found." << std::endl;
-		exit(1);
+/* Compile the module into a native object file for the host */
+bool CodeGenContext::emitObject(const std::string& path)
+{
+	std::unique_ptr<TargetMachine> machine = createTargetMachine(target);
+	if (!machine) {
+		return false;
 	}
+	module->setTargetTriple(machine->getTargetTriple().str());
+	module->setDataLayout(machine->createDataLayout());
 
-	vector<GenericValue> noargs;
-	GenericValue v = ee->runFunction(mainFunction, noargs);
-	std::cout << "Code was run.\n";
-	return v;
+	std::error_code ec;
+	raw_fd_ostream out(path, ec, sys::fs::OF_None);
+	if (ec) {
+		std::cerr << "无法创建 " << path << ": " << ec.message() << std::endl;
+		return false;
+	}
+	legacy::PassManager pm;
+	if (machine->addPassesToEmitFile(pm, out, nullptr, CGFT_ObjectFile)) {
+		std::cerr << "Target cannot emit object files." << std::endl;
+		return false;
+	}
+	pm.run(*module);
+	return true;
+}
+
+bool CodeGenContext::emitBitcode(const std::string& path)
+{
+	// 和目标文件一样带上三元组和数据布局，链接时与主模块一致
+	std::unique_ptr<TargetMachine> machine = createTargetMachine(target);
+	if (!machine) {
+		return false;
+	}
+	module->setTargetTriple(machine->getTargetTriple().str());
+	module->setDataLayout(machine->createDataLayout());
+
+	std::error_code ec;
+	raw_fd_ostream out(path, ec, sys::fs::OF_None);
+	if (ec) {
+		std::cerr << "无法创建 " << path << ": " << ec.message() << std::endl;
+		return false;
+	}
+	// 记下 int 的位宽，链接时拒绝 -fint32 与默认 64 位混用
+	module->addModuleFlag(Module::Error, IntBitsFlag, intBits);
+	WriteBitcodeToFile(*module, out);
+	return true;
+}
+
+static string typeName(Type *type)
+{
+	string text;
+	raw_string_ostream os(text);
+	type->print(os);
+	return os.str();
+}
+
+// 链接器只按名字合并，i32 的声明配上 i64 的定义也照样链接，要到运行时才出错
+bool CodeGenContext::checkLinkInput(const std::string& path, Module& input)
+{
+	if (ConstantInt *bits = mdconst::extract_or_null<ConstantInt>(input.getModuleFlag(IntBitsFlag))) {
+		if (bits->getZExtValue() != intBits) {
+			error(path + " 按 " + to_string(bits->getZExtValue()) + " 位 int 编译，当前是 " +
+				to_string(intBits) + " 位（-fint32 要一致）");
+			return false;
+		}
+	}
+	bool ok = true;
+	for (Function& incoming : input) {
+		if (incoming.hasLocalLinkage()) {
+			continue;
+		}
+		Function *existing = module->getFunction(incoming.getName());
+		if (existing && !existing->hasLocalLinkage() &&
+			existing->getFunctionType() != incoming.getFunctionType()) {
+			error(path + ": 函数 " + incoming.getName().str() + " 的类型 " + typeName(incoming.getFunctionType()) +
+				" 与已有的 " + typeName(existing->getFunctionType()) + " 不一致");
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+void CodeGenContext::linkModules()
+{
+	// 链接器拿目标模块的三元组和数据布局与输入比对，先按本机填上
+	if (std::unique_ptr<TargetMachine> machine = createTargetMachine(target)) {
+		module->setTargetTriple(machine->getTargetTriple().str());
+		module->setDataLayout(machine->createDataLayout());
+	}
+	Linker linker(*module);
+	for (auto& path : linkInputs) {
+		ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+		if (!buffer) {
+			error("无法读取 " + path + ": " + buffer.getError().message());
+			return;
+		}
+		Expected<std::unique_ptr<Module> > input = parseBitcodeFile(**buffer, llvmContext);
+		if (!input) {
+			error(path + ": " + toString(input.takeError()));
+			return;
+		}
+		if (!checkLinkInput(path, **input)) {
+			return;
+		}
+		// 重复定义等冲突由链接器报告
+		if (linker.linkInModule(std::move(*input))) {
+			error("链接 " + path + " 失败");
+			return;
+		}
+		log() << "Linked " << path << "\n";
+	}
+	// 程序已经完整，只有 main 要留给 JIT 和启动代码，其余都能内联或删掉
+	internalizeModule(*module, [](const GlobalValue& value) { return value.getName() == "main"; });
+	legacy::PassManager pm;
+	pm.add(createGlobalDCEPass());
+	pm.run(*module);
+}
+
+orc::ThreadSafeModule CodeGenContext::takeModule()
+{
+	orc::ThreadSafeModule taken(std::unique_ptr<Module>(module), std::move(ownedContext));
+	module = NULL;
+	return taken;
+}
+
+/* Executes the AST by running the main function */
+bool CodeGenContext::runCode(JitSession& jit) {
+	log() << "Running code...\n";
+	long long result;
+	if (!jit.run(takeModule(), result, intType()->getBitWidth())) {
+		return false;
+	}
+	log() << "Code was run, main returned " << result << ".\n";
+	return true;
 }
 
 /* Returns an LLVM type based on the identifier */
-static Type *typeOf(const NIdent& type) 
+static Type *typeOf(const NIdent& type, CodeGenContext& context) 
 {
 	if (type.type == TINTTYPE) {
-		return Type::getInt64Ty(MyContext);
+		return context.intType();
 	}
 	else if (type.type == TFLOATTYPE) {
-		return Type::getDoubleTy(MyContext);
+		return Type::getDoubleTy(context.llvmContext);
 	}
-	return Type::getVoidTy(MyContext);
+	// 向量的元素固定是 32 位，int4 / float4 正好放进一个 SSE 寄存器，int8 / float8 放进一个 AVX 寄存器
+	switch (type.type) {
+		case TINT4TYPE:		return FixedVectorType::get(Type::getInt32Ty(context.llvmContext), 4);
+		case TINT8TYPE:		return FixedVectorType::get(Type::getInt32Ty(context.llvmContext), 8);
+		case TFLOAT4TYPE:	return FixedVectorType::get(Type::getFloatTy(context.llvmContext), 4);
+		case TFLOAT8TYPE:	return FixedVectorType::get(Type::getFloatTy(context.llvmContext), 8);
+	}
+	return Type::getVoidTy(context.llvmContext);
 }
 
-/* -- Code Generation -- */
+/* Type of the value stored behind a local (alloca) or a global */
+static Type *storedType(Value *ptr)
+{
+	if (AllocaInst *alloca = dyn_cast<AllocaInst>(ptr)) {
+		return alloca->getAllocatedType();
+	}
+	if (GlobalVariable *gvar = dyn_cast<GlobalVariable>(ptr)) {
+		return gvar->getValueType();
+	}
+	// parallel for 的循环体经 env 拿到的外层变量地址
+	if (PointerType *pointer = dyn_cast<PointerType>(ptr->getType())) {
+		if (!pointer->isOpaque()) {
+			return pointer->getPointerElementType();
+		}
+	}
+	return Type::getInt64Ty(ptr->getContext());
+}
 
-Value* NInteger::codeGen(CodeGenContext& context)
+/* Point the builder at the current block, or leave it detached at global scope
+   so that constant operands still fold */
+static void insertAtEnd(IRBuilder<>& builder, CodeGenContext& context)
 {
-	std::cout << "Creating integer: " << value << endl;
-	return ConstantInt::get(Type::getInt64Ty(MyContext), value, true);
+	if (context.currentBlock()) {
+		builder.SetInsertPoint(context.currentBlock());
+	}
 }
 
-Value* NFloat::codeGen(CodeGenContext& context)
+/* Implicit conversion between int, float and bool values. A scalar converts to a
+   vector by filling every lane; vectors convert lane-wise when the lane counts match.
+   Anything else is returned unchanged, see convertChecked */
+static Value *convertTo(IRBuilder<>& builder, Value *value, Type *type)
 {
-	std::cout << "Creating double: " << value << endl;
-	return ConstantFP::get(Type::getDoubleTy(MyContext), value);
+	Type *from = value->getType();
+	if (from == type || type->isVoidTy()) {
+		return value;
+	}
+	if (FixedVectorType *vector = dyn_cast<FixedVectorType>(type)) {
+		if (!from->isVectorTy()) {
+			return builder.CreateVectorSplat(vector->getNumElements(), convertTo(builder, value, vector->getElementType()));
+		}
+		if (cast<FixedVectorType>(from)->getNumElements() != vector->getNumElements()) {
+			return value;
+		}
+		if (from->isIntOrIntVectorTy() && type->isFPOrFPVectorTy()) {
+			return builder.CreateSIToFP(value, type);
+		}
+		if (from->isFPOrFPVectorTy() && type->isIntOrIntVectorTy()) {
+			return builder.CreateFPToSI(value, type);
+		}
+		return value;
+	}
+	if (from->isVectorTy()) {
+		return value;
+	}
+	if (from->isIntegerTy() && type->isIntegerTy()) {
+		if (from->isIntegerTy(1)) {
+			return builder.CreateZExt(value, type);
+		}
+		return builder.CreateSExtOrTrunc(value, type);
+	}
+	if (from->isIntegerTy() && type->isFloatingPointTy()) {
+		return builder.CreateSIToFP(value, type);
+	}
+	if (from->isFloatingPointTy() && type->isIntegerTy()) {
+		return builder.CreateFPToSI(value, type);
+	}
+	if (from->isFloatingPointTy() && type->isFloatingPointTy()) {
+		return builder.CreateFPCast(value, type);
+	}
+	return value;
 }
 
-Value* NIdent::codeGen(CodeGenContext& context)
+/* convertTo where the result must have exactly the given type */
+static Value *convertChecked(CodeGenContext& context, IRBuilder<>& builder, Value *value, Type *type, const std::string& what)
 {
-	std::cout << "Creating identifier reference: " << name << endl;
+	value = convertTo(builder, value, type);
+	if (value->getType() == type || type->isVoidTy()) {
+		return value;
+	}
+	std::string from, to;
+	raw_string_ostream fromOut(from), toOut(to);
+	value->getType()->print(fromOut);
+	type->print(toOut);
+	context.error("cannot convert " + fromOut.str() + " to " + toOut.str() + " in " + what);
+	return UndefValue::get(type);
+}
 
-	if (context.locals().find(name) != context.locals().end()) {
-		return new LoadInst(context.locals()[name]->getType(), context.locals()[name], name, false, context.currentBlock());
-	} else if (context.module->getGlobalVariable(name.c_str())) {
-		auto gvar = context.module->getNamedGlobal(name.c_str());
-		IRBuilder<> builder(context.currentBlock());
-		return builder.CreateLoad(gvar->getType()->getPointerElementType(), gvar, "");
+/* Condition value for branches and logical operators */
+static Value *toBool(IRBuilder<>& builder, Value *value)
+{
+	Type *type = value->getType();
+	if (type->isIntegerTy(1)) {
+		return value;
+	}
+	if (type->isFloatingPointTy()) {
+		return builder.CreateFCmpONE(value, ConstantFP::get(type, 0.0));
+	}
+	return builder.CreateICmpNE(value, ConstantInt::get(type, 0));
+}
+
+/* Bring both operands of a binary operator to a common type */
+static void unifyOperands(IRBuilder<>& builder, Value *&lhs, Value *&rhs)
+{
+	Type *l = lhs->getType();
+	Type *r = rhs->getType();
+	if (l == r) {
+		return;
+	}
+	Type *common;
+	if (l->isVectorTy() || r->isVectorTy()) {
+		// 标量铺满向量；同样长度的 int 向量与 float 向量按 float 算
+		common = !r->isVectorTy() || (l->isVectorTy() && l->isFPOrFPVectorTy()) ? l : r;
+	}
+	else if (l->isFloatingPointTy() || r->isFloatingPointTy()) {
+		common = Type::getDoubleTy(builder.getContext());
 	}
 	else {
-		std::cerr << "undeclared variable " << name << endl;
-		return NULL;
+		common = l->getIntegerBitWidth() >= r->getIntegerBitWidth() ? l : r;
+		if (common->isIntegerTy(1)) {
+			common = Type::getInt64Ty(builder.getContext());
+		}
 	}
+	lhs = convertTo(builder, lhs, common);
+	rhs = convertTo(builder, rhs, common);
+}
 
-	
-	// if (context.locals().find(name) == context.locals().end()) {
-	// 	std::cerr << "undeclared variable " << name << endl;
-	// 	return NULL;
-	// }
+/* Return from the function when control falls off its end */
+static void emitDefaultReturn(BasicBlock *block)
+{
+	if (block->getTerminator()) {
+		return;
+	}
+	Type *retType = block->getParent()->getReturnType();
+	if (retType->isVoidTy()) {
+		ReturnInst::Create(block->getContext(), block);
+	}
+	else {
+		ReturnInst::Create(block->getContext(), Constant::getNullValue(retType), block);
+	}
+}
+
+/* LLVM constant of the given type for a compile-time value */
+static Constant *constantFor(const ConstValue& value, Type *type)
+{
+	if (FixedVectorType *vector = dyn_cast<FixedVectorType>(type)) {
+		return ConstantVector::getSplat(vector->getElementCount(), constantFor(value, vector->getElementType()));
+	}
+	if (type->isFloatingPointTy()) {
+		return ConstantFP::get(type, value.asFloat());
+	}
+	return ConstantInt::get(type, value.asInt(), true);
+}
+
+/* -- Code Generation -- */
+
+Value* Node::codeGen(CodeGenContext& context)
+{
+	return context.emit(*this);
+}
+
+bool Node::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	context.pushValue(NULL);
+	return true;
+}
+
+Value* CodeGenContext::emit(Node& root)
+{
+	size_t base = work.size();
+	schedule(root);
+	while (work.size() > base) {
+		size_t top = work.size() - 1;
+		CodeGenFrame frame = work[top];
+		if (frame.node->codeGenStep(*this, frame)) {
+			// a finished node schedules nothing, so it is still on top
+			work.pop_back();
+		}
+		else {
+			work[top] = frame;
+		}
+	}
+	return popValue();
+}
+
+Value* CodeGenContext::error(const std::string& message)
+{
+	std::cerr << message << endl;
+	errors++;
+	return UndefValue::get(intType());
+}
+
+Constant* CodeGenContext::constantOf(const std::string& name)
+{
+	Value *local = lookupLocal(name);
+	if (local != NULL) {
+		return isa<ConstantInt>(local) || isa<ConstantFP>(local) ? cast<Constant>(local) : NULL;
+	}
+	auto it = globals.find(name);
+	return it == globals.end() ? NULL : cast<Constant>(it->second);
+}
+
+bool CodeGenContext::evaluate(const NExpr& expr, ConstValue& value)
+{
+	return evaluateConst(expr, [this](const std::string& name, ConstValue& out) {
+		Constant *known = constantOf(name);
+		if (ConstantInt *i = dyn_cast_or_null<ConstantInt>(known)) {
+			out = ConstValue::ofInt(i->getSExtValue());
+			return true;
+		}
+		if (ConstantFP *f = dyn_cast_or_null<ConstantFP>(known)) {
+			out = ConstValue::ofFloat(f->getValueAPF().convertToDouble());
+			return true;
+		}
+		return false;
+	}, value, intBits);
+}
+
+bool NInteger::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	context.log() << "Creating integer: " << value << endl;
+	context.pushValue(ConstantInt::get(context.intType(), value, true));
+	return true;
+}
+
+bool NFloat::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	context.log() << "Creating double: " << value << endl;
+	context.pushValue(ConstantFP::get(Type::getDoubleTy(context.llvmContext), value));
+	return true;
+}
+
+bool NIdent::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	context.log() << "Creating identifier reference: " << name << endl;
+
+	// const 变量不读内存，直接代入它的值
+	if (Constant *value = context.constantOf(name)) {
+		context.pushValue(value);
+		return true;
+	}
+	Value *ptr = context.lookupLocal(name);
+	if (ptr == NULL) {
+		ptr = context.module->getNamedGlobal(name.c_str());
+	}
+	if (ptr == NULL) {
+		context.pushValue(context.error("undeclared variable " + name));
+		return true;
+	}
+	context.pushValue(new LoadInst(storedType(ptr), ptr, name, false, context.currentBlock()));
+	return true;
+}
+
+/* Vector constructors (int4(...) etc.), lane access, shuffles and horizontal
+   reductions. Returns false when name is not a builtin; misuse is reported and
+   leaves a placeholder in result */
+static bool vectorBuiltin(CodeGenContext& context, IRBuilder<>& builder, const std::string& name,
+	std::vector<Value*>& args, Value *&result)
+{
+	static const char *constructors[] = { "int4", "int8", "float4", "float8" };
+	static const int constructorTypes[] = { TINT4TYPE, TINT8TYPE, TFLOAT4TYPE, TFLOAT8TYPE };
+	for (int i = 0; i < 4; i++) {
+		if (name != constructors[i]) {
+			continue;
+		}
+		FixedVectorType *type = cast<FixedVectorType>(typeOf(NIdent(name, constructorTypes[i]), context));
+		unsigned lanes = type->getNumElements();
+		if (args.size() == 1) {
+			result = convertChecked(context, builder, args[0], type, name);
+			return true;
+		}
+		if (args.size() != lanes) {
+			result = context.error(name + " takes 1 or " + std::to_string(lanes) + " arguments");
+			return true;
+		}
+		result = UndefValue::get(type);
+		for (unsigned lane = 0; lane < lanes; lane++) {
+			Value *element = convertChecked(context, builder, args[lane], type->getElementType(), name);
+			result = builder.CreateInsertElement(result, element, builder.getInt32(lane));
+		}
+		return true;
+	}
+
+	bool isReduce = name == "reduce_add" || name == "reduce_mul" || name == "reduce_min" || name == "reduce_max";
+	if (name != "extract" && name != "insert" && name != "shuffle" && !isReduce) {
+		return false;
+	}
+	if (args.empty() || !args[0]->getType()->isVectorTy()) {
+		result = context.error("first argument of " + name + " must be a vector");
+		return true;
+	}
+	FixedVectorType *type = cast<FixedVectorType>(args[0]->getType());
+	unsigned lanes = type->getNumElements();
+	bool fp = type->isFPOrFPVectorTy();
+
+	// extract(v, i) / insert(v, i, x)：下标可以是变量，越界时结果无定义
+	if (name == "extract" || name == "insert") {
+		size_t expected = name == "extract" ? 2 : 3;
+		if (args.size() != expected || args[1]->getType()->isVectorTy()) {
+			result = context.error(name == "extract" ? "usage: extract(vector, lane)" : "usage: insert(vector, lane, value)");
+			return true;
+		}
+		Value *lane = convertTo(builder, args[1], builder.getInt32Ty());
+		if (name == "extract") {
+			result = builder.CreateExtractElement(args[0], lane);
+		}
+		else {
+			Value *element = convertChecked(context, builder, args[2], type->getElementType(), "insert");
+			result = builder.CreateInsertElement(args[0], element, lane);
+		}
+		return true;
+	}
 
-	// // return nullptr;  
-	// return new LoadInst(context.locals()[name]->getType(),context.locals()[name], name, false, context.currentBlock());
+	// shuffle(a, i0, ..., iN-1) 或 shuffle(a, b, i0, ..., iN-1)：下标是常量，
+	// 两个向量时 b 的第 k 个元素记作 N + k
+	if (name == "shuffle") {
+		Value *second = UndefValue::get(type);
+		size_t first = 1;
+		if (args.size() > 1 && args[1]->getType()->isVectorTy()) {
+			if (args[1]->getType() != type) {
+				result = context.error("shuffle of vectors with different types");
+				return true;
+			}
+			second = args[1];
+			first = 2;
+		}
+		unsigned limit = first == 2 ? 2 * lanes : lanes;
+		if (args.size() - first != lanes) {
+			result = context.error("shuffle needs " + std::to_string(lanes) + " lane indices");
+			return true;
+		}
+		std::vector<int> mask;
+		for (size_t i = first; i < args.size(); i++) {
+			ConstantInt *index = dyn_cast<ConstantInt>(args[i]);
+			if (!index || index->getSExtValue() < 0 || index->getSExtValue() >= limit) {
+				result = context.error("shuffle lane indices must be constants below " + std::to_string(limit));
+				return true;
+			}
+			mask.push_back(index->getSExtValue());
+		}
+		result = builder.CreateShuffleVector(args[0], second, mask);
+		return true;
+	}
+
+	// 横向归约：结果是一个元素。浮点加法允许重结合，按树形两两相加，与 SIMD 指令的做法一致
+	if (args.size() != 1) {
+		result = context.error(name + " takes one vector");
+		return true;
+	}
+	IRBuilder<>::FastMathFlagGuard guard(builder);
+	FastMathFlags flags;
+	flags.setAllowReassoc();
+	builder.setFastMathFlags(flags);
+	if (name == "reduce_add") {
+		result = fp ? builder.CreateFAddReduce(ConstantFP::get(type->getElementType(), -0.0), args[0])
+			: builder.CreateAddReduce(args[0]);
+	}
+	else if (name == "reduce_mul") {
+		result = fp ? builder.CreateFMulReduce(ConstantFP::get(type->getElementType(), 1.0), args[0])
+			: builder.CreateMulReduce(args[0]);
+	}
+	else if (name == "reduce_min") {
+		result = fp ? builder.CreateFPMinReduce(args[0]) : builder.CreateIntMinReduce(args[0], true);
+	}
+	else {
+		result = fp ? builder.CreateFPMaxReduce(args[0]) : builder.CreateIntMaxReduce(args[0], true);
+	}
+	return true;
 }
 
-Value* NMethodCall::codeGen(CodeGenContext& context)
+bool NMethodCall::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
+	if (frame.index < arguments.size()) {
+		context.schedule(*arguments[frame.index++]);
+		return false;
+	}
+
+	std::vector<Value*> args(arguments.size());
+	for (size_t i = arguments.size(); i-- > 0; ) {
+		args[i] = context.popValue();
+	}
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
 	Function *function = context.module->getFunction(id.name.c_str());
 	if (function == NULL) {
-		std::cerr << "no such function " << id.name << endl;
+		Value *result;
+		if (vectorBuiltin(context, builder, id.name, args, result)) {
+			context.log() << "Creating vector builtin: " << id.name << endl;
+			context.pushValue(result);
+			return true;
+		}
+		context.pushValue(context.error("no such function " + id.name));
+		return true;
+	}
+	FunctionType *ftype = function->getFunctionType();
+	if (args.size() < ftype->getNumParams() || (args.size() > ftype->getNumParams() && !ftype->isVarArg())) {
+		context.pushValue(context.error("wrong number of arguments to " + id.name));
+		return true;
 	}
-	std::vector<Value*> args;
-	ExprList::const_iterator it;
-	for (it = arguments.begin(); it != arguments.end(); it++) {
-		args.push_back((**it).codeGen(context));
+	for (size_t i = 0; i < ftype->getNumParams(); i++) {
+		args[i] = convertChecked(context, builder, args[i], ftype->getParamType(i), "argument " + std::to_string(i + 1) + " of " + id.name);
 	}
 	CallInst *call = CallInst::Create(function, makeArrayRef(args), "", context.currentBlock());
-	std::cout << "Creating method call: " << id.name << endl;
-	return call;
+	context.log() << "Creating method call: " << id.name << endl;
+	context.pushValue(call);
+	return true;
 }
 
-Value* NBinaryExpr::codeGen(CodeGenContext& context)
+bool NBinaryExpr::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
+	switch (frame.state++) {
+		case 0: context.schedule(lhs); return false;
+		case 1: context.schedule(rhs); return false;
+	}
 
-	std::cout << "Creating binary operation " << op << endl;
+	context.log() << "Creating binary operation " << op << endl;
+	Value *r = context.popValue();
+	Value *l = context.popValue();
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	unifyOperands(builder, l, r);
+	if (l->getType() != r->getType()) {
+		context.pushValue(context.error("operands of binary operator " + std::to_string(op) + " have incompatible vector types"));
+		return true;
+	}
+	bool fp = l->getType()->isFPOrFPVectorTy();
 	Instruction::BinaryOps instr;
 	switch (op) {
-		case TPLUS: 	instr = Instruction::Add; goto math;
-		case TMINUS: 	instr = Instruction::Sub; goto math;
-		case TMUL: 		instr = Instruction::Mul; goto math;
-		case TDIV: 		instr = Instruction::SDiv; goto math;
-				
-		case TMOD: {
-			Function *modf = context.module->getFunction("mod");
-			if (modf == NULL) {
-				std::vector<Type*> argTypes;
-				argTypes.push_back(Type::getInt64Ty(MyContext));
-				argTypes.push_back(Type::getInt64Ty(MyContext));
-				FunctionType *ftype = FunctionType::get(Type::getInt64Ty(MyContext), makeArrayRef(argTypes), false);
-				modf = Function::Create(ftype, GlobalValue::ExternalLinkage, "mod", context.module);
-				modf->setCallingConv(CallingConv::C);
-			}
-			std::vector<Value*> args;
-			args.push_back(lhs.codeGen(context));
-			args.push_back(rhs.codeGen(context));
-			return CallInst::Create(modf, makeArrayRef(args), "", context.currentBlock());
-		}
+		case TPLUS: 	instr = fp ? Instruction::FAdd : Instruction::Add; break;
+		case TMINUS: 	instr = fp ? Instruction::FSub : Instruction::Sub; break;
+		case TMUL: 		instr = fp ? Instruction::FMul : Instruction::Mul; break;
+		case TDIV: 		instr = fp ? Instruction::FDiv : Instruction::SDiv; break;
+		case TMOD: 		instr = fp ? Instruction::FRem : Instruction::SRem; break;
+		default:
+			context.pushValue(context.error("unknown binary operator " + std::to_string(op)));
+			return true;
 	}
-	return NULL;
-math:
-	return BinaryOperator::Create(instr, lhs.codeGen(context), 
-		rhs.codeGen(context), "", context.currentBlock());
+	context.pushValue(builder.CreateBinOp(instr, l, r));
+	return true;
 }
 
-Value* NLogicalBinaryExpr::codeGen(CodeGenContext& context)
+bool NLogicalBinaryExpr::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Creating logical binary operation " << op << endl;
-	Instruction::BinaryOps instr;
+	switch (frame.state++) {
+		case 0: context.schedule(lhs); return false;
+		case 1: context.schedule(rhs); return false;
+	}
+
+	context.log() << "Creating logical binary operation " << op << endl;
+	Value *r = context.popValue();
+	Value *l = context.popValue();
+	if (l->getType()->isVectorTy() || r->getType()->isVectorTy()) {
+		context.pushValue(context.error("comparison and logical operators do not apply to vectors"));
+		return true;
+	}
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	if (op == TAND || op == TOR) {
+		l = toBool(builder, l);
+		r = toBool(builder, r);
+		context.pushValue(op == TAND ? builder.CreateAnd(l, r) : builder.CreateOr(l, r));
+		return true;
+	}
+
+	unifyOperands(builder, l, r);
+	bool fp = l->getType()->isFloatingPointTy();
 	CmpInst::Predicate pred;
 	switch (op) {
-		case TAND: 	instr = Instruction::And; goto logic;
-		case TOR: 	instr = Instruction::Or; goto logic;
-		case TCEQ: 	pred = CmpInst::ICMP_EQ; goto cmp;
-		case TCNE: 	pred = CmpInst::ICMP_NE; goto cmp;
-		case TCLT: 	pred = CmpInst::ICMP_SLT; goto cmp;
-		case TCLE: 	pred = CmpInst::ICMP_SLE; goto cmp;
-		case TCGT: 	pred = CmpInst::ICMP_SGT; goto cmp;
-		case TCGE: 	pred = CmpInst::ICMP_SGE; goto cmp;
-	}
-	return NULL;
-cmp:
-	return CmpInst::Create(Instruction::ICmp, pred, lhs.codeGen(context), rhs.codeGen(context), "", context.currentBlock());
-logic:
-	return BinaryOperator::Create(instr, lhs.codeGen(context), rhs.codeGen(context), "", context.currentBlock());
-}
-
-Value* NUnaryExpr::codeGen(CodeGenContext& context)
-{
-	std::cout << "Creating unary operation " << op << endl;
-	Instruction::UnaryOps instr;
-	switch (op) {
-		case TMINUS: 	instr = Instruction::UnaryOps::FNeg; goto math;
+		case TCEQ: 	pred = fp ? CmpInst::FCMP_OEQ : CmpInst::ICMP_EQ; break;
+		case TCNE: 	pred = fp ? CmpInst::FCMP_ONE : CmpInst::ICMP_NE; break;
+		case TCLT: 	pred = fp ? CmpInst::FCMP_OLT : CmpInst::ICMP_SLT; break;
+		case TCLE: 	pred = fp ? CmpInst::FCMP_OLE : CmpInst::ICMP_SLE; break;
+		case TCGT: 	pred = fp ? CmpInst::FCMP_OGT : CmpInst::ICMP_SGT; break;
+		case TCGE: 	pred = fp ? CmpInst::FCMP_OGE : CmpInst::ICMP_SGE; break;
+		default:
+			context.pushValue(context.error("unknown logical operator " + std::to_string(op)));
+			return true;
 	}
-	return NULL;
-math:
-	return UnaryOperator::Create(instr, expr.codeGen(context), "", context.currentBlock());
+	context.pushValue(builder.CreateCmp(pred, l, r));
+	return true;
 }
 
-Value* NLogicalUnaryExpr::codeGen(CodeGenContext& context)
+bool NUnaryExpr::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Creating logical unary operation " << op << endl;
-	llvm::IRBuilder<> builder(context.currentBlock());
+	if (frame.state++ == 0) {
+		context.schedule(expr);
+		return false;
+	}
+
+	context.log() << "Creating unary operation " << op << endl;
+	Value *value = context.popValue();
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
 	switch (op) {
-		case TNOT: {
-			llvm::Value *val = expr.codeGen(context);
-			return builder.CreateNot(val, "not");
-		}
+		case TMINUS:
+			value = convertTo(builder, value, value->getType()->isIntegerTy(1) ? context.intType() : value->getType());
+			context.pushValue(value->getType()->isFPOrFPVectorTy() ? builder.CreateFNeg(value) : builder.CreateNeg(value));
+			return true;
 	}
+	context.pushValue(context.error("unknown unary operator " + std::to_string(op)));
+	return true;
 }
 
-Value* NAssignment::codeGen(CodeGenContext& context)
+bool NLogicalUnaryExpr::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Creating assignment for " << lhs.name << endl;
-	
-	if (context.locals().find(lhs.name) != context.locals().end()) {
-		return new StoreInst(rhs.codeGen(context), context.locals()[lhs.name], false, context.currentBlock());
-	} else if (context.module->getGlobalVariable(lhs.name.c_str())) {
-		// do assign here
-		IRBuilder<> builder(context.currentBlock());
-		GlobalVariable *gvar = context.module->getNamedGlobal(lhs.name.c_str());
-		if (gvar == NULL) {
-			std::cerr << "no such global variable " << lhs.name << endl;
-		}
-		return builder.CreateStore(rhs.codeGen(context), gvar);
+	if (frame.state++ == 0) {
+		context.schedule(expr);
+		return false;
 	}
-	else {
-		std::cerr << "undeclared variable " << lhs.name << endl;
-		return NULL;
+
+	context.log() << "Creating logical unary operation " << op << endl;
+	Value *value = context.popValue();
+	if (value->getType()->isVectorTy()) {
+		context.pushValue(context.error("logical operators do not apply to vectors"));
+		return true;
+	}
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	switch (op) {
+		case TNOT:
+			context.pushValue(builder.CreateNot(toBool(builder, value), "not"));
+			return true;
 	}
+	context.pushValue(context.error("unknown logical operator " + std::to_string(op)));
+	return true;
 }
 
-Value* NCompUnit::codeGen(CodeGenContext& context)
+bool NAssignment::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	DeclList::const_iterator it;
-	Value *last = NULL;
-	for (it = decls.begin(); it != decls.end(); it++) {
-		std::cout << "Generating code for " << typeid(**it).name() << endl;
-		last = (**it).codeGen(context);
+	if (frame.state++ == 0) {
+		context.schedule(rhs);
+		return false;
+	}
+
+	context.log() << "Creating assignment for " << lhs.name << endl;
+	Value *value = context.popValue();
+	if (context.constantOf(lhs.name)) {
+		context.pushValue(context.error("cannot assign to const " + lhs.name));
+		return true;
+	}
+	Value *ptr = context.lookupLocal(lhs.name);
+	if (ptr == NULL) {
+		ptr = context.module->getNamedGlobal(lhs.name.c_str());
+	}
+	if (ptr == NULL) {
+		context.pushValue(context.error("undeclared variable " + lhs.name));
+		return true;
 	}
-	std::cout << "Creating CompUnit" << endl;
-	return last;
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	value = convertChecked(context, builder, value, storedType(ptr), "assignment to " + lhs.name);
+	builder.CreateStore(value, ptr);
+	context.pushValue(value);
+	return true;
 }
 
-Value* NBlock::codeGen(CodeGenContext& context)
+bool NCompUnit::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	StmtList::const_iterator it;
-	Value *last = NULL;
-	for (it = statements.begin(); it != statements.end(); it++) {
-		std::cout << "Generating code for " << typeid(**it).name() << endl;
-		last = (**it).codeGen(context);
+	if (frame.index > 0) {
+		context.popValue();
 	}
-	std::cout << "Creating block" << endl;
-	return last;
+	if (frame.index < decls.size()) {
+		context.log() << "Generating code for " << typeid(*decls[frame.index]).name() << endl;
+		context.schedule(*decls[frame.index++]);
+		return false;
+	}
+	context.log() << "Creating CompUnit" << endl;
+	context.pushValue(NULL);
+	return true;
 }
 
-Value* NExprStmt::codeGen(CodeGenContext& context)
+bool NBlock::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Generating code for " << typeid(expression).name() << endl;
-	return expression.codeGen(context);
+	if (frame.state == 0) {
+		context.pushScope();
+		frame.state = 1;
+	}
+	if (frame.index > 0) {
+		context.popValue();
+	}
+	if (frame.index < statements.size()) {
+		context.log() << "Generating code for " << typeid(*statements[frame.index]).name() << endl;
+		context.schedule(*statements[frame.index++]);
+		return false;
+	}
+	context.popScope();
+	context.log() << "Creating block" << endl;
+	context.pushValue(NULL);
+	return true;
 }
 
-Value* NReturnStmt::codeGen(CodeGenContext& context)
+bool NExprStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Generating return code for " << typeid(expression).name() << endl;
-	Value *returnValue = expression.codeGen(context);
-	context.setCurrentReturnValue(returnValue);
-	return returnValue;
+	if (frame.state++ == 0) {
+		context.log() << "Generating code for " << typeid(expression).name() << endl;
+		context.schedule(expression);
+		return false;
+	}
+	// the expression's value stays on the stack as ours
+	return true;
 }
 
-Value* NVarDecl::codeGen(CodeGenContext& context)
+bool NReturnStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
 {
-	std::cout << "Creating variable declaration " << id.type << " " << id.name << endl;
+	if (frame.state++ == 0) {
+		context.log() << "Generating return code for " << typeid(expression).name() << endl;
+		context.schedule(expression);
+		return false;
+	}
 
+	Value *returnValue = context.popValue();
+	if (context.inParallelBody()) {
+		context.pushValue(context.error("return inside parallel for"));
+		return true;
+	}
+	Function *function = context.currentBlock()->getParent();
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	if (function->getReturnType()->isVoidTy()) {
+		builder.CreateRetVoid();
+	}
+	else {
+		builder.CreateRet(convertChecked(context, builder, returnValue, function->getReturnType(), "return from " + function->getName().str()));
+	}
+	// anything after the return in this block is unreachable
+	context.setInsertBlock(BasicBlock::Create(context.llvmContext, "afterReturn", function));
+	context.pushValue(returnValue);
+	return true;
+}
+
+bool NVarDecl::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	Type *type = typeOf(id, context);
 	// if current block is null, then it is a global variable
 	if (context.currentBlock() == NULL) {
-		std::cout << "Creating global variable " << id.name << endl;
-		// Global variable
-		// GlobalVariable *gvar = new GlobalVariable(*context.module, typeOf(id), false, GlobalValue::InternalLinkage, NULL, id.name.c_str());
-		// if (assignmentExpr != NULL)
-		// {
-		// 	gvar->setInitializer(static_cast<llvm::Constant*>(assignmentExpr->codeGen(context)));
-		// }
-		context.module->getOrInsertGlobal(id.name.c_str(), typeOf(id));
-		GlobalVariable *gvar = context.module->getNamedGlobal(id.name.c_str());
-		gvar->setLinkage(GlobalValue::CommonLinkage);
-		if (assignmentExpr != NULL)
-		{
-			// NAssignment assn(id, *assignmentExpr);
-			// std::cout << "gen assn" << std::endl;
-			// Value* result = assn.codeGen(context);
-			// std::cout << "ready for dyn_cast" << std::endl;
-
-			// auto constant = llvm::dyn_cast<llvm::Constant>(assignmentExpr->codeGen(context));
-			// // print out constant
-			// std::cout << "constant: ";
-			// constant->print(outs());
-			// std::cout << "constant end" << std::endl;
-			gvar->setInitializer(llvm::dyn_cast<llvm::Constant>(assignmentExpr->codeGen(context)));
-
-			NInteger *intVal = dynamic_cast<NInteger*>(assignmentExpr);
-			NFloat *floatVal = dynamic_cast<NFloat*>(assignmentExpr);
-
-			context.globals.insert(std::pair<std::string, Value*>(id.name, assignmentExpr->codeGen(context)));
-
-			if (intVal) {
-				gvar->setInitializer(llvm::ConstantInt::get(MyContext, llvm::APInt(64, intVal->value, true)));
-				context.globals.insert(std::pair<std::string, Constant*>(id.name, llvm::ConstantInt::get(MyContext, llvm::APInt(64, intVal->value, true))));
+		context.log() << "Creating global variable " << id.name << endl;
+		// 初始化表达式在 AST 上求值一次，不生成任何指令
+		GlobalVariable *declared = context.module->getNamedGlobal(id.name);
+		if (declared && declared->getValueType() != type && (isExtern || declared->isDeclaration())) {
+			context.pushValue(context.error("conflicting types for global " + id.name));
+			return true;
+		}
+		if (isExtern) {
+			// 已经声明或定义过时沿用原来的，否则留一个外部声明等链接时解析
+			if (!declared) {
+				declared = new GlobalVariable(*context.module, type, false, GlobalValue::ExternalLinkage, NULL, id.name.c_str());
 			}
-			else if (floatVal) {
-				gvar->setInitializer(llvm::ConstantFP::get(MyContext, llvm::APFloat(floatVal->value)));
-				context.globals.insert(std::pair<std::string, Constant*>(id.name, llvm::ConstantFP::get(MyContext, llvm::APFloat(floatVal->value))));
+			context.pushValue(declared);
+			return true;
+		}
+		Constant *init = Constant::getNullValue(type);
+		GlobalValue::LinkageTypes linkage = GlobalValue::CommonLinkage;
+		if (assignmentExpr != NULL) {
+			ConstValue value;
+			if (context.evaluate(*assignmentExpr, value)) {
+				init = constantFor(value, type);
 			}
 			else {
-				gvar->setInitializer(llvm::dyn_cast<llvm::Constant>(assignmentExpr->codeGen(context)));
-				context.globals.insert(std::pair<std::string, Constant*>(id.name, llvm::dyn_cast<llvm::Constant>(assignmentExpr->codeGen(context))));
+				context.error("initializer of global " + id.name + " is not a constant");
 			}
+			// 'common' globals must be zero-initialized
+			linkage = GlobalValue::ExternalLinkage;
+		}
+		if (isConst) {
+			linkage = GlobalValue::InternalLinkage;
+			context.globals[id.name] = init;
 		}
-		// context.globals.insert(std::pair<std::string, Value*>(id.name, gvar));
-		// std::cout << "gb1" << std::endl;
-		// // context.locals()[id.name] = gvar;
-		// std::cout << "gb2" << std::endl;
-		return gvar;
+		GlobalVariable *gvar = new GlobalVariable(*context.module, type, isConst, linkage, init, id.name.c_str());
+		if (declared && declared->isDeclaration()) {
+			// 先有 extern 声明后有定义：已生成的引用改指向定义
+			gvar->takeName(declared);
+			declared->replaceAllUsesWith(gvar);
+			declared->eraseFromParent();
+		}
+		context.pushValue(gvar);
+		return true;
 	}
-	else {
-		AllocaInst *alloc = new AllocaInst(typeOf(id),8, id.name.c_str(), context.currentBlock());
-		context.locals()[id.name] = alloc;
-		if (assignmentExpr != NULL)
-		{
-			NAssignment assn(id, *assignmentExpr);
-			assn.codeGen(context);
-		}
-		return alloc;
-	}
-}
-
-Value* NFuncDecl::codeGen(CodeGenContext& context)
-{
-	vector<Type*> argTypes;
-	VariableList::const_iterator it;
-	for (it = arguments.begin(); it != arguments.end(); it++) {
-		argTypes.push_back(typeOf((**it).id));
-	}
-	FunctionType *ftype = FunctionType::get(typeOf(id), makeArrayRef(argTypes), false);
-	Function *function;
-	// check if is main
-	if (id.name == "main") {
-		function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
-
-		// init all global variables
-		// for (auto& globalVar : context.globals) {
-        //     // Assuming globalVariables is a map of variable names to their initial values
-        //     Value* initValue = globalVar.second;
-        //     if (initValue) {
-		// 		GlobalVariable* gvar = context.module->getNamedGlobal(globalVar.first);
-		// 		if (gvar) {
-		// 			gvar->setInitializer(initValue);
-		// 		}
-		// 	}
-        // }
+
+	if (frame.state++ == 0) {
+		context.log() << "Creating variable declaration " << id.type << " " << id.name << endl;
+		if (isConst) {
+			// const 局部变量不分配栈空间，值登记在作用域里，使用处直接代入
+			Constant *init = Constant::getNullValue(type);
+			ConstValue value;
+			if (assignmentExpr != NULL && context.evaluate(*assignmentExpr, value)) {
+				init = constantFor(value, type);
+			}
+			else {
+				context.error("initializer of const " + id.name + " is not a constant");
+			}
+			context.declareLocal(id.name, init);
+			context.pushValue(init);
+			return true;
+		}
+		// allocas go to the entry block so loops do not grow the stack
+		BasicBlock &entry = context.currentBlock()->getParent()->getEntryBlock();
+		IRBuilder<> builder(&entry, entry.begin());
+		AllocaInst *alloc = builder.CreateAlloca(type, NULL, id.name.c_str());
+		context.declareLocal(id.name, alloc);
+		if (assignmentExpr != NULL) {
+			context.schedule(*assignmentExpr);
+			return false;
+		}
+		context.pushValue(alloc);
+		return true;
 	}
-	else {
-		function = Function::Create(ftype, GlobalValue::InternalLinkage, id.name.c_str(), context.module);
+
+	Value *value = context.popValue();
+	Value *alloc = context.lookupLocal(id.name);
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	builder.CreateStore(convertChecked(context, builder, value, storedType(alloc), "initializer of " + id.name), alloc);
+	context.pushValue(alloc);
+	return true;
+}
+
+bool NFuncDecl::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	if (frame.state++ == 0) {
+		vector<Type*> argTypes;
+		VariableList::const_iterator it;
+		for (it = arguments.begin(); it != arguments.end(); it++) {
+			argTypes.push_back(typeOf((**it).id, context));
+		}
+		FunctionType *ftype = FunctionType::get(typeOf(id, context), makeArrayRef(argTypes), false);
+		// 单文件编译时整个程序都在这个模块里，只有 main 需要导出；
+		// 分开编译时别的模块可能调用这里定义的函数，链接后再统一内部化
+		GlobalValue::LinkageTypes linkage = GlobalValue::InternalLinkage;
+		if (id.name == "main" || context.separate) {
+			linkage = GlobalValue::ExternalLinkage;
+		}
+		Function *function = context.module->getFunction(id.name);
+		if (function && function->getFunctionType() != ftype && (isPrototype || function->isDeclaration())) {
+			context.pushValue(context.error("conflicting types for function " + id.name));
+			return true;
+		}
+		if (isPrototype) {
+			// 原型只声明：已经有同名函数时沿用，否则留给链接器解析
+			if (!function) {
+				function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
+			}
+			context.log() << "Creating function prototype: " << id.name << endl;
+			context.pushValue(function);
+			return true;
+		}
+		if (function && function->isDeclaration()) {
+			// 前面有原型：就地补上函数体，原型之后生成的调用不用改
+			function->setLinkage(linkage);
+		}
+		else {
+			function = Function::Create(ftype, linkage, id.name.c_str(), context.module);
+		}
+		BasicBlock *bblock = BasicBlock::Create(context.llvmContext, "entry", function, 0);
+
+		context.pushBlock(bblock);
+
+		IRBuilder<> builder(bblock);
+		Function::arg_iterator argsValues = function->arg_begin();
+		for (it = arguments.begin(); it != arguments.end(); it++) {
+			Value *argumentValue = &*argsValues++;
+			argumentValue->setName((*it)->id.name.c_str());
+			AllocaInst *alloc = builder.CreateAlloca(argumentValue->getType(), NULL, (*it)->id.name.c_str());
+			builder.CreateStore(argumentValue, alloc);
+			context.declareLocal((*it)->id.name, alloc);
+		}
+
+		frame.blocks[0] = bblock;
+		context.schedule(block);
+		return false;
 	}
-	BasicBlock *bblock = BasicBlock::Create(MyContext, "entry", function, 0);
 
-	context.pushBlock(bblock);
+	context.popValue();
+	emitDefaultReturn(context.currentBlock());
+	Function *function = frame.blocks[0]->getParent();
+	context.popBlock();
+	context.log() << "Creating function: " << id.name << endl;
+	bool recursive;
+	if (context.memoize && isPureFunction(*this, context, recursive)) {
+		context.pureFunctions.insert(id.name);
+		// 不递归的纯函数每个参数大多只算一次，查表反而更慢
+		if (recursive) {
+			context.log() << "Memoizing function: " << id.name << endl;
+			context.memoized.push_back(function);
+		}
+	}
+	context.pushValue(function);
+	return true;
+}
 
-	Function::arg_iterator argsValues = function->arg_begin();
-    Value* argumentValue;
+/* Distinct self-referencing loop ID carrying the #pragma hints, see LangRef "llvm.loop" */
+static MDNode *loopMetadata(LLVMContext& llvmContext, const LoopHints& hints)
+{
+	std::vector<Metadata*> operands;
+	operands.push_back(NULL);
+	Type *i32 = Type::getInt32Ty(llvmContext);
+	auto flag = [&](const char *name) {
+		operands.push_back(MDNode::get(llvmContext, MDString::get(llvmContext, name)));
+	};
+	auto setting = [&](const char *name, Constant *value) {
+		Metadata *pair[] = { MDString::get(llvmContext, name), ConstantAsMetadata::get(value) };
+		operands.push_back(MDNode::get(llvmContext, pair));
+	};
+	if (hints.unroll < 0) {
+		flag("llvm.loop.unroll.disable");
+	}
+	else if (hints.unroll == 1) {
+		flag("llvm.loop.unroll.enable");
+	}
+	else if (hints.unroll > 1) {
+		setting("llvm.loop.unroll.count", ConstantInt::get(i32, hints.unroll));
+	}
+	if (hints.vectorize != 0) {
+		setting("llvm.loop.vectorize.enable", ConstantInt::get(Type::getInt1Ty(llvmContext), hints.vectorize > 0));
+	}
+	if (hints.vectorize > 1) {
+		setting("llvm.loop.vectorize.width", ConstantInt::get(i32, hints.vectorize));
+	}
+	MDNode *loopID = MDNode::getDistinct(llvmContext, operands);
+	loopID->replaceOperandWith(0, loopID);
+	return loopID;
+}
 
-	for (it = arguments.begin(); it != arguments.end(); it++) {
-		(**it).codeGen(context);
-		
-		argumentValue = &*argsValues++;
-		argumentValue->setName((*it)->id.name.c_str());
-		StoreInst *inst = new StoreInst(argumentValue, context.locals()[(*it)->id.name], false, bblock);
+bool NWhileStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	Function *function = context.currentBlock()->getParent();
+	switch (frame.state++) {
+		case 0: {
+			BasicBlock *condBB = BasicBlock::Create(context.llvmContext, "whileCond", function);
+			BasicBlock *afterBB = BasicBlock::Create(context.llvmContext, "whileEnd", function);
+			frame.blocks[0] = condBB;
+			frame.blocks[2] = afterBB;
+
+			// Branch to the condition block
+			builder.CreateBr(condBB);
+
+			// Generate code for the condition
+			context.setInsertBlock(condBB);
+			context.schedule(condition);
+			return false;
+		}
+		case 1: {
+			BasicBlock *loopBB = BasicBlock::Create(context.llvmContext, "whileLoop", function, frame.blocks[2]);
+			// 循环体末尾和 continue 都跳到同一个回边块，llvm.loop 元数据只挂在这一条回边上
+			frame.blocks[1] = BasicBlock::Create(context.llvmContext, "whileLatch");
+			Value *condValue = toBool(builder, context.popValue());
+			builder.CreateCondBr(condValue, loopBB, frame.blocks[2]);
+
+			// Generate code for the loop body
+			context.pushLoop(frame.blocks[1], frame.blocks[2]);
+			context.setInsertBlock(loopBB);
+			context.schedule(block);
+			return false;
+		}
 	}
-	
-	block.codeGen(context);
-	ReturnInst::Create(MyContext, context.getCurrentReturnValue(), bblock);
 
+	context.popValue();
+	context.popLoop();
+	builder.CreateBr(frame.blocks[1]);
+	frame.blocks[1]->insertInto(function, frame.blocks[2]);
+	builder.SetInsertPoint(frame.blocks[1]);
+	BranchInst *backEdge = builder.CreateBr(frame.blocks[0]);
+	if (!hints.empty()) {
+		backEdge->setMetadata(LLVMContext::MD_loop, loopMetadata(context.llvmContext, hints));
+	}
+
+	// Set the insertion point to the after block
+	context.setInsertBlock(frame.blocks[2]);
+	context.pushValue(NULL);
+	return true;
+}
+
+/* Identity of a reduction operator, the initial value of every thread's private copy */
+static Constant *reductionIdentity(const std::string& op, Type *type)
+{
+	if (type->isFloatingPointTy()) {
+		if (op == "+") return ConstantFP::get(type, 0.0);
+		if (op == "*") return ConstantFP::get(type, 1.0);
+		return ConstantFP::getInfinity(type, op == "max");
+	}
+	unsigned bits = type->getIntegerBitWidth();
+	if (op == "+") return ConstantInt::get(type, 0);
+	if (op == "*") return ConstantInt::get(type, 1);
+	return ConstantInt::get(type->getContext(), op == "min" ? APInt::getSignedMaxValue(bits) : APInt::getSignedMinValue(bits));
+}
+
+static Value *combineReduction(IRBuilder<>& builder, const std::string& op, Value *a, Value *b)
+{
+	bool fp = a->getType()->isFloatingPointTy();
+	if (op == "+") return fp ? builder.CreateFAdd(a, b) : builder.CreateAdd(a, b);
+	if (op == "*") return fp ? builder.CreateFMul(a, b) : builder.CreateMul(a, b);
+	if (fp) {
+		return op == "min" ? builder.CreateMinNum(a, b) : builder.CreateMaxNum(a, b);
+	}
+	Value *less = builder.CreateICmpSLT(a, b);
+	return op == "min" ? builder.CreateSelect(less, a, b) : builder.CreateSelect(less, b, a);
+}
+
+/* Merge a thread's partial result into the shared variable with a compare-exchange
+   loop, which works for every operator and for floats alike */
+static void atomicReduce(IRBuilder<>& builder, const std::string& op, Value *shared, Value *partial)
+{
+	Type *type = partial->getType();
+	IntegerType *bits = IntegerType::get(builder.getContext(), type->getPrimitiveSizeInBits());
+	Value *address = builder.CreatePointerCast(shared, bits->getPointerTo());
+	BasicBlock *before = builder.GetInsertBlock();
+	Function *function = before->getParent();
+	Value *initial = builder.CreateLoad(bits, address);
+	BasicBlock *retry = BasicBlock::Create(builder.getContext(), "reduce", function);
+	BasicBlock *done = BasicBlock::Create(builder.getContext(), "reduced", function);
+	builder.CreateBr(retry);
+
+	builder.SetInsertPoint(retry);
+	PHINode *expected = builder.CreatePHI(bits, 2);
+	expected->addIncoming(initial, before);
+	Value *combined = combineReduction(builder, op, builder.CreateBitCast(expected, type), partial);
+	Value *exchange = builder.CreateAtomicCmpXchg(address, expected, builder.CreateBitCast(combined, bits), MaybeAlign(),
+		AtomicOrdering::SequentiallyConsistent, AtomicOrdering::SequentiallyConsistent);
+	expected->addIncoming(builder.CreateExtractValue(exchange, 0), retry);
+	builder.CreateCondBr(builder.CreateExtractValue(exchange, 1), done, retry);
+	builder.SetInsertPoint(done);
+}
+
+/* Fills loop.header with the loop variable, lower bound, upper bound and constant
+   step of a canonical parallel for header; reports misuse and returns false */
+static bool parallelHeader(CodeGenContext& context, NParallelFor& loop)
+{
+	NParallelFor::Header& header = loop.header;
+	NAssignment *init = dynamic_cast<NAssignment*>(&loop.init);
+	NLogicalBinaryExpr *cond = dynamic_cast<NLogicalBinaryExpr*>(&loop.condition);
+	NAssignment *next = dynamic_cast<NAssignment*>(&loop.step);
+	if (!init) {
+		context.error("parallel for must start with an assignment to the loop variable");
+		return false;
+	}
+	header.var = &init->lhs;
+	header.start = &init->rhs;
+	NIdent *compared = cond ? dynamic_cast<NIdent*>(&cond->lhs) : NULL;
+	if (!compared || compared->name != header.var->name || (cond->op != TCLT && cond->op != TCLE)) {
+		context.error("parallel for condition must be " + header.var->name + " < bound or " + header.var->name + " <= bound");
+		return false;
+	}
+	header.bound = &cond->rhs;
+	header.inclusive = cond->op == TCLE;
+	NBinaryExpr *sum = next && next->lhs.name == header.var->name ? dynamic_cast<NBinaryExpr*>(&next->rhs) : NULL;
+	NIdent *incremented = sum && sum->op == TPLUS ? dynamic_cast<NIdent*>(&sum->lhs) : NULL;
+	ConstValue value;
+	if (!incremented || incremented->name != header.var->name || !context.evaluate(sum->rhs, value) || value.asInt() <= 0) {
+		context.error("parallel for step must be " + header.var->name + " = " + header.var->name + " + a positive integer constant");
+		return false;
+	}
+	header.step = value.asInt();
+	return true;
+}
+
+bool NParallelFor::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	// 循环头只在第一步检查一次，报错也只报一次
+	if (frame.state == 0 && !parallelHeader(context, *this)) {
+		context.pushValue(UndefValue::get(context.intType()));
+		return true;
+	}
+	NIdent *var = header.var;
+	NExpr *start = header.start, *bound = header.bound;
+	bool inclusive = header.inclusive;
+	long long step = header.step;
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	Type *i64 = builder.getInt64Ty();
+	Type *envType = builder.getInt8PtrTy()->getPointerTo();
+
+	switch (frame.state++) {
+		case 0:
+			context.schedule(*start);
+			return false;
+		case 1:
+			context.schedule(*bound);
+			return false;
+		case 2: {
+			Value *upper = convertChecked(context, builder, context.popValue(), i64, "parallel for bound");
+			Value *lower = convertChecked(context, builder, context.popValue(), i64, "parallel for start");
+			Value *varPtr = context.lookupLocal(var->name);
+			if (!varPtr) {
+				varPtr = context.module->getNamedGlobal(var->name);
+			}
+			if (!varPtr || (isa<Constant>(varPtr) && !isa<GlobalVariable>(varPtr)) || !storedType(varPtr)->isIntegerTy()) {
+				context.pushValue(context.error("parallel for variable " + var->name + " must be an int variable"));
+				return true;
+			}
+
+			// 迭代次数在外层算好，循环体里的第 k 次迭代对应 i = start + k * step
+			Function *parent = context.currentBlock()->getParent();
+			IRBuilder<> entryBuilder(&parent->getEntryBlock(), parent->getEntryBlock().begin());
+			AllocaInst *startSlot = entryBuilder.CreateAlloca(i64, NULL, var->name + ".start");
+			builder.CreateStore(lower, startSlot);
+			Value *span = inclusive ? builder.CreateAdd(builder.CreateSub(upper, lower), builder.getInt64(1))
+				: builder.CreateSub(upper, lower);
+			Value *rounded = builder.CreateAdd(span, builder.getInt64(step - 1));
+			ParallelRegion region;
+			region.count = builder.CreateSelect(builder.CreateICmpSGT(span, builder.getInt64(0)),
+				builder.CreateSDiv(rounded, builder.getInt64(step)), builder.getInt64(0), "count");
+			region.variable = varPtr;
+			region.last = builder.CreateSExtOrTrunc(builder.CreateAdd(lower, builder.CreateMul(region.count, builder.getInt64(step))),
+				storedType(varPtr));
+			region.env.push_back(startSlot);
+
+			// void body(i8 **env, i64 lo, i64 hi)：执行第 lo 到 hi - 1 次迭代
+			FunctionType *bodyType = FunctionType::get(builder.getVoidTy(), { envType, i64, i64 }, false);
+			Function *body = Function::Create(bodyType, GlobalValue::InternalLinkage, parent->getName() + ".parallel", context.module);
+			Argument *env = body->getArg(0);
+			Argument *lo = body->getArg(1);
+			Argument *hi = body->getArg(2);
+			env->setName("env");
+			lo->setName("lo");
+			hi->setName("hi");
+			std::vector<std::pair<std::string, Value*> > captured = context.visibleLocals();
+			BasicBlock *entry = BasicBlock::Create(context.llvmContext, "entry", body);
+			context.pushBlock(entry);
+			builder.SetInsertPoint(entry);
+			auto envSlot = [&](size_t index, Type *pointer) {
+				Value *address = builder.CreateLoad(builder.getInt8PtrTy(), builder.CreateConstGEP1_64(builder.getInt8PtrTy(), env, index));
+				return builder.CreatePointerCast(address, pointer);
+			};
+			Value *first = builder.CreateLoad(i64, envSlot(0, i64->getPointerTo()), "start");
+			// 外层的局部变量按地址共享，const 变量的值直接登记
+			for (auto& local : captured) {
+				if (local.first == var->name) {
+					continue;
+				}
+				if (isa<Constant>(local.second)) {
+					context.declareLocal(local.first, local.second);
+					continue;
+				}
+				context.declareLocal(local.first, envSlot(region.env.size(), local.second->getType()));
+				region.env.push_back(local.second);
+			}
+			for (const Reduction& reduction : reductions) {
+				Value *shared = context.lookupLocal(reduction.name);
+				if (!shared) {
+					shared = context.module->getNamedGlobal(reduction.name);
+				}
+				if (!shared || (isa<Constant>(shared) && !isa<GlobalVariable>(shared)) || reduction.name == var->name) {
+					context.error("reduction variable " + reduction.name + " must be a non-const variable other than the loop variable");
+					continue;
+				}
+				Type *type = storedType(shared);
+				if (!type->isIntegerTy() && !type->isFloatingPointTy()) {
+					context.error("reduction variable " + reduction.name + " must be int or float");
+					continue;
+				}
+				AllocaInst *local = builder.CreateAlloca(type, NULL, reduction.name + ".private");
+				builder.CreateStore(reductionIdentity(reduction.op, type), local);
+				context.declareLocal(reduction.name, local);
+				region.reductions.push_back({shared, local, reduction.op});
+			}
+			Type *varType = storedType(varPtr);
+			AllocaInst *iteration = builder.CreateAlloca(i64, NULL, "k");
+			region.iteration = iteration;
+			AllocaInst *index = builder.CreateAlloca(varType, NULL, var->name.c_str());
+			context.declareLocal(var->name, index);
+			builder.CreateStore(lo, iteration);
+
+			BasicBlock *head = BasicBlock::Create(context.llvmContext, "parallelCond", body);
+			BasicBlock *loopBB = BasicBlock::Create(context.llvmContext, "parallelLoop", body);
+			frame.blocks[1] = BasicBlock::Create(context.llvmContext, "parallelLatch");
+			frame.blocks[2] = BasicBlock::Create(context.llvmContext, "parallelEnd");
+			frame.blocks[0] = head;
+			builder.CreateBr(head);
+			builder.SetInsertPoint(head);
+			Value *k = builder.CreateLoad(i64, iteration, "k");
+			builder.CreateCondBr(builder.CreateICmpSLT(k, hi), loopBB, frame.blocks[2]);
+			builder.SetInsertPoint(loopBB);
+			Value *i = builder.CreateAdd(first, builder.CreateMul(k, builder.getInt64(step)));
+			builder.CreateStore(builder.CreateSExtOrTrunc(i, varType), index);
+
+			// continue 跳到回边块；break 没有去处，由 jumpToLoopTarget 报错
+			context.pushParallel(region);
+			context.pushLoop(frame.blocks[1], NULL);
+			context.setInsertBlock(loopBB);
+			context.schedule(block);
+			return false;
+		}
+	}
+
+	context.popValue();
+	context.popLoop();
+	ParallelRegion region = context.popParallel();
+	Function *body = frame.blocks[0]->getParent();
+	builder.CreateBr(frame.blocks[1]);
+	frame.blocks[1]->insertInto(body);
+	builder.SetInsertPoint(frame.blocks[1]);
+	Value *k = builder.CreateLoad(i64, region.iteration);
+	builder.CreateStore(builder.CreateAdd(k, builder.getInt64(1)), region.iteration);
+	builder.CreateBr(frame.blocks[0]);
+
+	frame.blocks[2]->insertInto(body);
+	builder.SetInsertPoint(frame.blocks[2]);
+	for (auto& reduction : region.reductions) {
+		Value *partial = builder.CreateLoad(reduction.local->getAllocatedType(), reduction.local);
+		atomicReduce(builder, reduction.op, reduction.shared, partial);
+	}
+	builder.CreateRetVoid();
 	context.popBlock();
-	std::cout << "Creating function: " << id.name << endl;
-	return function;
-}
-
-Value* NWhileStmt::codeGen(CodeGenContext& context)
-{
-    Function *function = context.currentBlock()->getParent();
-    BasicBlock *condBB = BasicBlock::Create(MyContext, "whileCond", function);
-    BasicBlock *loopBB = BasicBlock::Create(MyContext, "whileLoop", function);
-    BasicBlock *afterBB = BasicBlock::Create(MyContext, "whileEnd", function);
-
-    // Branch to the condition block
-    IRBuilder<> builder(context.currentBlock());
-    builder.CreateBr(condBB);
-
-    // Generate code for the condition
-    context.pushBlock(condBB);
-    Value *condValue = condition.codeGen(context);
-    builder.SetInsertPoint(condBB);
-    builder.CreateCondBr(condValue, loopBB, afterBB);
-    context.popBlock();
-
-    // Generate code for the loop body
-    context.pushBlock(loopBB);
-    block.codeGen(context);
-    builder.SetInsertPoint(loopBB);
-    builder.CreateBr(condBB);
-    context.popBlock();
-
-    // Set the insertion point to the after block
-    context.pushBlock(afterBB);
-    builder.SetInsertPoint(afterBB);
-
-    return nullptr;
-}
-
-Value* NIfStmt::codeGen(CodeGenContext& context)
-{
-    Function *function = context.currentBlock()->getParent();
-    BasicBlock *thenBB = BasicBlock::Create(MyContext, "then", function);
-    BasicBlock *elseBB = falseBlock ? BasicBlock::Create(MyContext, "else", function) : nullptr;
-    BasicBlock *mergeBB = BasicBlock::Create(MyContext, "ifcont", function);
-
-    // Generate code for the condition
-    Value *condValue = condition.codeGen(context);
-    IRBuilder<> builder(context.currentBlock());
-    if (elseBB) {
-        builder.CreateCondBr(condValue, thenBB, elseBB);
-    } else {
-        builder.CreateCondBr(condValue, thenBB, mergeBB);
-    }
-
-    // Generate code for the then block
-    context.pushBlock(thenBB);
-    trueBlock.codeGen(context);
-    builder.SetInsertPoint(context.currentBlock());
-    builder.CreateBr(mergeBB);
-    context.popBlock();
-
-    // Generate code for the else block (if it exists)
-    if (elseBB) {
-        context.pushBlock(elseBB);
-        falseBlock->codeGen(context);
-        builder.SetInsertPoint(context.currentBlock());
-        builder.CreateBr(mergeBB);
-        context.popBlock();
-    }
-
-    // Set the insertion point to the merge block
-    context.pushBlock(mergeBB);
-    builder.SetInsertPoint(mergeBB);
-
-    return nullptr;
-}
\ No newline at end of file
+	context.log() << "Creating parallel for: " << body->getName().str() << endl;
+
+	// 外层：把共享变量的地址装进 env，交给运行时切分迭代
+	insertAtEnd(builder, context);
+	Function *parent = context.currentBlock()->getParent();
+	IRBuilder<> entryBuilder(&parent->getEntryBlock(), parent->getEntryBlock().begin());
+	AllocaInst *env = entryBuilder.CreateAlloca(builder.getInt8PtrTy(), builder.getInt32(region.env.size()), "env");
+	for (size_t i = 0; i < region.env.size(); i++) {
+		builder.CreateStore(builder.CreatePointerCast(region.env[i], builder.getInt8PtrTy()),
+			builder.CreateConstGEP1_64(builder.getInt8PtrTy(), env, i));
+	}
+	if (context.profile) {
+		// --profile 的运行时只支持单线程，插桩时整个迭代空间在当前线程里跑完
+		builder.CreateCall(body, { env, builder.getInt64(0), region.count });
+	}
+	else {
+		FunctionCallee run = context.module->getOrInsertFunction("sysy_parallel_for", builder.getVoidTy(),
+			body->getType(), envType, i64);
+		builder.CreateCall(run, { body, env, region.count });
+	}
+	builder.CreateStore(region.last, region.variable);
+	context.pushValue(NULL);
+	return true;
+}
+
+/* break / continue: jump out of the innermost loop; the rest of the block is unreachable */
+static bool jumpToLoopTarget(CodeGenContext& context, bool isBreak)
+{
+	const LoopTargets *loop = context.innermostLoop();
+	if (!loop) {
+		context.pushValue(context.error(isBreak ? "break statement not within a loop" : "continue statement not within a loop"));
+		return true;
+	}
+	if (isBreak && !loop->breakBlock) {
+		context.pushValue(context.error("break out of parallel for"));
+		return true;
+	}
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	builder.CreateBr(isBreak ? loop->breakBlock : loop->continueBlock);
+	Function *function = context.currentBlock()->getParent();
+	context.setInsertBlock(BasicBlock::Create(context.llvmContext, isBreak ? "afterBreak" : "afterContinue", function));
+	context.pushValue(NULL);
+	return true;
+}
+
+bool NBreakStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	return jumpToLoopTarget(context, true);
+}
+
+bool NContinueStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	return jumpToLoopTarget(context, false);
+}
+
+bool NIfStmt::codeGenStep(CodeGenContext& context, CodeGenFrame& frame)
+{
+	IRBuilder<> builder(context.llvmContext);
+	insertAtEnd(builder, context);
+	switch (frame.state++) {
+		case 0:
+			// Generate code for the condition
+			context.schedule(condition);
+			return false;
+		case 1: {
+			Function *function = context.currentBlock()->getParent();
+			BasicBlock *thenBB = BasicBlock::Create(context.llvmContext, "then", function);
+			BasicBlock *elseBB = falseBlock ? BasicBlock::Create(context.llvmContext, "else", function) : nullptr;
+			BasicBlock *mergeBB = BasicBlock::Create(context.llvmContext, "ifcont", function);
+			frame.blocks[0] = elseBB;
+			frame.blocks[1] = mergeBB;
+
+			Value *condValue = toBool(builder, context.popValue());
+			builder.CreateCondBr(condValue, thenBB, elseBB ? elseBB : mergeBB);
+
+			// Generate code for the then block
+			context.setInsertBlock(thenBB);
+			context.schedule(trueBlock);
+			return false;
+		}
+		case 2:
+			context.popValue();
+			builder.CreateBr(frame.blocks[1]);
+
+			// Generate code for the else block (if it exists)
+			if (frame.blocks[0]) {
+				context.setInsertBlock(frame.blocks[0]);
+				context.schedule(*falseBlock);
+				return false;
+			}
+			break;
+		case 3:
+			context.popValue();
+			builder.CreateBr(frame.blocks[1]);
+			break;
+	}
+
+	// Set the insertion point to the merge block
+	context.setInsertBlock(frame.blocks[1]);
+	context.pushValue(NULL);
+	return true;
+}
@@ -1,4 +1,9 @@
-#include <stack>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 #include <typeinfo>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
@@ -14,81 +19,236 @@
 #include <llvm/Bitstream/BitstreamReader.h>
 #include <llvm/Bitstream/BitstreamWriter.h>
 #include <llvm/Support/TargetSelect.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
-#include <llvm/ExecutionEngine/MCJIT.h>
-#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/Support/raw_ostream.h>
+#include "target.h"
 
 using namespace llvm;
 
 class NCompUnit;
-
-static LLVMContext MyContext;
+class NDecl;
+class NExpr;
+class Node;
+struct ConstValue;
+class JitSession;
+class RemarkLog;
 
 class CodeGenBlock {
 public:
-    BasicBlock *block;
-    Value *returnValue;
+    BasicBlock *block;      // 当前插入点
+    bool isFunction;        // 函数最外层作用域，名字查找到此为止
     std::map<std::string, Value*> locals;
 };
 
+// 代码生成显式栈中的一帧。节点在 codeGenStep 中用 state / index 记录进度，
+// 用 blocks 记住自己创建的基本块
+struct CodeGenFrame {
+    Node *node;
+    int state;
+    size_t index;
+    BasicBlock *blocks[3];
+
+    CodeGenFrame(Node *node) : node(node), state(0), index(0), blocks{NULL, NULL, NULL} { }
+};
+
+// 一层 while 循环的跳转目标
+struct LoopTargets {
+    BasicBlock *continueBlock;  // continue 跳到的回边块
+    BasicBlock *breakBlock;     // break 跳到的出口块
+    size_t function;            // 所在函数的层数，break 不能跳出函数
+};
+
+// 正在生成的 parallel for 循环体，见 NParallelFor::codeGenStep
+struct ParallelRegion {
+    size_t function;                // 提出的函数所在的层数
+    Value *count;                   // 外层算出的迭代次数
+    AllocaInst *iteration;          // 循环体里的迭代序号 k
+    Value *variable;                // 外层的循环变量，循环结束后写入 last
+    Value *last;                    // 顺序执行时循环变量的终值
+    std::vector<Value*> env;        // 依次传给循环体的地址：起点，再是捕获的外层变量
+    // 归约变量：共享的地址、线程私有的副本和运算
+    struct Reduction {
+        Value *shared;
+        AllocaInst *local;
+        std::string op;
+    };
+    std::vector<Reduction> reductions;
+};
+
 class CodeGenContext {
-    std::stack<CodeGenBlock *> blocks;
+    std::vector<CodeGenBlock *> blocks;
+    std::vector<LoopTargets> loops;
+    std::vector<ParallelRegion> parallels;
+    // 每个局部变量名当前可见的定义：(所在作用域下标, 值)
+    std::map<std::string, std::vector<std::pair<size_t, Value*> > > visible;
+    // 各层函数最外层作用域的下标
+    std::vector<size_t> functionScopes;
+    std::vector<CodeGenFrame> work;
+    std::vector<Value *> values;
     Function *mainFunction;
+    // 每个 CodeGenContext 有自己的 LLVMContext，类型和常量随模块一起交给 JIT，
+    // 卸载模块时一并释放，而不是留在进程级的全局 context 里
+    std::unique_ptr<LLVMContext> ownedContext;
 
 public:
+    LLVMContext& llvmContext;
+    // const 全局变量的编译期值，使用处直接代入
     std::map<std::string, Value*> globals;
-    std::map<std::string, Value*> mergedLocals;
     Module *module;
-    CodeGenContext() { module = new Module("main", MyContext); }
+    int errors;
+    bool verbose;           // 是否输出代码生成的跟踪信息
+    int optLevel;           // -O0 到 -O3，finishCode 按它优化模块
+    unsigned intBits;       // int 的位宽：默认 64，-fint32 时按 SysY 规定用 32
+    bool narrowInts;        // -fnarrow-ints，优化时把取值范围小的整数运算收窄
+    bool profile;           // --profile，给每个函数的入口和出口插桩，见 profile.h
+    CpuTarget target;       // 优化和生成目标文件针对的 CPU
+    std::vector<std::string> multiversion;  // -fmultiversion 列出的 CPU，见 multiversion.h
+    bool separate;          // 分开编译（-c 或链接 .bc）：函数保留外部链接，供别的模块调用
+    std::vector<std::string> linkInputs;    // finishCode 时链接进来的位码模块
+    bool memoize;           // -fmemoize，记忆化纯的递归函数，见 memoize.h
+    std::set<std::string> pureFunctions;    // 已判定为纯的函数
+    std::vector<Function*> memoized;        // 要换成记忆化包装的函数
+    RemarkLog *remarks;     // 非空时 optimize 把优化备注收集到这里，见 remarks.h
+    CodeGenContext() : ownedContext(new LLVMContext()), llvmContext(*ownedContext), errors(0), verbose(true), optLevel(0),
+        intBits(64), narrowInts(false), profile(false), separate(false), memoize(false), remarks(NULL) {
+        module = new Module("main", llvmContext);
+    }
+    ~CodeGenContext() { delete module; }
+    CodeGenContext(const CodeGenContext&) = delete;
     
     void generateCode(NCompUnit& root);
-    GenericValue runCode();
-    std::map<std::string, Value*>& locals() {
-        // merge all locals from all blocks
-        // mergedLocals.clear();
-        // std::stack<CodeGenBlock*> buf;
-        // while(!blocks.empty()) {
-        //     auto locals = blocks.top()->locals;
-        //     for(auto it = locals.begin(); it != locals.end(); ++it) {
-        //         mergedLocals[it->first] = it->second;
-        //     }
-        //     buf.push(blocks.top());
-        //     blocks.pop();
-        // }
+    void generateDecl(NDecl& decl);
+    void finishCode();
+    // 用 LLVM 的默认流水线按 optLevel 优化模块
+    void optimize();
+    void printCode(raw_ostream& out);
+    bool emitObject(const std::string& path);
+    // -c：把模块写成位码文件，之后与别的模块一起链接
+    bool emitBitcode(const std::string& path);
+    // 把 linkInputs 合并进模块，再把 main 以外的符号内部化并删掉用不到的
+    void linkModules();
+    // linkModules 链接前的检查：输入的 int 位宽和同名函数的原型要与模块一致，否则报错返回 false
+    bool checkLinkInput(const std::string& path, Module& input);
+    // 把模块连同 LLVMContext 交出去，之后本对象不再持有模块
+    orc::ThreadSafeModule takeModule();
+    // 在 jit 中运行 main，运行完即卸载模块
+    bool runCode(JitSession& jit);
+    // 源程序中 int 对应的 LLVM 类型
+    IntegerType* intType() { return Type::getIntNTy(llvmContext, intBits); }
+    // 跟踪输出，verbose 为 false 时什么也不写
+    std::ostream& log();
 
-        // while(!buf.empty()) {
-        //     blocks.push(buf.top());
-        //     buf.pop();
-        // }
-        // return mergedLocals;
-        return blocks.top()->locals;
+    // 非递归地为 root 生成代码，返回它的值
+    Value* emit(Node& root);
+    // 在 codeGenStep 中调度一个子节点，它完成后值留在值栈顶
+    void schedule(Node& child) { work.push_back(CodeGenFrame(&child)); }
+    void pushValue(Value *value) { values.push_back(value); }
+    Value* popValue() { Value *value = values.back(); values.pop_back(); return value; }
+    // 报告错误并返回一个占位值，让代码生成继续下去
+    Value* error(const std::string& message);
+
+    // 名字当前指向的编译期常量：const 局部变量直接以值登记在作用域里，
+    // const 全局变量的值在 globals 里。不是常量时返回 NULL
+    Constant* constantOf(const std::string& name);
+    // 在 AST 上对表达式求值，只能引用已知的常量
+    bool evaluate(const NExpr& expr, ConstValue& value);
+
+    // 在当前作用域声明局部变量
+    void declareLocal(const std::string& name, Value *value) {
+        auto it = blocks.back()->locals.find(name);
+        if (it != blocks.back()->locals.end()) {
+            // 同一作用域重复声明，覆盖可见的那一个
+            it->second = value;
+            visible[name].back().second = value;
+            return;
+        }
+        blocks.back()->locals[name] = value;
+        visible[name].push_back(std::make_pair(blocks.size() - 1, value));
+    }
+    // 查找可见的局部变量，不越过所在函数。每个名字维护一个遮蔽栈，
+    // 查找与作用域嵌套深度无关
+    Value* lookupLocal(const std::string& name) {
+        auto it = visible.find(name);
+        if (it == visible.end() || it->second.empty() || functionScopes.empty()) {
+            return NULL;
+        }
+        if (it->second.back().first < functionScopes.back()) {
+            return NULL;
+        }
+        return it->second.back().second;
     }
     BasicBlock *currentBlock() { 
         if(blocks.empty()) {
             return NULL;
         }
-        return blocks.top()->block; 
+        return blocks.back()->block; 
     }
+    // 进入一个函数：新的作用域，插入点设为函数的入口块
     void pushBlock(BasicBlock *block) {
-        bool notFirstBlock = false;
-        if(notFirstBlock && blocks.top() && blocks.top()->locals.size() > 0) {
-            auto locals = blocks.top()->locals;
-            blocks.push(new CodeGenBlock()); 
-            blocks.top()->returnValue = NULL; 
-            blocks.top()->block = block; 
-            // copy locals
-            for(auto it = locals.begin(); it != locals.end(); ++it) {
-                blocks.top()->locals[it->first] = it->second;
-            }
+        blocks.push_back(new CodeGenBlock());
+        blocks.back()->block = block;
+        blocks.back()->isFunction = true;
+        functionScopes.push_back(blocks.size() - 1);
+    }
+    // 进入一个语句块作用域，插入点不变
+    void pushScope() {
+        BasicBlock *block = currentBlock();
+        blocks.push_back(new CodeGenBlock());
+        blocks.back()->block = block;
+        blocks.back()->isFunction = false;
+    }
+    // 离开作用域；语句块结束时插入点交还给外层作用域
+    void popBlock() {
+        CodeGenBlock *top = blocks.back();
+        blocks.pop_back();
+        for (auto& local : top->locals) {
+            visible[local.first].pop_back();
+        }
+        if (top->isFunction) {
+            functionScopes.pop_back();
+        }
+        else if (!blocks.empty()) {
+            blocks.back()->block = top->block;
+        }
+        delete top;
+    }
+    void popScope() { popBlock(); }
+
+    void pushLoop(BasicBlock *continueBlock, BasicBlock *breakBlock) {
+        loops.push_back({continueBlock, breakBlock, functionScopes.size()});
+    }
+    void popLoop() { loops.pop_back(); }
+    // 当前函数中最内层的循环，不在循环里时返回 NULL
+    const LoopTargets* innermostLoop() const {
+        if (loops.empty() || loops.back().function != functionScopes.size()) {
+            return NULL;
         }
-        else {
-            blocks.push(new CodeGenBlock()); 
-            blocks.top()->returnValue = NULL; 
-            blocks.top()->block = block;
+        return &loops.back();
+    }
+    void setInsertBlock(BasicBlock *block) { blocks.back()->block = block; }
+
+    // 当前函数里可见的全部局部变量，每个名字取最内层的定义
+    std::vector<std::pair<std::string, Value*> > visibleLocals() {
+        std::vector<std::pair<std::string, Value*> > out;
+        for (auto& entry : visible) {
+            if (Value *value = lookupLocal(entry.first)) {
+                out.push_back(std::make_pair(entry.first, value));
+            }
         }
+        return out;
+    }
+    // 进入 parallel for 提出的函数之后调用
+    void pushParallel(const ParallelRegion& region) {
+        parallels.push_back(region);
+        parallels.back().function = functionScopes.size();
+    }
+    ParallelRegion popParallel() {
+        ParallelRegion region = parallels.back();
+        parallels.pop_back();
+        return region;
+    }
+    // 是否直接位于 parallel for 的循环体里（不算其中再定义的函数）
+    bool inParallelBody() const {
+        return !parallels.empty() && parallels.back().function == functionScopes.size();
     }
-    void popBlock() { CodeGenBlock *top = blocks.top(); blocks.pop(); delete top; }
-    void setCurrentReturnValue(Value *value) { blocks.top()->returnValue = value; }
-    Value* getCurrentReturnValue() { return blocks.top()->returnValue; }
 };
@@ -0,0 +1,164 @@
+// consteval.cpp
+#include "consteval.h"
+#include "node.h"
+#include "parser.hpp" // 包含 token 定义
+#include <climits>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+struct EvalTask {
+    const NExpr *expr;
+    bool expanded;          // 子表达式已经入栈，再次出栈时计算自己
+};
+
+// 截断到 bits 位再符号扩展回 long long，与 bits 位的 IR 运算得到相同的值
+long long wrap(long long value, unsigned bits) {
+    if (bits >= 64) {
+        return value;
+    }
+    unsigned shift = 64 - bits;
+    return (long long)((unsigned long long)value << shift) >> shift;
+}
+
+// 按代码生成的规则做二元运算：有一侧是 float 就按 float 算，int 的结果回绕到 bits 位
+bool binary(int op, ConstValue l, ConstValue r, unsigned bits, ConstValue& out) {
+    if (l.isFloat || r.isFloat) {
+        double a = l.asFloat(), b = r.asFloat();
+        switch (op) {
+            case TPLUS:  out = ConstValue::ofFloat(a + b); return true;
+            case TMINUS: out = ConstValue::ofFloat(a - b); return true;
+            case TMUL:   out = ConstValue::ofFloat(a * b); return true;
+            case TDIV:   out = ConstValue::ofFloat(a / b); return true;
+            case TMOD:   out = ConstValue::ofFloat(std::fmod(a, b)); return true;
+            case TCEQ:   out = ConstValue::ofInt(a == b); return true;
+            case TCNE:   out = ConstValue::ofInt(a != b); return true;
+            case TCLT:   out = ConstValue::ofInt(a < b); return true;
+            case TCLE:   out = ConstValue::ofInt(a <= b); return true;
+            case TCGT:   out = ConstValue::ofInt(a > b); return true;
+            case TCGE:   out = ConstValue::ofInt(a >= b); return true;
+        }
+        return false;
+    }
+    long long a = l.i, b = r.i;
+    // 加减乘在无符号数上做，再回绕到 bits 位，得到与生成的 IR 相同的结果
+    unsigned long long ua = a, ub = b;
+    switch (op) {
+        case TPLUS:  out = ConstValue::ofInt(wrap((long long)(ua + ub), bits)); return true;
+        case TMINUS: out = ConstValue::ofInt(wrap((long long)(ua - ub), bits)); return true;
+        case TMUL:   out = ConstValue::ofInt(wrap((long long)(ua * ub), bits)); return true;
+        case TDIV:
+        case TMOD:
+            // 除以零和最小值除以 -1 在 sdiv / srem 里没有定义
+            if (b == 0 || (a == LLONG_MIN >> (64 - bits) && b == -1)) {
+                return false;
+            }
+            out = ConstValue::ofInt(wrap(op == TDIV ? a / b : a % b, bits));
+            return true;
+        case TCEQ:   out = ConstValue::ofInt(a == b); return true;
+        case TCNE:   out = ConstValue::ofInt(a != b); return true;
+        case TCLT:   out = ConstValue::ofInt(a < b); return true;
+        case TCLE:   out = ConstValue::ofInt(a <= b); return true;
+        case TCGT:   out = ConstValue::ofInt(a > b); return true;
+        case TCGE:   out = ConstValue::ofInt(a >= b); return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool evaluateConst(const NExpr& root, const ConstLookup& lookup, ConstValue& result, unsigned intBits) {
+    std::vector<EvalTask> work;
+    std::vector<ConstValue> values;
+    work.push_back({&root, false});
+
+    while (!work.empty()) {
+        EvalTask task = work.back();
+        work.pop_back();
+        const NExpr *expr = task.expr;
+
+        if (auto p = dynamic_cast<const NInteger*>(expr)) {
+            values.push_back(ConstValue::ofInt(wrap(p->value, intBits)));
+        }
+        else if (auto p = dynamic_cast<const NFloat*>(expr)) {
+            values.push_back(ConstValue::ofFloat(p->value));
+        }
+        else if (auto p = dynamic_cast<const NIdent*>(expr)) {
+            ConstValue value;
+            if (!lookup(p->name, value)) {
+                return false;
+            }
+            if (!value.isFloat) {
+                value.i = wrap(value.i, intBits);
+            }
+            values.push_back(value);
+        }
+        else if (auto p = dynamic_cast<const NBinaryExpr*>(expr)) {
+            if (!task.expanded) {
+                work.push_back({expr, true});
+                work.push_back({&p->rhs, false});
+                work.push_back({&p->lhs, false});
+                continue;
+            }
+            ConstValue r = values.back(); values.pop_back();
+            ConstValue l = values.back(); values.pop_back();
+            ConstValue out;
+            if (!binary(p->op, l, r, intBits, out)) {
+                return false;
+            }
+            values.push_back(out);
+        }
+        else if (auto p = dynamic_cast<const NLogicalBinaryExpr*>(expr)) {
+            if (!task.expanded) {
+                work.push_back({expr, true});
+                work.push_back({&p->rhs, false});
+                work.push_back({&p->lhs, false});
+                continue;
+            }
+            ConstValue r = values.back(); values.pop_back();
+            ConstValue l = values.back(); values.pop_back();
+            ConstValue out;
+            if (p->op == TAND || p->op == TOR) {
+                bool a = !l.isZero(), b = !r.isZero();
+                out = ConstValue::ofInt(p->op == TAND ? (a && b) : (a || b));
+            }
+            else if (!binary(p->op, l, r, intBits, out)) {
+                return false;
+            }
+            values.push_back(out);
+        }
+        else if (auto p = dynamic_cast<const NUnaryExpr*>(expr)) {
+            if (!task.expanded) {
+                work.push_back({expr, true});
+                work.push_back({&p->expr, false});
+                continue;
+            }
+            if (p->op != TMINUS) {
+                return false;
+            }
+            ConstValue& v = values.back();
+            v = v.isFloat ? ConstValue::ofFloat(-v.f) : ConstValue::ofInt(wrap((long long)(0ULL - (unsigned long long)v.i), intBits));
+        }
+        else if (auto p = dynamic_cast<const NLogicalUnaryExpr*>(expr)) {
+            if (!task.expanded) {
+                work.push_back({expr, true});
+                work.push_back({&p->expr, false});
+                continue;
+            }
+            if (p->op != TNOT) {
+                return false;
+            }
+            values.back() = ConstValue::ofInt(values.back().isZero());
+        }
+        else {
+            // 函数调用、赋值等不是常量表达式
+            return false;
+        }
+    }
+    result = values.back();
+    if (!result.isFloat) {
+        result.i = wrap(result.i, intBits);
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <functional>
+#include <string>
+
+class NExpr;
+
+// 编译期常量。SysY 只有 int 和 float 两种标量，比较和逻辑运算的结果按 int 0 / 1 算
+struct ConstValue {
+    bool isFloat;
+    long long i;
+    double f;
+
+    static ConstValue ofInt(long long value) { return {false, value, 0.0}; }
+    static ConstValue ofFloat(double value) { return {true, 0, value}; }
+    double asFloat() const { return isFloat ? f : (double)i; }
+    long long asInt() const { return isFloat ? (long long)f : i; }
+    bool isZero() const { return isFloat ? f == 0.0 : i == 0; }
+};
+
+// 名字到常量的查找；名字不是已知常量时返回 false
+typedef std::function<bool(const std::string& name, ConstValue& value)> ConstLookup;
+
+// 在 AST 上对表达式求值，运算规则与代码生成一致：int 是 intBits 位补码（默认 64，
+// -fint32 时 32），字面量、查到的常量和每一步整数运算的结果都截断到 intBits 位再符号扩展。
+// 表达式中有函数调用、赋值、非常量变量，或除以零等没有定义的运算时返回 false。
+// 使用显式栈，不随表达式深度递归。
+bool evaluateConst(const NExpr& expr, const ConstLookup& lookup, ConstValue& result, unsigned intBits = 64);
@@ -11,13 +11,13 @@ extern NBlock* programBlock;
 llvm::Function* createPrintfFunction(CodeGenContext& context)
 {
     std::vector<llvm::Type*> printf_arg_types;
-    printf_arg_types.push_back(llvm::Type::getInt8PtrTy(MyContext)); //char*
+    printf_arg_types.push_back(llvm::Type::getInt8PtrTy(context.llvmContext)); //char*
 
-    std::cout << "printf" << std::endl;
+    context.log() << "printf" << std::endl;
 
     llvm::FunctionType* printf_type =
         llvm::FunctionType::get(
-            llvm::Type::getInt32Ty(MyContext), printf_arg_types, true);
+            llvm::Type::getInt32Ty(context.llvmContext), printf_arg_types, true);
 
     llvm::Function *func = llvm::Function::Create(
                 printf_type, llvm::Function::ExternalLinkage,
@@ -31,34 +31,34 @@ llvm::Function* createPrintfFunction(CodeGenContext& context)
 void createEchoFunction(CodeGenContext& context, llvm::Function* printfFn)
 {
     std::vector<llvm::Type*> echo_arg_types;
-    echo_arg_types.push_back(llvm::Type::getInt64Ty(MyContext));
+    echo_arg_types.push_back(context.intType());
 
     llvm::FunctionType* echo_type =
         llvm::FunctionType::get(
-            llvm::Type::getVoidTy(MyContext), echo_arg_types, false);
+            llvm::Type::getVoidTy(context.llvmContext), echo_arg_types, false);
 
     llvm::Function *func = llvm::Function::Create(
                 echo_type, llvm::Function::InternalLinkage,
                 llvm::Twine("echo"),
                 context.module
            );
-    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(MyContext, "entry", func, 0);
+    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(context.llvmContext, "entry", func, 0);
 	context.pushBlock(bblock);
     
     const char *constValue = "%d\n";
-    llvm::Constant *format_const = llvm::ConstantDataArray::getString(MyContext, constValue);
+    llvm::Constant *format_const = llvm::ConstantDataArray::getString(context.llvmContext, constValue);
     llvm::GlobalVariable *var =
         new llvm::GlobalVariable(
-            *context.module, llvm::ArrayType::get(llvm::IntegerType::get(MyContext, 8), strlen(constValue)+1),
+            *context.module, llvm::ArrayType::get(llvm::IntegerType::get(context.llvmContext, 8), strlen(constValue)+1),
             true, llvm::GlobalValue::PrivateLinkage, format_const, ".str");
     llvm::Constant *zero =
-        llvm::Constant::getNullValue(llvm::IntegerType::getInt32Ty(MyContext));
+        llvm::Constant::getNullValue(llvm::IntegerType::getInt32Ty(context.llvmContext));
 
     std::vector<llvm::Constant*> indices;
     indices.push_back(zero);
     indices.push_back(zero);
     llvm::Constant *var_ref = llvm::ConstantExpr::getGetElementPtr(
-	llvm::ArrayType::get(llvm::IntegerType::get(MyContext, 8), strlen(constValue)+1),
+	llvm::ArrayType::get(llvm::IntegerType::get(context.llvmContext, 8), strlen(constValue)+1),
         var, indices);
 
     std::vector<Value*> args;
@@ -70,11 +70,65 @@ void createEchoFunction(CodeGenContext& context, llvm::Function* printfFn)
     args.push_back(toPrint);
     
 	CallInst *call = CallInst::Create(printfFn, makeArrayRef(args), "", bblock);
-	ReturnInst::Create(MyContext, bblock);
+	ReturnInst::Create(context.llvmContext, bblock);
 	context.popBlock();
 }
 
+llvm::Function* declareLibcFunction(CodeGenContext& context, const char *name, llvm::Type *result,
+                                    std::vector<llvm::Type*> params, bool vararg = false)
+{
+    llvm::Function *func = context.module->getFunction(name);
+    if (func == NULL) {
+        func = llvm::Function::Create(llvm::FunctionType::get(result, params, vararg),
+                                      llvm::Function::ExternalLinkage, llvm::Twine(name), context.module);
+        func->setCallingConv(llvm::CallingConv::C);
+    }
+    return func;
+}
+
+// SysY 运行时库的 getint / getch / putint / putch，和 echo 一样在模块里包一层 libc，
+// 参数和返回值随 -fint32 取 intType()，生成的目标文件只依赖 libc
+void createRuntimeFunctions(CodeGenContext& context, llvm::Function* printfFn)
+{
+    llvm::LLVMContext& llvmContext = context.llvmContext;
+    llvm::Type *i32 = llvm::Type::getInt32Ty(llvmContext);
+    llvm::Type *i64 = llvm::Type::getInt64Ty(llvmContext);
+    llvm::Type *intType = context.intType();
+    llvm::Type *voidType = llvm::Type::getVoidTy(llvmContext);
+    llvm::Function *scanfFn = declareLibcFunction(context, "scanf", i32, { llvm::Type::getInt8PtrTy(llvmContext) }, true);
+    llvm::Function *getcharFn = declareLibcFunction(context, "getchar", i32, {});
+    llvm::Function *putcharFn = declareLibcFunction(context, "putchar", i32, { i32 });
+    llvm::IRBuilder<> builder(llvmContext);
+
+    auto define = [&](const char *name, llvm::Type *result, std::vector<llvm::Type*> params) {
+        llvm::Function *func = llvm::Function::Create(llvm::FunctionType::get(result, params, false),
+                                                      llvm::Function::InternalLinkage, llvm::Twine(name), context.module);
+        builder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", func));
+        return func;
+    };
+
+    // 读不到整数时返回 0
+    define("getint", intType, {});
+    llvm::Constant *lld = builder.CreateGlobalStringPtr("%lld", ".str.lld");
+    llvm::Value *slot = builder.CreateAlloca(i64);
+    builder.CreateStore(llvm::ConstantInt::get(i64, 0), slot);
+    builder.CreateCall(scanfFn, { lld, slot });
+    builder.CreateRet(builder.CreateTrunc(builder.CreateLoad(i64, slot), intType));
+
+    define("getch", intType, {});
+    builder.CreateRet(builder.CreateSExtOrTrunc(builder.CreateCall(getcharFn), intType));
+
+    llvm::Function *putint = define("putint", voidType, { intType });
+    builder.CreateCall(printfFn, { lld, builder.CreateSExt(putint->getArg(0), i64) });
+    builder.CreateRetVoid();
+
+    llvm::Function *putch = define("putch", voidType, { intType });
+    builder.CreateCall(putcharFn, { builder.CreateTrunc(putch->getArg(0), i32) });
+    builder.CreateRetVoid();
+}
+
 void createCoreFunctions(CodeGenContext& context){
 	llvm::Function* printfFn = createPrintfFunction(context);
     createEchoFunction(context, printfFn);
+    createRuntimeFunctions(context, printfFn);
 }
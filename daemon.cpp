@@ -0,0 +1,127 @@
+// daemon.cpp
+#include "daemon.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// main.cpp 中的命令行入口
+extern int driverMain(int argc, char **argv);
+
+bool inCompileServer = false;
+
+static double milliseconds(const struct timeval& t) {
+    return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+}
+
+// 在连接进程里处理一个请求：再 fork 一次去编译，
+// 这样编译器崩溃或调用 exit() 也能把状态如实告诉客户端
+static void serveConnection(int conn) {
+    vector<string> fields;
+    int fds[3];
+    if (!receiveRequest(conn, fields, fds) || fields.empty()) {
+        cerr << "compile server: malformed request" << endl;
+        return;
+    }
+
+    struct timeval started, finished;
+    gettimeofday(&started, NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return;
+    }
+    if (pid == 0) {
+        close(conn);
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] != i) {
+                dup2(fds[i], i);
+                close(fds[i]);
+            }
+        }
+        if (chdir(fields[0].c_str()) != 0) {
+            perror(fields[0].c_str());
+            exit(2);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        inCompileServer = true;
+        // fields[0] 是工作目录，借它的位置放 argv[0]
+        fields[0] = "parser";
+        vector<char *> argv;
+        for (auto& field : fields) {
+            argv.push_back(&field[0]);
+        }
+        argv.push_back(NULL);
+        exit(driverMain(argv.size() - 1, argv.data()));
+    }
+    for (int i = 0; i < 3; i++) {
+        close(fds[i]);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR);
+    gettimeofday(&finished, NULL);
+
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    char reply[256];
+    int length = snprintf(reply, sizeof(reply), "status %d wall %.3f user %.3f sys %.3f maxrss %ld\n",
+        code, milliseconds(finished) - milliseconds(started),
+        milliseconds(usage.ru_utime), milliseconds(usage.ru_stime), usage.ru_maxrss);
+    writeAll(conn, reply, length);
+}
+
+int runCompileServer(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        cerr << "套接字路径过长: " << path << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 64) < 0) {
+        perror(path);
+        return 1;
+    }
+    // 连接进程结束后由内核回收，不留僵尸
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    cerr << "compile server listening on " << path << endl;
+
+    for (;;) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return 1;
+        }
+        cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            // 连接进程要等编译子进程的退出状态，恢复默认的 SIGCHLD 处理
+            signal(SIGCHLD, SIG_DFL);
+            serveConnection(conn);
+            _exit(0);
+        }
+        if (pid < 0) {
+            perror("fork");
+        }
+        close(conn);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// 编译服务器（--daemon <套接字>）与瘦客户端 sysyc 之间的协议。
+//
+// 请求：一次 sendmsg，附带客户端的 stdin / stdout / stderr 三个描述符，
+// 数据是 4 字节长度加上以 '\0' 分隔的工作目录和命令行参数。
+// 服务器在子进程里把三个描述符装到 0 / 1 / 2 上再照常编译，
+// 输出因此直接写到客户端的终端或管道。
+// 应答：编译结束后一行文本
+//   status <退出码> wall <毫秒> user <毫秒> sys <毫秒> maxrss <KB>
+
+#define DEFAULT_DAEMON_SOCKET "/tmp/sysy-parser.sock"
+
+// 服务器以 --daemon 启动后初始化一次 LLVM，之后每个请求在 fork 出的子进程里编译
+int runCompileServer(const char *path);
+// 在服务器的子进程里为 true，此时不再接受嵌套的 --daemon
+extern bool inCompileServer;
+
+inline bool writeAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool readAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool sendRequest(int sock, const std::vector<std::string>& fields, const int fds[3]) {
+    std::string body;
+    for (auto& field : fields) {
+        body += field;
+        body.push_back('\0');
+    }
+    uint32_t size = body.size();
+
+    struct iovec iov = { &size, sizeof(size) };
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    ssize_t n;
+    while ((n = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR);
+    if (n != sizeof(size)) {
+        return false;
+    }
+    return writeAll(sock, body.data(), body.size());
+}
+
+inline bool receiveRequest(int sock, std::vector<std::string>& fields, int fds[3]) {
+    uint32_t size = 0;
+    struct iovec iov = { &size, sizeof(size) };
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_WAITALL)) < 0 && errno == EINTR);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != sizeof(size) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+    std::string body(size, '\0');
+    if (!readAll(sock, &body[0], size)) {
+        return false;
+    }
+    fields.clear();
+    for (size_t start = 0; start < body.size(); ) {
+        size_t end = body.find('\0', start);
+        fields.push_back(body.substr(start, end - start));
+        start = end + 1;
+    }
+    return true;
+}
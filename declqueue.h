@@ -0,0 +1,74 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+
+class NDecl;
+
+// 有界队列：解析线程每归约出一个顶层声明就放进来，
+// 代码生成线程从另一端取出并立即生成 IR。
+// 队列满时解析线程阻塞，避免解析远远跑在代码生成前面。
+// 解析时的报错和警告也按出现的顺序排进队列，由代码生成线程打印：
+// 只有一个线程写 stdout / stderr，各声明的诊断和生成时的输出不会交错。
+class DeclQueue {
+public:
+    // 一个顶层声明，或者 decl 为 NULL 时是一条要写到 stream 的诊断
+    struct Item {
+        NDecl *decl;
+        FILE *stream;
+        std::string text;
+    };
+
+private:
+    std::deque<Item> items;
+    std::mutex lock;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    size_t capacity;
+    bool closed;
+
+public:
+    DeclQueue(size_t capacity = 64) : capacity(capacity), closed(false) { }
+
+    void push(NDecl *decl) {
+        push(Item{decl, NULL, std::string()});
+    }
+
+    void push(FILE *stream, const std::string& text) {
+        push(Item{NULL, stream, text});
+    }
+
+    void push(Item item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [this] { return items.size() < capacity || closed; });
+        if (closed) {
+            return;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    // 队列关闭且取空后返回 false
+    bool pop(Item& item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // 解析结束后调用，唤醒等待中的代码生成线程
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+};
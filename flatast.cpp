@@ -0,0 +1,469 @@
+// flatast.cpp
+#include "flatast.h"
+#include "node.h"
+#include "parser.hpp" // 包含 token 定义
+
+namespace {
+
+// 构建时待回填的位置：子节点的下标写回父节点的哪个槽位
+enum class Slot : uint8_t { A, B, C, List, Root };
+
+struct BuildTask {
+    const Node *node;
+    Slot slot;
+    uint32_t pos;
+};
+
+} // namespace
+
+uint32_t FlatAST::addNode(FlatKind k, uint16_t o) {
+    uint32_t n = kind.size();
+    kind.push_back(k);
+    op.push_back(o);
+    a.push_back(FlatNone);
+    b.push_back(FlatNone);
+    c.push_back(FlatNone);
+    return n;
+}
+
+uint32_t FlatAST::intern(const std::string& name) {
+    auto it = nameIndex.find(name);
+    if (it != nameIndex.end()) {
+        return it->second;
+    }
+    uint32_t id = names.size();
+    names.push_back(name);
+    nameIndex[name] = id;
+    return id;
+}
+
+FlatAST FlatAST::build(const NCompUnit& unit) {
+    FlatAST ast;
+    std::vector<BuildTask> work;
+    work.push_back({&unit, Slot::Root, 0});
+
+    // 为 count 个子节点预留一段列表，返回列表起点
+    auto allocList = [&ast](size_t count) {
+        uint32_t list = ast.lists.size();
+        ast.lists.push_back(count);
+        ast.lists.resize(ast.lists.size() + count, FlatNone);
+        return list;
+    };
+
+    while (!work.empty()) {
+        BuildTask task = work.back();
+        work.pop_back();
+        const Node *node = task.node;
+        uint32_t n;
+
+        // 子节点逆序入栈，使节点编号保持先序，遍历时内存访问基本是顺序的
+        if (auto p = dynamic_cast<const NIdent*>(node)) {
+            n = ast.addNode(FlatKind::Ident, (uint16_t)p->type);
+            ast.a[n] = ast.intern(p->name);
+        }
+        else if (auto p = dynamic_cast<const NInteger*>(node)) {
+            n = ast.addNode(FlatKind::Integer);
+            ast.a[n] = ast.ints.size();
+            ast.ints.push_back(p->value);
+        }
+        else if (auto p = dynamic_cast<const NFloat*>(node)) {
+            n = ast.addNode(FlatKind::Float);
+            ast.a[n] = ast.floats.size();
+            ast.floats.push_back(p->value);
+        }
+        else if (auto p = dynamic_cast<const NBinaryExpr*>(node)) {
+            n = ast.addNode(FlatKind::BinaryExpr, p->op);
+            work.push_back({&p->rhs, Slot::B, n});
+            work.push_back({&p->lhs, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NLogicalBinaryExpr*>(node)) {
+            n = ast.addNode(FlatKind::LogicalBinaryExpr, p->op);
+            work.push_back({&p->rhs, Slot::B, n});
+            work.push_back({&p->lhs, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NUnaryExpr*>(node)) {
+            n = ast.addNode(FlatKind::UnaryExpr, p->op);
+            work.push_back({&p->expr, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NLogicalUnaryExpr*>(node)) {
+            n = ast.addNode(FlatKind::LogicalUnaryExpr, p->op);
+            work.push_back({&p->expr, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NAssignment*>(node)) {
+            n = ast.addNode(FlatKind::Assignment);
+            work.push_back({&p->rhs, Slot::B, n});
+            work.push_back({&p->lhs, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NMethodCall*>(node)) {
+            n = ast.addNode(FlatKind::MethodCall);
+            uint32_t list = allocList(p->arguments.size());
+            ast.b[n] = list;
+            for (size_t i = p->arguments.size(); i-- > 0; ) {
+                work.push_back({p->arguments[i], Slot::List, (uint32_t)(list + 1 + i)});
+            }
+            work.push_back({&p->id, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NBlock*>(node)) {
+            n = ast.addNode(FlatKind::Block);
+            uint32_t list = allocList(p->statements.size());
+            ast.a[n] = list;
+            for (size_t i = p->statements.size(); i-- > 0; ) {
+                work.push_back({p->statements[i], Slot::List, (uint32_t)(list + 1 + i)});
+            }
+        }
+        else if (auto p = dynamic_cast<const NExprStmt*>(node)) {
+            n = ast.addNode(FlatKind::ExprStmt);
+            work.push_back({&p->expression, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NReturnStmt*>(node)) {
+            n = ast.addNode(FlatKind::ReturnStmt);
+            work.push_back({&p->expression, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NIfStmt*>(node)) {
+            n = ast.addNode(FlatKind::IfStmt);
+            if (p->falseBlock) {
+                work.push_back({p->falseBlock, Slot::C, n});
+            }
+            work.push_back({&p->trueBlock, Slot::B, n});
+            work.push_back({&p->condition, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NWhileStmt*>(node)) {
+            n = ast.addNode(FlatKind::WhileStmt);
+            if (!p->pragmas.empty()) {
+                ast.c[n] = allocList(p->pragmas.size());
+                for (size_t i = 0; i < p->pragmas.size(); i++) {
+                    ast.lists[ast.c[n] + 1 + i] = ast.intern(p->pragmas[i]);
+                }
+            }
+            work.push_back({&p->block, Slot::B, n});
+            work.push_back({&p->condition, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NParallelFor*>(node)) {
+            n = ast.addNode(FlatKind::ParallelFor);
+            if (!p->reductions.empty()) {
+                ast.c[n] = allocList(2 * p->reductions.size());
+                for (size_t i = 0; i < p->reductions.size(); i++) {
+                    ast.lists[ast.c[n] + 1 + 2 * i] = ast.intern(p->reductions[i].op);
+                    ast.lists[ast.c[n] + 2 + 2 * i] = ast.intern(p->reductions[i].name);
+                }
+            }
+            uint32_t list = allocList(3);
+            ast.a[n] = list;
+            work.push_back({&p->block, Slot::B, n});
+            work.push_back({&p->step, Slot::List, list + 3});
+            work.push_back({&p->condition, Slot::List, list + 2});
+            work.push_back({&p->init, Slot::List, list + 1});
+        }
+        else if (auto p = dynamic_cast<const NVarDecl*>(node)) {
+            n = ast.addNode(FlatKind::VarDecl, p->isConst | p->isExtern << 1);
+            if (p->assignmentExpr) {
+                work.push_back({p->assignmentExpr, Slot::B, n});
+            }
+            work.push_back({&p->id, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NFuncDecl*>(node)) {
+            n = ast.addNode(FlatKind::FuncDecl, p->isPrototype);
+            uint32_t list = allocList(p->arguments.size());
+            ast.c[n] = list;
+            work.push_back({&p->block, Slot::B, n});
+            for (size_t i = p->arguments.size(); i-- > 0; ) {
+                work.push_back({p->arguments[i], Slot::List, (uint32_t)(list + 1 + i)});
+            }
+            work.push_back({&p->id, Slot::A, n});
+        }
+        else if (auto p = dynamic_cast<const NCompUnit*>(node)) {
+            n = ast.addNode(FlatKind::CompUnit);
+            uint32_t list = allocList(p->decls.size());
+            ast.a[n] = list;
+            for (size_t i = p->decls.size(); i-- > 0; ) {
+                work.push_back({p->decls[i], Slot::List, (uint32_t)(list + 1 + i)});
+            }
+        }
+        else if (dynamic_cast<const NBreakStmt*>(node)) {
+            n = ast.addNode(FlatKind::BreakStmt);
+        }
+        else if (dynamic_cast<const NContinueStmt*>(node)) {
+            n = ast.addNode(FlatKind::ContinueStmt);
+        }
+        else {
+            n = ast.addNode(FlatKind::Unknown);
+        }
+
+        switch (task.slot) {
+            case Slot::A:    ast.a[task.pos] = n; break;
+            case Slot::B:    ast.b[task.pos] = n; break;
+            case Slot::C:    ast.c[task.pos] = n; break;
+            case Slot::List: ast.lists[task.pos] = n; break;
+            case Slot::Root: ast.root = n; break;
+        }
+    }
+    return ast;
+}
+
+///////////////////////////////////////////////////
+// 以下为扁平 AST 的源码还原
+
+namespace {
+
+// 待输出的片段：节点、文本、缩进空格或未知运算符
+struct PrintItem {
+    enum What { Node, Text, Spaces, BadOp } what;
+    uint32_t value;
+    int indent;
+    const char *text;
+};
+
+class FlatPrinter : public FlatVisitor<FlatPrinter> {
+    std::ostream& out;
+    std::vector<PrintItem> work;
+    std::vector<PrintItem> pending;
+    int indent;
+
+    void node(uint32_t n, int ind = 0) { pending.push_back({PrintItem::Node, n, ind, nullptr}); }
+    void text(const char *s) { pending.push_back({PrintItem::Text, 0, 0, s}); }
+    void spaces(int count) { pending.push_back({PrintItem::Spaces, (uint32_t)count, 0, nullptr}); }
+    void badOp(uint32_t o) { pending.push_back({PrintItem::BadOp, o, 0, nullptr}); }
+
+    void list(uint32_t l, const char *sep) {
+        uint32_t count = ast.listCount(l);
+        for (uint32_t i = 0; i < count; ++i) {
+            node(ast.listItem(l, i));
+            if (i != count - 1)
+                text(sep);
+        }
+    }
+
+public:
+    FlatPrinter(const FlatAST& ast, std::ostream& out) : FlatVisitor<FlatPrinter>(ast), out(out), indent(0) { }
+
+    void run(uint32_t root) {
+        work.push_back({PrintItem::Node, root, 0, nullptr});
+        while (!work.empty()) {
+            PrintItem item = work.back();
+            work.pop_back();
+            switch (item.what) {
+                case PrintItem::Node:
+                    indent = item.indent;
+                    visit(item.value);
+                    // visit 按输出顺序登记片段，这里逆序压栈
+                    for (size_t i = pending.size(); i-- > 0; ) {
+                        work.push_back(pending[i]);
+                    }
+                    pending.clear();
+                    break;
+                case PrintItem::Text:
+                    out << item.text;
+                    break;
+                case PrintItem::Spaces:
+                    for (uint32_t i = 0; i < item.value; ++i) out << " ";
+                    break;
+                case PrintItem::BadOp:
+                    out << " op(" << item.value << ") ";
+                    break;
+            }
+        }
+    }
+
+    void visitDefault(uint32_t n) {
+        spaces(indent);
+        text("$");
+    }
+
+    void visitCompUnit(uint32_t n) {
+        uint32_t l = ast.a[n];
+        for (uint32_t i = 0; i < ast.listCount(l); ++i) {
+            node(ast.listItem(l, i), indent);
+            text("\n");
+        }
+    }
+
+    void visitInteger(uint32_t n) { out << ast.ints[ast.a[n]]; }
+    void visitFloat(uint32_t n) { out << ast.floats[ast.a[n]]; }
+
+    void visitIdent(uint32_t n) {
+        if (const char *keyword = typeName(ast.op[n])) {
+            out << keyword << " ";
+        }
+        out << ast.names[ast.a[n]];
+    }
+
+    void visitMethodCall(uint32_t n) {
+        node(ast.a[n]);
+        text("(");
+        list(ast.b[n], ", ");
+        text(")");
+    }
+
+    void visitBinaryExpr(uint32_t n) {
+        node(ast.a[n]);
+        switch (ast.op[n]) {
+            case TPLUS:  text(" + "); break;
+            case TMINUS: text(" - "); break;
+            case TMUL:   text(" * "); break;
+            case TDIV:   text(" / "); break;
+            case TMOD:   text(" %"); break;
+            default:     badOp(ast.op[n]); break;
+        }
+        node(ast.b[n]);
+    }
+
+    void visitLogicalBinaryExpr(uint32_t n) {
+        node(ast.a[n]);
+        switch (ast.op[n]) {
+            case TCEQ: text(" == "); break;
+            case TCNE: text(" != "); break;
+            case TCLT: text(" < "); break;
+            case TCLE: text(" <= "); break;
+            case TCGT: text(" > "); break;
+            case TCGE: text(" >= "); break;
+            case TAND: text(" && "); break;
+            case TOR:  text(" || "); break;
+            default:   badOp(ast.op[n]); break;
+        }
+        node(ast.b[n]);
+    }
+
+    void visitUnaryExpr(uint32_t n) {
+        if (ast.op[n] == TMINUS) text("-");
+        else badOp(ast.op[n]);
+        node(ast.a[n]);
+    }
+
+    void visitLogicalUnaryExpr(uint32_t n) {
+        if (ast.op[n] == TNOT) text("!");
+        else badOp(ast.op[n]);
+        node(ast.a[n]);
+    }
+
+    void visitAssignment(uint32_t n) {
+        node(ast.a[n]);
+        text(" = ");
+        node(ast.b[n]);
+    }
+
+    void visitBlock(uint32_t n) {
+        text("{\n");
+        uint32_t l = ast.a[n];
+        for (uint32_t i = 0; i < ast.listCount(l); ++i) {
+            node(ast.listItem(l, i), indent + 2);
+            text("\n");
+        }
+        spaces(indent);
+        text("}");
+    }
+
+    void visitExprStmt(uint32_t n) {
+        spaces(indent);
+        node(ast.a[n]);
+        text(";");
+    }
+
+    void visitReturnStmt(uint32_t n) {
+        spaces(indent);
+        text("return ");
+        node(ast.a[n]);
+        text(";");
+    }
+
+    void visitVarDecl(uint32_t n) {
+        spaces(indent);
+        if (ast.op[n] & 2) text("extern ");
+        if (ast.op[n] & 1) text("const ");
+        node(ast.a[n]);
+        if (ast.b[n] != FlatNone) {
+            text(" = ");
+            node(ast.b[n]);
+        }
+        text(";");
+    }
+
+    void visitFuncDecl(uint32_t n) {
+        spaces(indent);
+        node(ast.a[n]);
+        text("(");
+        // 参数只打印类型和名字
+        uint32_t l = ast.c[n];
+        uint32_t count = ast.listCount(l);
+        for (uint32_t i = 0; i < count; ++i) {
+            node(ast.a[ast.listItem(l, i)]);
+            if (i != count - 1)
+                text(", ");
+        }
+        if (ast.op[n]) {
+            text(");");
+            return;
+        }
+        text(") ");
+        node(ast.b[n], indent);
+    }
+
+    void visitIfStmt(uint32_t n) {
+        spaces(indent);
+        text("if (");
+        node(ast.a[n]);
+        text(") ");
+        node(ast.b[n], indent);
+        if (ast.c[n] != FlatNone) {
+            text("\n");
+            spaces(indent);
+            text("else ");
+            node(ast.c[n], indent);
+        }
+    }
+
+    void visitWhileStmt(uint32_t n) {
+        if (ast.c[n] != FlatNone) {
+            for (uint32_t i = 0; i < ast.listCount(ast.c[n]); i++) {
+                spaces(indent);
+                text(ast.names[ast.listItem(ast.c[n], i)].c_str());
+                text("\n");
+            }
+        }
+        spaces(indent);
+        text("while (");
+        node(ast.a[n]);
+        text(") ");
+        node(ast.b[n], indent);
+    }
+
+    void visitParallelFor(uint32_t n) {
+        spaces(indent);
+        text("parallel for (");
+        node(ast.listItem(ast.a[n], 0));
+        text("; ");
+        node(ast.listItem(ast.a[n], 1));
+        text("; ");
+        node(ast.listItem(ast.a[n], 2));
+        text(") ");
+        if (ast.c[n] != FlatNone) {
+            for (uint32_t i = 0; i < ast.listCount(ast.c[n]); i += 2) {
+                text("reduction(");
+                text(ast.names[ast.listItem(ast.c[n], i)].c_str());
+                text(": ");
+                text(ast.names[ast.listItem(ast.c[n], i + 1)].c_str());
+                text(") ");
+            }
+        }
+        node(ast.b[n], indent);
+    }
+
+    void visitBreakStmt(uint32_t n) {
+        spaces(indent);
+        text("break;");
+    }
+
+    void visitContinueStmt(uint32_t n) {
+        spaces(indent);
+        text("continue;");
+    }
+};
+
+} // namespace
+
+void FlatAST::print(std::ostream& out) const {
+    if (root == FlatNone) {
+        return;
+    }
+    FlatPrinter printer(*this, out);
+    printer.run(root);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class NCompUnit;
+
+// 扁平 AST 的节点种类标签，与 node.h 中的类一一对应
+enum class FlatKind : uint8_t {
+    CompUnit,
+    VarDecl,
+    FuncDecl,
+    Integer,
+    Float,
+    Ident,
+    MethodCall,
+    BinaryExpr,
+    LogicalBinaryExpr,
+    UnaryExpr,
+    LogicalUnaryExpr,
+    Assignment,
+    Block,
+    ExprStmt,
+    ReturnStmt,
+    IfStmt,
+    WhileStmt,
+    BreakStmt,
+    ContinueStmt,
+    ParallelFor,
+    Unknown
+};
+
+// 表示“没有这个子节点”的下标
+const uint32_t FlatNone = 0xffffffffu;
+
+// 结构数组（SoA）形式的 AST：每个节点只占各数组中的一个槽位，
+// 子节点用 32 位下标引用。各种类对槽位的使用：
+//   CompUnit / Block      a = 子节点列表在 lists 中的起点
+//   VarDecl               op = isConst | isExtern << 1, a = Ident, b = 初始化表达式
+//   FuncDecl              op = isPrototype, a = Ident, b = Block, c = 参数列表起点
+//   Integer / Float       a = ints / floats 下标
+//   Ident                 op = 类型 token, a = names 下标
+//   MethodCall            a = Ident, b = 实参列表起点
+//   BinaryExpr 等         op = 运算符 token, a = lhs, b = rhs
+//   UnaryExpr 等          op = 运算符 token, a = 操作数
+//   Assignment            a = Ident, b = 右值
+//   ExprStmt / ReturnStmt a = 表达式
+//   IfStmt                a = 条件, b = 真分支, c = 假分支
+//   WhileStmt             a = 条件, b = 循环体, c = #pragma 列表起点（元素是 names 下标）
+//   ParallelFor           a = [初始化, 条件, 步进] 列表起点, b = 循环体,
+//                         c = reduction 列表起点（元素依次是运算符和变量名的 names 下标）
+// 子节点列表在 lists 中以 [个数, 子节点...] 的形式连续存放。
+// 节点按先序编号，每棵子树占连续的一段下标，从子树的根开始顺序扫描即可访问整棵子树。
+class FlatAST {
+public:
+    std::vector<FlatKind> kind;
+    std::vector<uint16_t> op;
+    std::vector<uint32_t> a;
+    std::vector<uint32_t> b;
+    std::vector<uint32_t> c;
+
+    std::vector<uint32_t> lists;
+    std::vector<long long> ints;
+    std::vector<double> floats;
+    std::vector<std::string> names;
+
+    uint32_t root = FlatNone;
+
+    // 从 node.h 的对象树构建，使用显式栈，不依赖递归深度
+    static FlatAST build(const NCompUnit& unit);
+
+    size_t size() const { return kind.size(); }
+    // 每个节点在各数组中占用的字节数
+    static size_t bytesPerNode() {
+        return sizeof(FlatKind) + sizeof(uint16_t) + 3 * sizeof(uint32_t);
+    }
+
+    uint32_t listCount(uint32_t list) const { return lists[list]; }
+    uint32_t listItem(uint32_t list, uint32_t i) const { return lists[list + 1 + i]; }
+
+    // 与 Node::print 输出一致的源码还原
+    void print(std::ostream& out) const;
+
+private:
+    std::unordered_map<std::string, uint32_t> nameIndex;
+
+    uint32_t addNode(FlatKind k, uint16_t o = 0);
+    uint32_t intern(const std::string& name);
+};
+
+// 不经过虚函数的访问器：按 kind 标签静态分派到 Derived 的 visitXxx 方法。
+// Derived 只需实现自己关心的方法，其余落到 visitDefault。
+template <typename Derived>
+class FlatVisitor {
+public:
+    const FlatAST& ast;
+    FlatVisitor(const FlatAST& ast) : ast(ast) { }
+
+    void visit(uint32_t n) {
+        Derived& self = static_cast<Derived&>(*this);
+        switch (ast.kind[n]) {
+            case FlatKind::CompUnit:          self.visitCompUnit(n); break;
+            case FlatKind::VarDecl:           self.visitVarDecl(n); break;
+            case FlatKind::FuncDecl:          self.visitFuncDecl(n); break;
+            case FlatKind::Integer:           self.visitInteger(n); break;
+            case FlatKind::Float:             self.visitFloat(n); break;
+            case FlatKind::Ident:             self.visitIdent(n); break;
+            case FlatKind::MethodCall:        self.visitMethodCall(n); break;
+            case FlatKind::BinaryExpr:        self.visitBinaryExpr(n); break;
+            case FlatKind::LogicalBinaryExpr: self.visitLogicalBinaryExpr(n); break;
+            case FlatKind::UnaryExpr:         self.visitUnaryExpr(n); break;
+            case FlatKind::LogicalUnaryExpr:  self.visitLogicalUnaryExpr(n); break;
+            case FlatKind::Assignment:        self.visitAssignment(n); break;
+            case FlatKind::Block:             self.visitBlock(n); break;
+            case FlatKind::ExprStmt:          self.visitExprStmt(n); break;
+            case FlatKind::ReturnStmt:        self.visitReturnStmt(n); break;
+            case FlatKind::IfStmt:            self.visitIfStmt(n); break;
+            case FlatKind::WhileStmt:         self.visitWhileStmt(n); break;
+            case FlatKind::BreakStmt:         self.visitBreakStmt(n); break;
+            case FlatKind::ContinueStmt:      self.visitContinueStmt(n); break;
+            case FlatKind::ParallelFor:       self.visitParallelFor(n); break;
+            default:                          self.visitDefault(n); break;
+        }
+    }
+
+    void visitDefault(uint32_t n) { }
+    void visitCompUnit(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitVarDecl(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitFuncDecl(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitInteger(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitFloat(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitIdent(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitMethodCall(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitBinaryExpr(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitLogicalBinaryExpr(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitUnaryExpr(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitLogicalUnaryExpr(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitAssignment(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitBlock(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitExprStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitReturnStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitIfStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitWhileStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitBreakStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitContinueStmt(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+    void visitParallelFor(uint32_t n) { static_cast<Derived&>(*this).visitDefault(n); }
+};
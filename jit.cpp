@@ -0,0 +1,155 @@
+// jit.cpp
+#include "jit.h"
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Object/SymbolSize.h>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+
+// 按 perf 的约定把每个加载的函数写进 /tmp/perf-<pid>.map，一行一个：
+// 起始地址 长度 名字（都是十六进制）。perf report 靠它给 JIT 代码的采样起名字
+class PerfMapListener : public JITEventListener {
+    FILE *file;
+
+public:
+    PerfMapListener() {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        file = fopen(path, "a");
+        if (!file) {
+            perror(path);
+        }
+    }
+
+    ~PerfMapListener() override {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    void notifyObjectLoaded(ObjectKey key, const object::ObjectFile& object,
+                            const RuntimeDyld::LoadedObjectInfo& info) override {
+        if (!file) {
+            return;
+        }
+        // 调试对象里的节地址已经改成了加载后的地址
+        object::OwningBinary<object::ObjectFile> debug = info.getObjectForDebug(object);
+        const object::ObjectFile& loaded = debug.getBinary() ? *debug.getBinary() : object;
+        for (const auto& symbol : object::computeSymbolSizes(loaded)) {
+            Expected<object::SymbolRef::Type> type = symbol.first.getType();
+            Expected<StringRef> name = symbol.first.getName();
+            Expected<uint64_t> address = symbol.first.getAddress();
+            if (!type || !name || !address || *type != object::SymbolRef::ST_Function || symbol.second == 0) {
+                consumeError(type.takeError());
+                consumeError(name.takeError());
+                consumeError(address.takeError());
+                continue;
+            }
+            fprintf(file, "%llx %llx %s\n", (unsigned long long)*address,
+                    (unsigned long long)symbol.second, name->str().c_str());
+        }
+        fflush(file);
+    }
+};
+
+} // namespace
+
+// 把 LLVM 的 Error 打印出来，返回是否出错
+static bool report(Error error, const char *what) {
+    if (!error) {
+        return false;
+    }
+    std::cerr << what << ": " << toString(std::move(error)) << std::endl;
+    return true;
+}
+
+JitSession::JitSession(bool symbols, const CpuTarget& target) {
+    LLJITBuilder builder;
+    Expected<JITTargetMachineBuilder> machine = JITTargetMachineBuilder::detectHost();
+    if (!machine) {
+        report(machine.takeError(), "Failed to detect host");
+        return;
+    }
+    std::string cpu, features;
+    resolveCpuTarget(target, cpu, features);
+    machine->setCPU(cpu);
+    machine->getFeatures() = SubtargetFeatures(features);
+    builder.setJITTargetMachineBuilder(std::move(*machine));
+    if (symbols) {
+        perfMap.reset(new PerfMapListener());
+        // 事件监听器挂在 RuntimeDyld 上，这里显式创建这一层
+        JITEventListener *perfMapListener = perfMap.get();
+        builder.setObjectLinkingLayerCreator([perfMapListener](ExecutionSession& session, const Triple&) {
+            std::unique_ptr<RTDyldObjectLinkingLayer> layer(new RTDyldObjectLinkingLayer(session, []() {
+                return std::unique_ptr<RuntimeDyld::MemoryManager>(new SectionMemoryManager());
+            }));
+            layer->registerJITEventListener(*perfMapListener);
+            layer->registerJITEventListener(*JITEventListener::createGDBRegistrationListener());
+            // LLVM 编译时没有打开 perf 支持时为空
+            if (JITEventListener *jitdump = JITEventListener::createPerfJITEventListener()) {
+                layer->registerJITEventListener(*jitdump);
+            }
+            return Expected<std::unique_ptr<ObjectLayer> >(std::move(layer));
+        });
+    }
+    Expected<std::unique_ptr<LLJIT> > created = builder.create();
+    if (!created) {
+        report(created.takeError(), "Failed to create JIT");
+        return;
+    }
+    // printf、printi 等由编译器进程自身提供（链接时带 -rdynamic）
+    Expected<std::unique_ptr<DynamicLibrarySearchGenerator> > process =
+        DynamicLibrarySearchGenerator::GetForCurrentProcess((*created)->getDataLayout().getGlobalPrefix());
+    if (!process) {
+        report(process.takeError(), "Failed to expose process symbols");
+        return;
+    }
+    (*created)->getMainJITDylib().addGenerator(std::move(*process));
+    jit = std::move(*created);
+}
+
+ResourceTrackerSP JitSession::add(ThreadSafeModule module) {
+    ResourceTrackerSP tracker = jit->getMainJITDylib().createResourceTracker();
+    if (report(jit->addIRModule(tracker, std::move(module)), "Failed to add module")) {
+        return nullptr;
+    }
+    return tracker;
+}
+
+bool JitSession::runMain(long long& result, unsigned intBits) {
+    Expected<JITEvaluatedSymbol> main = jit->lookup("main");
+    if (!main) {
+        report(main.takeError(), "Function main not found");
+        return false;
+    }
+    // 返回 i32 的 main 只写 eax，当成 64 位读时高 32 位是残留的值
+    if (intBits == 32) {
+        int32_t (*entry)() = jitTargetAddressToFunction<int32_t (*)()>(main->getAddress());
+        result = entry();
+    } else {
+        int64_t (*entry)() = jitTargetAddressToFunction<int64_t (*)()>(main->getAddress());
+        result = entry();
+    }
+    return true;
+}
+
+bool JitSession::remove(ResourceTrackerSP tracker) {
+    return !report(tracker->remove(), "Failed to unload module");
+}
+
+bool JitSession::run(ThreadSafeModule module, long long& result, unsigned intBits) {
+    ResourceTrackerSP tracker = add(std::move(module));
+    if (!tracker) {
+        return false;
+    }
+    bool ok = runMain(result, intBits);
+    return remove(tracker) && ok;
+}
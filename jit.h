@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include "target.h"
+
+// 可反复使用的 JIT 会话。每个模块连同它自己的 LLVMContext 加进来，
+// 运行后通过资源跟踪器卸载，机器码、数据段和 IR 都随之释放，
+// 一个进程里连续运行任意多个程序内存也不会增长。
+class JitSession {
+    // 先于 jit 声明，jit 析构时监听器还在
+    std::unique_ptr<llvm::JITEventListener> perfMap;
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+
+public:
+    // 失败时打印原因，valid() 为 false。
+    // symbols 为 true 时把生成的函数告诉 perf 和 gdb：写 /tmp/perf-<pid>.map，
+    // 生成 perf inject 用的 jitdump，并向 gdb 注册调试对象。
+    // 机器码默认针对本机的 CPU 和特性生成
+    explicit JitSession(bool symbols = false, const CpuTarget& target = CpuTarget{"native", ""});
+
+    bool valid() const { return jit != nullptr; }
+
+    // 加入模块，返回卸载它用的资源跟踪器；失败时返回空
+    llvm::orc::ResourceTrackerSP add(llvm::orc::ThreadSafeModule module);
+    // 运行已加入的模块中的 main，result 为它的返回值。intBits 是 main 返回的 int 的位数
+    // （CodeGenContext::intBits，-fint32 时为 32），按这个宽度调用后符号扩展
+    bool runMain(long long& result, unsigned intBits = 64);
+    // 卸载 tracker 名下的全部代码和数据
+    bool remove(llvm::orc::ResourceTrackerSP tracker);
+
+    // add、runMain、remove 一次完成
+    bool run(llvm::orc::ThreadSafeModule module, long long& result, unsigned intBits = 64);
+};
@@ -0,0 +1,104 @@
+// lexbench.cpp: 单独测词法分析器的吞吐量，不经过语法分析和代码生成。
+// 分别与 tokens.o（flex）和 lexer.o（手写）链接成 lexbench-flex / lexbench-simd，
+// 见 Makefile 的 bench-lexer 目标和 bench/lexer.sh。
+//
+//   lexbench [--dump] [--repeat N] file.sy
+//
+// 默认把文件完整分析 N 遍，打印 token 数、耗时和每秒 token 数；
+// --dump 按行打印每个 token 的编号、行号和值，用来比较两个实现的输出是否一致。
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include "node.h"
+#include "parser.hpp"
+
+YYSTYPE yylval;
+extern int yylex();
+extern FILE *yyin;
+extern void yyrestart(FILE *file);
+extern long long lineCount;
+
+static bool failed = false;
+
+void yyerror(const char *s) {
+    std::fprintf(stderr, "Error at line %lld: %s\n", lineCount, s);
+    failed = true;
+}
+
+static void dumpToken(int token) {
+    std::printf("%d %lld", token, lineCount);
+    switch (token) {
+        case TIDENTIFIER:
+        case TPRAGMA:
+            std::printf(" %s", yylval.string->c_str());
+            break;
+        case TINTEGER:
+            std::printf(" %lld", yylval.number_int);
+            break;
+        case TFLOAT:
+            std::printf(" %.17g", yylval.number_float);
+            break;
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char **argv) {
+    bool dump = false;
+    int repeat = 1;
+    const char *filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--dump") == 0) {
+            dump = true;
+        }
+        else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::atoi(argv[++i]);
+        }
+        else {
+            filename = argv[i];
+        }
+    }
+    if (!filename || repeat < 1) {
+        std::fprintf(stderr, "usage: %s [--dump] [--repeat N] file.sy\n", argv[0]);
+        return 1;
+    }
+
+    long long tokens = 0;
+    long long bytes = 0;
+    double seconds = 0;
+    for (int run = 0; run < repeat && !failed; run++) {
+        yyin = std::fopen(filename, "r");
+        if (!yyin) {
+            std::perror(filename);
+            return 1;
+        }
+        // 两个实现都直接 read 文件描述符，不能动 FILE 的读写位置
+        struct stat st;
+        fstat(fileno(yyin), &st);
+        bytes += st.st_size;
+        yyrestart(yyin);
+        lineCount = 1;
+        auto start = std::chrono::steady_clock::now();
+        while (int token = yylex()) {
+            tokens++;
+            if (dump) {
+                dumpToken(token);
+            }
+            if (token == TIDENTIFIER || token == TPRAGMA) {
+                delete yylval.string;
+            }
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::fclose(yyin);
+    }
+    if (failed) {
+        return 1;
+    }
+    if (!dump) {
+        std::printf("%lld tokens, %.1f MB, %.3f s, %.2f Mtokens/s, %.1f MB/s\n", tokens, bytes / 1e6,
+                    seconds, tokens / seconds / 1e6, bytes / seconds / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,580 @@
+// lexer.cpp: 手写的词法分析器，make LEXER=simd 时代替 flex 生成的 tokens.cpp。
+// 接受的语言、送给 parser.y 的 token 和 yylval、行号和出错行为都与 tokens.l 相同，
+// 对外同样是 yylex / yyin / yyrestart / lineCount / lexFromBuffer / lexEndBuffer。
+//
+// 与 flex 的区别在于大段的字节怎么跳过：空白、标识符、注释体、#pragma 行都用 SIMD
+// 一次比较 16 字节（SSE2）或 32 字节（AVX2，运行时检测 CPU 后选用），用 movemask
+// 找到第一个要停下的字节，换行数用 popcount 一次数完；不是 x86 时逐字节查表。
+// 关键字用完美哈希一次比较就能认出，不经过 DFA。
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "node.h"
+#include "parser.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEXER_X86 1
+#endif
+
+void yyerror(const char *s);
+void printDiagnostic(FILE *stream, const std::string& text);
+
+long long lineCount = 1;
+FILE *yyin = NULL;
+
+namespace {
+
+// 数据末尾之后总留这么多 0：SIMD 读取可以越过末尾，0 让每种扫描都停下
+const size_t PADDING = 64;
+const size_t READ_SIZE = 1 << 16;
+
+// 输入缓冲区。buf[0, end) 是读到的数据，pos 是下一个要分析的字节；
+// 补充数据时从当前 token 的起点开始整体前移，所以扫描中只记下标，不记指针
+struct Input {
+    char *buf = NULL;
+    size_t cap = 0;
+    size_t pos = 0;
+    size_t end = 0;
+    int fd = -1;            // -1 表示内存中的源码，没有更多数据
+    bool eof = true;
+    FILE *file = NULL;      // 当前在读的 yyin，换了文件就重新开始
+    bool active = false;
+};
+
+Input in;
+
+void reserve(size_t size) {
+    if (in.buf && size <= in.cap) {
+        return;
+    }
+    size_t cap = in.cap ? in.cap : READ_SIZE;
+    while (cap < size) {
+        cap *= 2;
+    }
+    in.buf = (char *)realloc(in.buf, cap + PADDING);
+    in.cap = cap;
+}
+
+void terminate() {
+    memset(in.buf + in.end, 0, PADDING);
+}
+
+void startFile(FILE *file) {
+    reserve(READ_SIZE);
+    in.file = file;
+    in.fd = fileno(file);
+    in.pos = in.end = 0;
+    in.eof = false;
+    in.active = true;
+    terminate();
+}
+
+// 读入更多数据：有多少读多少，管道里的输入不必凑满缓冲区就能开始分析。
+// start 是当前 token 的起点，它之前的数据不再需要；返回是否读到了新数据
+bool refill(size_t& start) {
+    if (in.eof) {
+        return false;
+    }
+    if (start > 0) {
+        memmove(in.buf, in.buf + start, in.end - start);
+        in.pos -= start;
+        in.end -= start;
+        start = 0;
+    }
+    reserve(in.end + READ_SIZE);
+    ssize_t n;
+    while ((n = read(in.fd, in.buf + in.end, in.cap - in.end)) < 0 && errno == EINTR);
+    if (n <= 0) {
+        in.eof = true;
+        terminate();
+        return false;
+    }
+    in.end += n;
+    terminate();
+    return true;
+}
+
+// pos 之后至少还有 n 个字节，或者已经没有更多输入
+void ensure(size_t& start, size_t n) {
+    while (in.pos + n > in.end && refill(start));
+}
+
+// ---- 字节分类 ----
+
+enum : uint8_t { C_SPACE = 1, C_NEWLINE = 2, C_IDENT = 4, C_DIGIT = 8 };
+
+struct CharTable {
+    uint8_t cls[256];
+    CharTable() {
+        memset(cls, 0, sizeof(cls));
+        cls[(uint8_t)' '] = cls[(uint8_t)'\t'] = C_SPACE;
+        cls[(uint8_t)'\n'] = C_NEWLINE;
+        for (int c = 'a'; c <= 'z'; c++) cls[c] = C_IDENT;
+        for (int c = 'A'; c <= 'Z'; c++) cls[c] = C_IDENT;
+        for (int c = '0'; c <= '9'; c++) cls[c] = C_IDENT | C_DIGIT;
+        cls[(uint8_t)'_'] = C_IDENT;
+    }
+};
+const CharTable chars;
+
+inline uint8_t classOf(char c) { return chars.cls[(uint8_t)c]; }
+
+// ---- 扫描内核：都从 p 开始，返回第一个要停下的位置，末尾的 0 保证会停 ----
+
+// 跳过空格、制表符和换行，newlines 加上跳过的换行数
+const char *skipSpaceScalar(const char *p, long long& newlines) {
+    while (uint8_t c = classOf(*p) & (C_SPACE | C_NEWLINE)) {
+        newlines += c == C_NEWLINE;
+        p++;
+    }
+    return p;
+}
+
+const char *skipIdentScalar(const char *p) {
+    while (classOf(*p) & C_IDENT) {
+        p++;
+    }
+    return p;
+}
+
+// 找 '\n' 或 0
+const char *findLineEndScalar(const char *p) {
+    while (*p != '\n' && *p != 0) {
+        p++;
+    }
+    return p;
+}
+
+// 找 '*' 或 0，newlines 加上经过的换行数
+const char *findStarScalar(const char *p, long long& newlines) {
+    while (*p != '*' && *p != 0) {
+        newlines += *p == '\n';
+        p++;
+    }
+    return p;
+}
+
+#ifdef LEXER_X86
+
+// 有符号比较对 ASCII 足够：128 以上的字节是负数，不落在任何区间里
+inline __m128i inRange16(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+inline __m128i identMask16(__m128i v) {
+    // 或上 0x20 把大写字母变成小写，'@' '[' 等邻居变成的字符都不在 a-z 里
+    __m128i letter = inRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = inRange16(v, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+}
+
+const char *skipSpaceSSE2(const char *p, long long& newlines) {
+    for (;;) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))), nl);
+        unsigned stop = ~_mm_movemask_epi8(space) & 0xffff;
+        unsigned lines = _mm_movemask_epi8(nl);
+        if (stop) {
+            unsigned n = __builtin_ctz(stop);
+            newlines += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n;
+        }
+        newlines += __builtin_popcount(lines);
+        p += 16;
+    }
+}
+
+const char *skipIdentSSE2(const char *p) {
+    for (;;) {
+        unsigned stop = ~_mm_movemask_epi8(identMask16(_mm_loadu_si128((const __m128i *)p))) & 0xffff;
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+        p += 16;
+    }
+}
+
+const char *findLineEndSSE2(const char *p) {
+    for (;;) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+            _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+        p += 16;
+    }
+}
+
+const char *findStarSSE2(const char *p, long long& newlines) {
+    for (;;) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+            _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        unsigned lines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (stop) {
+            unsigned n = __builtin_ctz(stop);
+            newlines += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n;
+        }
+        newlines += __builtin_popcount(lines);
+        p += 16;
+    }
+}
+
+#define AVX2 __attribute__((target("avx2,popcnt")))
+
+AVX2 inline __m256i inRange32(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2 const char *skipSpaceAVX2(const char *p, long long& newlines) {
+    for (;;) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i space = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))), nl);
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(space);
+        unsigned lines = _mm256_movemask_epi8(nl);
+        if (stop) {
+            unsigned n = __builtin_ctz(stop);
+            newlines += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n;
+        }
+        newlines += __builtin_popcount(lines);
+        p += 32;
+    }
+}
+
+AVX2 const char *skipIdentAVX2(const char *p) {
+    for (;;) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i letter = inRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digit = inRange32(v, '0', '9');
+        __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+        p += 32;
+    }
+}
+
+AVX2 const char *findLineEndAVX2(const char *p) {
+    for (;;) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned stop = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+            _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+        p += 32;
+    }
+}
+
+AVX2 const char *findStarAVX2(const char *p, long long& newlines) {
+    for (;;) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned stop = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+            _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+        unsigned lines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (stop) {
+            unsigned n = __builtin_ctz(stop);
+            newlines += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n;
+        }
+        newlines += __builtin_popcount(lines);
+        p += 32;
+    }
+}
+
+#endif
+
+struct Kernels {
+    const char *(*skipSpace)(const char *p, long long& newlines);
+    const char *(*skipIdent)(const char *p);
+    const char *(*findLineEnd)(const char *p);
+    const char *(*findStar)(const char *p, long long& newlines);
+};
+
+// SYSY_LEXER=scalar / sse2 可以强制选用较窄的实现，便于对比
+Kernels selectKernels() {
+    const char *forced = getenv("SYSY_LEXER");
+    std::string choice = forced ? forced : "";
+#ifdef LEXER_X86
+    if (choice != "scalar" && choice != "sse2" && __builtin_cpu_supports("avx2")) {
+        return { skipSpaceAVX2, skipIdentAVX2, findLineEndAVX2, findStarAVX2 };
+    }
+    if (choice != "scalar") {
+        return { skipSpaceSSE2, skipIdentSSE2, findLineEndSSE2, findStarSSE2 };
+    }
+#endif
+    return { skipSpaceScalar, skipIdentScalar, findLineEndScalar, findStarScalar };
+}
+
+const Kernels kernels = selectKernels();
+
+// ---- 关键字：按长度、首字母和末字母的完美哈希 ----
+
+const int KEYWORD_SLOTS = 32;
+
+inline unsigned keywordHash(const char *s, size_t length) {
+    return (length + (uint8_t)s[0] * 4 + (uint8_t)s[length - 1] * 2) & (KEYWORD_SLOTS - 1);
+}
+
+struct Keyword {
+    const char *word;
+    size_t length;
+    int token;
+};
+
+struct KeywordTable {
+    Keyword slots[KEYWORD_SLOTS];
+    KeywordTable() {
+        static const Keyword keywords[] = {
+            {"const", 5, TCONST}, {"extern", 6, TEXTERN}, {"if", 2, TIF}, {"else", 4, TELSE},
+            {"while", 5, TWHILE}, {"break", 5, TBREAK}, {"continue", 8, TCONTINUE},
+            {"parallel", 8, TPARALLEL}, {"for", 3, TFOR}, {"reduction", 9, TREDUCTION},
+            {"return", 6, TRETURN}, {"int", 3, TINTTYPE}, {"float", 5, TFLOATTYPE},
+            {"void", 4, TVOIDTYPE}, {"int4", 4, TINT4TYPE}, {"int8", 4, TINT8TYPE},
+            {"float4", 6, TFLOAT4TYPE}, {"float8", 6, TFLOAT8TYPE},
+        };
+        memset(slots, 0, sizeof(slots));
+        for (const Keyword& keyword : keywords) {
+            Keyword& slot = slots[keywordHash(keyword.word, keyword.length)];
+            // 新增关键字与已有的撞了槽位时要换哈希函数
+            if (slot.word) {
+                fprintf(stderr, "lexer: keywords %s and %s share a hash slot\n", slot.word, keyword.word);
+                abort();
+            }
+            slot = keyword;
+        }
+    }
+};
+const KeywordTable keywordTable;
+
+// 是关键字时返回它的 token，否则返回 0
+inline int keywordToken(const char *s, size_t length) {
+    const Keyword& slot = keywordTable.slots[keywordHash(s, length)];
+    if (slot.length == length && memcmp(slot.word, s, length) == 0) {
+        return slot.token;
+    }
+    return 0;
+}
+
+inline int token(int t) {
+    yylval.token = t;
+    return t;
+}
+
+// 数字常量按 flex 的做法交给 atoll / atof，需要一份以 0 结尾的副本
+template <typename T> T convert(size_t start, T (*parse)(const char *)) {
+    char text[64];
+    size_t length = in.pos - start;
+    if (length < sizeof(text)) {
+        memcpy(text, in.buf + start, length);
+        text[length] = 0;
+        return parse(text);
+    }
+    return parse(std::string(in.buf + start, length).c_str());
+}
+
+double parseFloat(const char *s) { return atof(s); }
+long long parseInt(const char *s) { return atoll(s); }
+
+// 从 in.pos 开始用 scan 扫描，缓冲区用完时补充数据接着扫，停下时 in.pos 指向停下的字节
+template <typename Scan> void scanRun(size_t& start, Scan scan) {
+    for (;;) {
+        in.pos = scan(in.buf + in.pos) - in.buf;
+        if (in.pos < in.end || !refill(start)) {
+            return;
+        }
+    }
+}
+
+// 已经读过开头的 "/*"
+void skipBlockComment(size_t& start) {
+    for (;;) {
+        long long newlines = 0;
+        scanRun(start, [&](const char *p) { return kernels.findStar(p, newlines); });
+        lineCount += newlines;
+        if (in.pos >= in.end) {
+            printDiagnostic(stderr, "Unclosed comment, except */.\n");
+            return;
+        }
+        if (in.buf[in.pos] == 0) {
+            // 源码里的 0 字节，注释里照样跳过
+            in.pos++;
+            continue;
+        }
+        in.pos++;
+        ensure(start, 1);
+        if (in.pos < in.end && in.buf[in.pos] == '/') {
+            in.pos++;
+            return;
+        }
+    }
+}
+
+// 行尾之前的内容，不含换行；遇到源码里的 0 字节继续找
+void skipToLineEnd(size_t& start) {
+    for (;;) {
+        scanRun(start, kernels.findLineEnd);
+        if (in.pos < in.end && in.buf[in.pos] == 0) {
+            in.pos++;
+            continue;
+        }
+        return;
+    }
+}
+
+} // namespace
+
+int yylex() {
+    if (!yyin) {
+        yyin = stdin;
+    }
+    if (!in.active || (in.fd >= 0 && in.file != yyin)) {
+        startFile(yyin);
+    }
+    for (;;) {
+        size_t start = in.pos;
+        long long newlines = 0;
+        scanRun(start, [&](const char *p) { return kernels.skipSpace(p, newlines); });
+        lineCount += newlines;
+        start = in.pos;
+        if (in.pos >= in.end) {
+            return 0;
+        }
+
+        char c = in.buf[in.pos];
+        uint8_t cls = classOf(c);
+        if (cls & C_DIGIT) {
+            // [0-9]+ 或 [0-9]+\.[0-9]*
+            auto digits = [&]() {
+                for (;;) {
+                    while (classOf(in.buf[in.pos]) & C_DIGIT) {
+                        in.pos++;
+                    }
+                    if (in.pos < in.end || !refill(start)) {
+                        return;
+                    }
+                }
+            };
+            digits();
+            ensure(start, 1);
+            if (in.pos < in.end && in.buf[in.pos] == '.') {
+                in.pos++;
+                ensure(start, 1);
+                digits();
+                yylval.number_float = convert<double>(start, parseFloat);
+                return TFLOAT;
+            }
+            yylval.number_int = convert<long long>(start, parseInt);
+            return TINTEGER;
+        }
+        if (cls & C_IDENT) {
+            scanRun(start, kernels.skipIdent);
+            size_t length = in.pos - start;
+            if (int keyword = keywordToken(in.buf + start, length)) {
+                return token(keyword);
+            }
+            yylval.string = new std::string(in.buf + start, length);
+            return TIDENTIFIER;
+        }
+
+        in.pos++;
+        ensure(start, 1);
+        char next = in.pos < in.end ? in.buf[in.pos] : 0;
+        switch (c) {
+            case '/':
+                if (next == '/') {
+                    skipToLineEnd(start);
+                    if (in.pos < in.end) {
+                        in.pos++;
+                        lineCount++;
+                    }
+                    continue;
+                }
+                if (next == '*') {
+                    in.pos++;
+                    skipBlockComment(start);
+                    continue;
+                }
+                return token(TDIV);
+            case '#':
+                ensure(start, 6);
+                if (in.end - in.pos >= 6 && memcmp(in.buf + in.pos, "pragma", 6) == 0) {
+                    skipToLineEnd(start);
+                    yylval.string = new std::string(in.buf + start, in.pos - start);
+                    return TPRAGMA;
+                }
+                break;
+            case '=':
+                if (next == '=') { in.pos++; return token(TCEQ); }
+                return token(TEQUAL);
+            case '!':
+                if (next == '=') { in.pos++; return token(TCNE); }
+                return token(TNOT);
+            case '<':
+                if (next == '=') { in.pos++; return token(TCLE); }
+                return token(TCLT);
+            case '>':
+                if (next == '=') { in.pos++; return token(TCGE); }
+                return token(TCGT);
+            case '&':
+                if (next == '&') { in.pos++; return token(TAND); }
+                break;
+            case '|':
+                if (next == '|') { in.pos++; return token(TOR); }
+                break;
+            case '(': return token(TLPAREN);
+            case ')': return token(TRPAREN);
+            case '[': return token(TLBRACKET);
+            case ']': return token(TRBRACKET);
+            case '{': return token(TLBRACE);
+            case '}': return token(TRBRACE);
+            case '.': return token(TDOT);
+            case ',': return token(TCOMMA);
+            case ';': return token(TSEMICOLON);
+            case ':': return token(TCOLON);
+            case '+': return token(TPLUS);
+            case '-': return token(TMINUS);
+            case '*': return token(TMUL);
+            case '%': return token(TMOD);
+        }
+        // 与 flex 的 "." 规则一致：报错后结束输入
+        yyerror("Unknown token!");
+        return 0;
+    }
+}
+
+// 与 flex 同名：丢掉缓冲区里剩下的内容，从 file 重新开始
+void yyrestart(FILE *file) {
+    yyin = file;
+    startFile(file);
+}
+
+/* 从内存中的一段源码读取 token，语言服务器用它单独重新解析一个声明 */
+void lexFromBuffer(const char *text, size_t size) {
+    reserve(size);
+    memcpy(in.buf, text, size);
+    in.pos = 0;
+    in.end = size;
+    in.fd = -1;
+    in.eof = true;
+    in.file = NULL;
+    in.active = true;
+    terminate();
+}
+
+void lexEndBuffer() {
+    in.active = false;
+}
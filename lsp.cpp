@@ -0,0 +1,422 @@
+// lsp.cpp
+#include "lsp.h"
+#include "memstats.h"
+#include "node.h"
+#include "rdparser.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+extern NCompUnit *programCompUnit;
+extern bool hasError;
+extern long long lineCount;
+extern void (*syntaxErrorHook)(long long line, const char *message);
+extern void lexFromBuffer(const char *text, size_t size);
+extern void lexEndBuffer();
+
+namespace {
+
+struct Diagnostic {
+    long long line;         // 相对所在块第一行的行号
+    std::string message;
+};
+
+// 一个顶层声明连同它前面的空白和注释，占文本中的 [begin, end)
+struct Chunk {
+    size_t begin;
+    size_t end;
+    bool empty;             // 只有空白和注释，不需要解析
+    std::vector<NDecl*> decls;
+    std::vector<Diagnostic> diagnostics;
+};
+
+// 从 p 开始切出一块：在括号深度为 0 处遇到 ';'，或 '}' 回到深度 0 时结束。
+// 切分只取决于起点之后的文本，因此从同一位置开始总会得到同样的块
+Chunk scanChunk(const std::string& text, size_t p) {
+    Chunk chunk;
+    chunk.begin = p;
+    chunk.empty = true;
+    int depth = 0;
+    size_t n = text.size();
+    while (p < n) {
+        char c = text[p];
+        if (c == '/' && p + 1 < n && text[p + 1] == '/') {
+            while (p < n && text[p] != '\n') {
+                p++;
+            }
+            continue;
+        }
+        if (c == '/' && p + 1 < n && text[p + 1] == '*') {
+            size_t close = text.find("*/", p + 2);
+            p = close == std::string::npos ? n : close + 2;
+            continue;
+        }
+        p++;
+        if (isspace((unsigned char)c)) {
+            continue;
+        }
+        chunk.empty = false;
+        if (c == '{' || c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth = depth > 0 ? depth - 1 : 0;
+        } else if (c == '}') {
+            depth = depth > 0 ? depth - 1 : 0;
+            if (depth == 0) {
+                break;
+            }
+        } else if (c == ';' && depth == 0) {
+            break;
+        }
+    }
+    chunk.end = p;
+    return chunk;
+}
+
+// 解析期间 yyerror 把错误记到这里
+std::vector<Diagnostic> *collecting = NULL;
+long long collectingBase = 0;
+
+void collectSyntaxError(long long line, const char *message) {
+    collecting->push_back({line - collectingBase, message});
+}
+
+// UTF-8 字节序列占多少个 UTF-16 码元（LSP 的列号以 UTF-16 计）
+int utf8Length(unsigned char lead) {
+    return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+class Document {
+public:
+    std::string text;
+    std::vector<size_t> lineStarts;
+    std::vector<Chunk> chunks;
+    NCompUnit unit;         // 各块的声明按顺序拼成的整棵树，声明归块所有
+    size_t reparsed;        // 上一次修改重新解析的块数
+
+    Document() : reparsed(0) { }
+    Document(const Document&) = delete;
+    ~Document() {
+        unit.decls.clear();
+        for (auto& chunk : chunks) {
+            release(chunk);
+        }
+    }
+
+    void open(const std::string& content) {
+        unit.decls.clear();
+        for (auto& chunk : chunks) {
+            release(chunk);
+        }
+        chunks.clear();
+        text = content;
+        indexLines();
+        for (size_t p = 0; p < text.size(); ) {
+            chunks.push_back(scanChunk(text, p));
+            parse(chunks.back());
+            p = chunks.back().end;
+        }
+        reparsed = chunks.size();
+        rebuildUnit();
+    }
+
+    // 用 insert 替换 [from, to)，只重新切分和解析受影响的块
+    void change(size_t from, size_t to, const std::string& insert) {
+        text.replace(from, to - from, insert);
+        indexLines();
+        long long delta = (long long)insert.size() - (long long)(to - from);
+        size_t editEnd = from + insert.size();
+
+        // 第一个受影响的块：包含编辑点前一个字符的块，编辑点恰在块边界时前一块的结尾也可能变
+        size_t probe = from > 0 ? from - 1 : 0;
+        auto after = std::upper_bound(chunks.begin(), chunks.end(), probe,
+            [](size_t offset, const Chunk& chunk) { return offset < chunk.begin; });
+        size_t first = after == chunks.begin() ? 0 : after - chunks.begin() - 1;
+
+        size_t p = chunks.empty() ? 0 : chunks[first].begin;
+        size_t next = first + 1;
+        size_t reuse = chunks.size();
+        std::vector<Chunk> fresh;
+        while (p < text.size()) {
+            if (p >= editEnd) {
+                // 某个编辑区之后的旧块起点与当前位置重合，后面的切分和解析结果都不变
+                while (next < chunks.size() && (chunks[next].begin < to ||
+                        (long long)chunks[next].begin + delta < (long long)p)) {
+                    next++;
+                }
+                if (next < chunks.size() && (long long)chunks[next].begin + delta == (long long)p) {
+                    reuse = next;
+                    break;
+                }
+            }
+            fresh.push_back(scanChunk(text, p));
+            parse(fresh.back());
+            p = fresh.back().end;
+        }
+
+        unit.decls.clear();
+        for (size_t i = first; i < reuse; i++) {
+            release(chunks[i]);
+        }
+        for (size_t i = reuse; i < chunks.size(); i++) {
+            chunks[i].begin += delta;
+            chunks[i].end += delta;
+        }
+        chunks.erase(chunks.begin() + first, chunks.begin() + reuse);
+        chunks.insert(chunks.begin() + first, fresh.begin(), fresh.end());
+        reparsed = fresh.size();
+        rebuildUnit();
+    }
+
+    // LSP 位置（行号从 0 起，列以 UTF-16 码元计）换算成字节偏移
+    size_t offsetOf(long long line, long long character) const {
+        if (line < 0) {
+            return 0;
+        }
+        if ((size_t)line >= lineStarts.size()) {
+            return text.size();
+        }
+        size_t p = lineStarts[line];
+        size_t end = lineEnd(line);
+        for (long long units = 0; p < end && units < character; ) {
+            int length = utf8Length(text[p]);
+            units += length == 4 ? 2 : 1;
+            p += length;
+        }
+        return std::min(p, end);
+    }
+
+    json::Array diagnostics() const {
+        json::Array out;
+        for (auto& chunk : chunks) {
+            if (chunk.diagnostics.empty()) {
+                continue;
+            }
+            long long base = lineOf(chunk.begin);
+            for (auto& diagnostic : chunk.diagnostics) {
+                long long line = std::min<long long>(base + diagnostic.line, lineStarts.size() - 1);
+                long long width = 0;
+                for (size_t p = lineStarts[line]; p < lineEnd(line); p += utf8Length(text[p])) {
+                    width += utf8Length(text[p]) == 4 ? 2 : 1;
+                }
+                out.push_back(json::Object{
+                    {"range", json::Object{
+                        {"start", json::Object{{"line", line}, {"character", 0}}},
+                        {"end", json::Object{{"line", line}, {"character", width}}}}},
+                    {"severity", 1},
+                    {"source", "sysy"},
+                    {"message", diagnostic.message}});
+            }
+        }
+        return out;
+    }
+
+private:
+    void indexLines() {
+        lineStarts.clear();
+        lineStarts.push_back(0);
+        for (size_t p = text.find('\n'); p != std::string::npos; p = text.find('\n', p + 1)) {
+            lineStarts.push_back(p + 1);
+        }
+    }
+
+    long long lineOf(size_t offset) const {
+        return std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin() - 1;
+    }
+
+    size_t lineEnd(long long line) const {
+        size_t end = (size_t)line + 1 < lineStarts.size() ? lineStarts[line + 1] - 1 : text.size();
+        if (end > lineStarts[line] && text[end - 1] == '\r') {
+            end--;
+        }
+        return end;
+    }
+
+    void parse(Chunk& chunk) {
+        if (chunk.empty) {
+            return;
+        }
+        // 词法分析器的行号从 1 开始
+        lineCount = lineOf(chunk.begin) + 1;
+        collecting = &chunk.diagnostics;
+        collectingBase = lineCount;
+        hasError = false;
+        programCompUnit = NULL;
+        syntaxErrorHook = collectSyntaxError;
+        lexFromBuffer(text.data() + chunk.begin, chunk.end - chunk.begin);
+        rdParse();
+        lexEndBuffer();
+        syntaxErrorHook = NULL;
+        // 语法分析器出错时已经释放了没读完的部分，留下的声明都是完整的树。
+        // 有错的块不提供声明，留下的也释放掉，输入时几乎每次重新解析都有错，不能积攒
+        if (programCompUnit) {
+            chunk.decls.swap(programCompUnit->decls);
+            delete programCompUnit;
+            if (hasError) {
+                release(chunk);
+            }
+        }
+        programCompUnit = NULL;
+    }
+
+    void release(Chunk& chunk) {
+        for (auto decl : chunk.decls) {
+            Node::deleteTree(decl);
+        }
+        chunk.decls.clear();
+    }
+
+    void rebuildUnit() {
+        unit.decls.clear();
+        for (auto& chunk : chunks) {
+            unit.decls.insert(unit.decls.end(), chunk.decls.begin(), chunk.decls.end());
+        }
+    }
+};
+
+std::map<std::string, std::unique_ptr<Document> > documents;
+
+bool readMessage(std::string& body) {
+    size_t length = 0;
+    std::string header;
+    while (std::getline(std::cin, header)) {
+        if (!header.empty() && header.back() == '\r') {
+            header.pop_back();
+        }
+        if (!header.empty()) {
+            if (header.compare(0, 15, "Content-Length:") == 0) {
+                length = strtoul(header.c_str() + 15, NULL, 10);
+            }
+            continue;
+        }
+        if (length == 0) {
+            continue;
+        }
+        body.resize(length);
+        return (bool)std::cin.read(&body[0], length);
+    }
+    return false;
+}
+
+void writeMessage(json::Value message) {
+    std::string body;
+    raw_string_ostream out(body);
+    out << message;
+    out.flush();
+    std::cout << "Content-Length: " << body.size() << "\r\n\r\n" << body << std::flush;
+}
+
+void reply(const json::Value& id, json::Value result) {
+    writeMessage(json::Object{{"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}});
+}
+
+void publishDiagnostics(const std::string& uri, json::Array diagnostics) {
+    writeMessage(json::Object{
+        {"jsonrpc", "2.0"},
+        {"method", "textDocument/publishDiagnostics"},
+        {"params", json::Object{{"uri", uri}, {"diagnostics", std::move(diagnostics)}}}});
+}
+
+long long positionField(const json::Object *position, StringRef name) {
+    if (!position) {
+        return 0;
+    }
+    return position->getInteger(name).getValueOr(0);
+}
+
+void applyChange(Document& document, const json::Object& change) {
+    std::string text = change.getString("text").getValueOr("").str();
+    const json::Object *range = change.getObject("range");
+    if (!range) {
+        document.open(text);
+        return;
+    }
+    const json::Object *start = range->getObject("start");
+    const json::Object *end = range->getObject("end");
+    size_t from = document.offsetOf(positionField(start, "line"), positionField(start, "character"));
+    size_t to = document.offsetOf(positionField(end, "line"), positionField(end, "character"));
+    document.change(from, std::max(from, to), text);
+}
+
+} // namespace
+
+int runLanguageServer() {
+    bool shutdownRequested = false;
+    std::string body;
+    while (readMessage(body)) {
+        Expected<json::Value> parsed = json::parse(body);
+        if (!parsed) {
+            std::cerr << "invalid message: " << toString(parsed.takeError()) << std::endl;
+            continue;
+        }
+        json::Object *message = parsed->getAsObject();
+        if (!message) {
+            continue;
+        }
+        std::string method = message->getString("method").getValueOr("").str();
+        const json::Value *id = message->get("id");
+        json::Object *params = message->getObject("params");
+        json::Object *textDocument = params ? params->getObject("textDocument") : NULL;
+        std::string uri = textDocument ? textDocument->getString("uri").getValueOr("").str() : "";
+
+        auto started = std::chrono::steady_clock::now();
+        if (method == "initialize" && id) {
+            reply(*id, json::Object{
+                {"capabilities", json::Object{
+                    {"textDocumentSync", json::Object{{"openClose", true}, {"change", 2}}}}},
+                {"serverInfo", json::Object{{"name", "sysy-parser"}}}});
+        } else if (method == "shutdown" && id) {
+            shutdownRequested = true;
+            reply(*id, nullptr);
+        } else if (method == "exit") {
+            return shutdownRequested ? 0 : 1;
+        } else if (method == "textDocument/didOpen" && textDocument) {
+            std::unique_ptr<Document>& document = documents[uri];
+            document.reset(new Document());
+            document->open(textDocument->getString("text").getValueOr("").str());
+        } else if (method == "textDocument/didChange" && textDocument) {
+            auto it = documents.find(uri);
+            json::Array *changes = params->getArray("contentChanges");
+            if (it == documents.end() || !changes) {
+                continue;
+            }
+            for (auto& change : *changes) {
+                if (const json::Object *object = change.getAsObject()) {
+                    applyChange(*it->second, *object);
+                }
+            }
+        } else if (method == "textDocument/didClose" && textDocument) {
+            documents.erase(uri);
+            publishDiagnostics(uri, json::Array());
+            continue;
+        } else {
+            if (id) {
+                writeMessage(json::Object{
+                    {"jsonrpc", "2.0"},
+                    {"id", *id},
+                    {"error", json::Object{{"code", -32601}, {"message", "method not found: " + method}}}});
+            }
+            continue;
+        }
+
+        auto it = documents.find(uri);
+        if (it != documents.end()) {
+            publishDiagnostics(uri, it->second->diagnostics());
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            std::cerr << uri << ": reparsed " << it->second->reparsed << " of "
+                      << it->second->chunks.size() << " declarations in " << ms << " ms, RSS "
+                      << residentKB() << " KB" << std::endl;
+        }
+    }
+    return shutdownRequested ? 0 : 1;
+}
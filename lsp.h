@@ -0,0 +1,6 @@
+#pragma once
+
+// 语言服务器（--lsp）：在标准输入输出上说 LSP，返回进程的退出码。
+// 打开的文档按顶层声明切块，编辑后只重新解析受影响的块，
+// 再把新声明拼回常驻内存的 NCompUnit。
+int runLanguageServer();
@@ -1,72 +1,685 @@
 #include <iostream>
 #include "codegen.h"
 #include "node.h"
+#include "parser.hpp"
+#include "declqueue.h"
+#include "flatast.h"
+#include "lsp.h"
+#include "daemon.h"
+#include "jit.h"
+#include "reach.h"
+#include "memstats.h"
+#include "astcache.h"
+#include "rdparser.h"
+#include "remarks.h"
 #include <fstream> // 添加此行以支持文件输出
+#include <llvm/Support/FileSystem.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
 
 using namespace std;
 
 extern int yyparse();
+extern int yylex();
+extern int yychar;
 extern NCompUnit* programCompUnit;
 
 extern int yydebug;
+extern void (*topLevelDeclHook)(NDecl *decl);
+extern void (*diagnosticHook)(FILE *stream, const std::string& text);
+extern bool keepTopLevelDecls;
 
 bool hasError = false;
 
 
 
-void open_file(const char* filename) {
-	// openfile
-	freopen(filename, "r", stdin);
+extern FILE *yyin;
+
+// 源文件直接交给词法分析器，标准输入留给运行的程序（getint / getch）
+static bool open_file(const char* filename) {
+	yyin = fopen(filename, "r");
+	if (!yyin) {
+		perror(filename);
+		return false;
+	}
+	return true;
 }
 
 void createCoreFunctions(CodeGenContext& context);
 
-int main(int argc, char **argv)
+// 解析线程与代码生成线程之间的顶层声明队列
+static DeclQueue declQueue;
+
+static void enqueueDecl(NDecl *decl) {
+	declQueue.push(decl);
+}
+
+static void enqueueDiagnostic(FILE *stream, const std::string& text) {
+	declQueue.push(stream, text);
+}
+
+static void dropDecl(NDecl *decl) {
+	Node::deleteTree(decl);
+}
+
+// --bison 时的推模式解析：每取到一个 token 就推给语法分析器。词法分析器按管道里
+// 实际到达的数据读取，顶层声明一归约就交给 topLevelDeclHook
+static int streamParse() {
+	yypstate *ps = yypstate_new();
+	int status;
+	do {
+		yychar = yylex();
+		status = yypush_parse(ps);
+	} while (status == YYPUSH_MORE);
+	yypstate_delete(ps);
+	return status;
+}
+
+// 命令行选择要执行的阶段。不给任何阶段选项时沿用原来的行为：
+// 打印语法树、写 ast.dot、打印 IR 并运行，同时输出跟踪信息
+struct Options {
+	const char *input = NULL;
+	const char *output = NULL;   // -o，所选阶段的输出文件
+	bool syntaxOnly = false;     // -fsyntax-only，只做语法分析
+	bool emitAst = false;        // --emit-ast，把语法树还原为源码
+	bool emitDot = false;        // --emit-dot，输出 AST 的 DOT 图
+	bool emitLLVM = false;       // --emit-llvm，输出 LLVM IR 文本
+	bool run = false;            // --run，用 JIT 执行 main
+	bool stream = false;         // --stream，边读边解析，生成完的声明即释放
+	bool prune = false;          // -fprune-unreachable，只为 main 可达的函数和全局变量生成代码
+	bool lsp = false;            // --lsp，在标准输入输出上运行语言服务器
+	const char *daemon = NULL;   // --daemon，在这个 Unix 套接字上运行编译服务器
+	int soak = 0;                // --soak N，在一个 JIT 会话里反复编译运行，检查内存不增长
+	bool verbose = false;        // -v，输出代码生成的跟踪信息
+	int optLevel = 0;            // -O0 到 -O3，生成 IR 后的优化级别
+	bool int32 = false;          // -fint32，int 按 SysY 规定为 32 位（默认 64 位）
+	bool narrowInts = false;     // -fnarrow-ints，按取值范围把整数运算收窄到 i32 / i16 / i8
+	bool jitSymbols = false;     // --jit-symbols，让 perf / gdb 认出 JIT 生成的函数
+	bool profile = false;        // --profile，统计各函数的调用次数和耗时，main 返回时打印
+	bool memoize = false;        // -fmemoize，记忆化纯的递归函数，main 返回时打印命中率
+	const char *cpu = NULL;      // -march / -mcpu，不给时 JIT 用本机 CPU，目标文件用 generic
+	string features;             // -mattr，逗号分隔的 +特性 / -特性
+	vector<string> multiversion; // -fmultiversion，含循环的函数按这些 CPU 各生成一份
+	bool memReport = false;      // --mem-report，按阶段、语法树节点类和函数统计内存
+	const char *astCache = NULL; // --ast-cache，语法树缓存目录，源码没变时跳过解析
+	bool compileOnly = false;    // -c，只把源文件编译成位码模块，留待链接
+	vector<string> libraries;    // 命令行上的 .bc 文件，与源文件链接成一个程序
+	bool bison = false;          // --bison，用 bison 生成的 LALR 分析器，默认用手写的 rdparser
+	string remarksFormat;        // -fsave-optimization-record[=yaml|json]，把优化备注按函数写入文件
+	const char *remarksFile = NULL;  // -foptimization-record-file，默认 <输出文件名或源文件名>.opt.<格式>
+	string remarksPasses;        // -foptimization-record-passes，只收 pass 名与这个正则匹配的备注
+	bool remarksSummary = false; // -fremarks-summary，在标准错误按出现次数列出没做的优化
+};
+
+static void usage(const char *prog) {
+	cerr << "用法: " << prog << " [选项] [源文件] [模块.bc ...]\n"
+	     << "  -fsyntax-only  只做语法分析\n"
+	     << "  --emit-ast     将语法树还原为源文件\n"
+	     << "  --emit-dot     输出 AST 的 DOT 图（默认写入 ast.dot）\n"
+	     << "  --emit-llvm    输出 LLVM IR\n"
+	     << "  --run          运行生成的代码\n"
+	     << "  --stream       边读入边解析和生成代码，不保留整棵语法树\n"
+	     << "  -fprune-unreachable  不为 main 用不到的函数和全局变量生成代码\n"
+	     << "  --lsp          在标准输入输出上运行语言服务器\n"
+	     << "  --daemon <套接字>  运行编译服务器，配合 sysyc 客户端使用\n"
+	     << "  --profile      插桩统计各函数的调用次数和耗时，main 返回时打印到标准错误\n"
+	     << "  --mem-report   在标准错误报告各编译阶段、各类语法树节点和各函数 IR 占用的内存\n"
+	     << "  --jit-symbols  运行时写 /tmp/perf-<pid>.map 和 jitdump，并向 gdb 注册 JIT 代码\n"
+	     << "  --soak <次数>  在同一进程里反复编译、运行、卸载，检查常驻内存不增长\n"
+	     << "  --ast-cache <目录>  按源码哈希缓存语法树，源码没变时跳过词法和语法分析\n"
+	     << "  --bison        用 bison 生成的语法分析器，默认用手写的递归下降分析器\n"
+	     << "  --threads <n>  --run 时 parallel for 使用的线程数，默认取 SYSY_THREADS 或 CPU 数\n"
+	     << "  -c             只编译成位码模块，默认写入 <源文件名>.bc\n"
+	     << "  模块.bc        与源文件链接在一起，内部化 main 以外的符号后做链接时优化；可以不给源文件只链接模块\n"
+	     << "  -o <文件>      所选阶段的输出文件；单独使用时生成目标文件\n"
+	     << "  -O0 ... -O3    优化级别，默认 -O0\n"
+	     << "  -fint32        int 为 32 位，默认 64 位\n"
+	     << "  -fnarrow-ints  优化时把取值范围小的整数运算收窄（需要 -O1 以上）\n"
+	     << "  -fmemoize      记忆化只读 int 参数、没有副作用的递归函数，main 返回时在标准错误打印命中率\n"
+	     << "  -march=<cpu>, -mcpu=<cpu>  针对这个 CPU 优化和生成代码，native 表示本机\n"
+	     << "  -mattr=<+特性,-特性>       在 CPU 自带的特性上增减\n"
+	     << "  -fmultiversion=<cpu>,...   含循环的函数按每个 CPU 各生成一份，运行时按本机特性选用\n"
+	     << "  -fsave-optimization-record[=yaml|json]  把优化流水线的备注（passed / missed / analysis）按函数写入文件\n"
+	     << "  -foptimization-record-file=<文件>        备注文件，默认 <-o 的文件名或源文件名>.opt.yaml 或 .opt.json\n"
+	     << "  -foptimization-record-passes=<正则>      只收 pass 名与正则匹配的备注\n"
+	     << "  -fremarks-summary  在标准错误按出现次数列出没做的优化（需要 -O1 以上）\n"
+	     << "  -v             输出代码生成的跟踪信息\n";
+}
+
+static bool parseOptions(int argc, char **argv, Options& opts) {
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-fsyntax-only") {
+			opts.syntaxOnly = true;
+		} else if (arg == "--emit-ast") {
+			opts.emitAst = true;
+		} else if (arg == "--emit-dot") {
+			opts.emitDot = true;
+		} else if (arg == "--emit-llvm") {
+			opts.emitLLVM = true;
+		} else if (arg == "--run") {
+			opts.run = true;
+		} else if (arg == "--stream") {
+			opts.stream = true;
+		} else if (arg == "-fint32") {
+			opts.int32 = true;
+		} else if (arg == "-fnarrow-ints") {
+			opts.narrowInts = true;
+		} else if (arg == "-fmemoize") {
+			opts.memoize = true;
+		} else if (arg == "-fprune-unreachable") {
+			opts.prune = true;
+		} else if (arg == "--profile") {
+			opts.profile = true;
+		} else if (arg == "--mem-report") {
+			opts.memReport = true;
+		} else if (arg == "--jit-symbols") {
+			opts.jitSymbols = true;
+		} else if (arg == "--lsp") {
+			opts.lsp = true;
+		} else if (arg == "--bison") {
+			opts.bison = true;
+		} else if (arg == "--daemon") {
+			if (++i == argc) {
+				cerr << "--daemon 缺少套接字路径\n";
+				return false;
+			}
+			opts.daemon = argv[i];
+		} else if (arg == "--soak") {
+			if (++i == argc || atoi(argv[i]) <= 0) {
+				cerr << "--soak 需要一个正整数\n";
+				return false;
+			}
+			opts.soak = atoi(argv[i]);
+		} else if (arg == "--ast-cache") {
+			if (++i == argc) {
+				cerr << "--ast-cache 缺少目录\n";
+				return false;
+			}
+			opts.astCache = argv[i];
+		} else if (arg == "--threads") {
+			if (++i == argc || atoi(argv[i]) <= 0) {
+				cerr << "--threads 需要一个正整数\n";
+				return false;
+			}
+			// parallel.cpp 的线程池第一次使用时读这个环境变量
+			setenv("SYSY_THREADS", argv[i], 1);
+		} else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3') {
+			opts.optLevel = arg[2] - '0';
+		} else if (arg.compare(0, 7, "-march=") == 0 || arg.compare(0, 6, "-mcpu=") == 0) {
+			opts.cpu = argv[i] + arg.find('=') + 1;
+		} else if (arg.compare(0, 7, "-mattr=") == 0) {
+			opts.features = arg.substr(7);
+		} else if (arg.compare(0, 15, "-fmultiversion=") == 0) {
+			istringstream list(arg.substr(15));
+			string cpu;
+			while (getline(list, cpu, ',')) {
+				if (!cpu.empty()) {
+					opts.multiversion.push_back(cpu);
+				}
+			}
+		} else if (arg == "-fsave-optimization-record") {
+			opts.remarksFormat = "yaml";
+		} else if (arg.compare(0, 27, "-fsave-optimization-record=") == 0) {
+			opts.remarksFormat = arg.substr(27);
+			if (opts.remarksFormat != "yaml" && opts.remarksFormat != "json") {
+				cerr << "-fsave-optimization-record 的格式只能是 yaml 或 json\n";
+				return false;
+			}
+		} else if (arg.compare(0, 27, "-foptimization-record-file=") == 0) {
+			opts.remarksFile = argv[i] + 27;
+		} else if (arg.compare(0, 29, "-foptimization-record-passes=") == 0) {
+			opts.remarksPasses = arg.substr(29);
+		} else if (arg == "-fremarks-summary") {
+			opts.remarksSummary = true;
+		} else if (arg == "-c") {
+			opts.compileOnly = true;
+		} else if (arg == "-v") {
+			opts.verbose = true;
+		} else if (arg == "-o") {
+			if (++i == argc) {
+				cerr << "-o 缺少文件名\n";
+				return false;
+			}
+			opts.output = argv[i];
+		} else if (arg == "-h" || arg == "--help") {
+			return false;
+		} else if (arg.size() > 1 && arg[0] == '-') {
+			cerr << "未知选项: " << arg << "\n";
+			return false;
+		} else if (arg.size() > 3 && arg.compare(arg.size() - 3, 3, ".bc") == 0) {
+			opts.libraries.push_back(arg);
+		} else if (opts.input) {
+			cerr << "只能给一个源文件，别的文件先用 -c 编译成 .bc 再一起链接\n";
+			return false;
+		} else {
+			opts.input = argv[i];
+		}
+	}
+	int emits = opts.emitAst + opts.emitDot + opts.emitLLVM;
+	if (opts.stream && (opts.emitAst || opts.emitDot || opts.soak)) {
+		cerr << "--stream 不保留语法树，不能与 --emit-ast / --emit-dot / --soak 同时使用\n";
+		return false;
+	}
+	if (opts.narrowInts && opts.optLevel == 0) {
+		cerr << "-fnarrow-ints 在优化流水线中运行，需要 -O1 以上\n";
+		return false;
+	}
+	// 给了备注文件而没给格式时按 YAML 写
+	if (opts.remarksFile && opts.remarksFormat.empty()) {
+		opts.remarksFormat = "yaml";
+	}
+	bool remarks = !opts.remarksFormat.empty() || opts.remarksSummary;
+	if (!opts.remarksPasses.empty() && !remarks) {
+		cerr << "-foptimization-record-passes 需要与 -fsave-optimization-record 或 -fremarks-summary 同时使用\n";
+		return false;
+	}
+	if (remarks && opts.optLevel == 0) {
+		cerr << "优化备注来自优化流水线，需要 -O1 以上\n";
+		return false;
+	}
+	if (opts.stream && opts.prune) {
+		cerr << "-fprune-unreachable 要看到整个文件才能判断可达性，不能与 --stream 同时使用\n";
+		return false;
+	}
+	if (opts.astCache && (opts.stream || !opts.input)) {
+		cerr << "--ast-cache 按源文件内容查找缓存，需要源文件参数，不能与 --stream 同时使用\n";
+		return false;
+	}
+	if (opts.stream && opts.memReport) {
+		cerr << "--mem-report 要在解析完成后分阶段统计，不能与 --stream 同时使用\n";
+		return false;
+	}
+	if (opts.compileOnly && (emits || opts.run || opts.soak || opts.syntaxOnly || !opts.libraries.empty())) {
+		cerr << "-c 只生成位码模块，不能与 --emit-* / --run / --soak / -fsyntax-only 或 .bc 输入同时使用\n";
+		return false;
+	}
+	if (opts.compileOnly && !opts.input && !opts.output) {
+		cerr << "从标准输入读源码时 -c 需要用 -o 指定输出文件\n";
+		return false;
+	}
+	if (!opts.input && !opts.libraries.empty() &&
+	    (opts.emitAst || opts.emitDot || opts.syntaxOnly || opts.stream || opts.astCache || opts.memReport)) {
+		cerr << "只链接 .bc 模块时没有语法树，不能使用 --emit-ast / --emit-dot / -fsyntax-only / --stream / --ast-cache / --mem-report\n";
+		return false;
+	}
+	if (opts.output && emits > 1) {
+		cerr << "-o 只能与一个 --emit-* 选项同时使用\n";
+		return false;
+	}
+	if (opts.output && opts.run && emits == 0) {
+		cerr << "-o 需要与 --emit-* 选项同时使用\n";
+		return false;
+	}
+	if (!opts.syntaxOnly && !opts.output && !opts.run && !opts.soak && !opts.compileOnly && emits == 0) {
+		// 只链接 .bc 模块时没有语法树可打印；从标准输入读源码时与给出源文件时一样
+		opts.emitAst = opts.emitDot = !opts.stream && (opts.input || opts.libraries.empty());
+		opts.emitLLVM = opts.run = true;
+		opts.verbose = true;
+	}
+	return true;
+}
+
+// 手写的分析器按需向词法分析器要 token，流式输入不用另走推模式
+static int parseInput(const Options& opts) {
+	if (!opts.bison) {
+		return rdParse();
+	}
+	return opts.stream ? streamParse() : yyparse();
+}
+
+// 把 out 指向 -o 给出的文件，没有 -o 时用 fallback（为 NULL 表示标准输出）
+static ostream *openOutput(const Options& opts, const char *fallback, ofstream& file) {
+	const char *path = opts.output ? opts.output : fallback;
+	if (!path) {
+		return &cout;
+	}
+	file.open(path);
+	if (!file.is_open()) {
+		cerr << "无法创建 " << path << " 文件。\n";
+		return NULL;
+	}
+	return &file;
+}
+
+// 没有 -o 时的输出文件：当前目录下去掉扩展名的源文件名加 suffix（-c 的 .bc、备注的 .opt.yaml）
+static string outputName(const string& input, const string& suffix) {
+	string name = input.substr(input.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.')) + suffix;
+}
+
+// 给了 -o 时的备注文件：与 clang 相同，放在输出文件旁边，去掉它的扩展名加 suffix
+static string besideOutput(const string& output, const string& suffix) {
+	size_t slash = output.find_last_of('/');
+	size_t dot = output.find_last_of('.');
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		dot = output.size();
+	}
+	return output.substr(0, dot) + suffix;
+}
+
+// 写出 -fsave-optimization-record 的备注文件，打印 -fremarks-summary 的汇总
+static bool reportRemarks(const Options& opts, const RemarkLog& remarks) {
+	if (!opts.remarksFormat.empty()) {
+		string suffix = ".opt." + opts.remarksFormat;
+		string path = opts.remarksFile ? opts.remarksFile :
+			opts.output ? besideOutput(opts.output, suffix) :
+			opts.input ? outputName(opts.input, suffix) : "remarks" + suffix;
+		ofstream file(path);
+		if (!file.is_open()) {
+			cerr << "无法创建 " << path << " 文件。\n";
+			return false;
+		}
+		if (opts.remarksFormat == "json") {
+			remarks.writeJSON(file);
+		} else {
+			remarks.writeYAML(file);
+		}
+	}
+	if (opts.remarksSummary) {
+		remarks.printSummary(cerr);
+	}
+	return true;
+}
+
+// 预热之后常驻内存最多允许增长这么多（KB），超过即认为有泄漏
+static const long SOAK_RSS_SLACK_KB = 4096;
+
+// 在同一个 JIT 会话里反复为整棵树生成代码、运行、卸载
+static int soak(int runs, JitSession& jit) {
+	int warmup = std::min(runs - 1, std::max(runs / 10, 1));
+	long baseline = 0;
+	for (int i = 0; i < runs; i++) {
+		CodeGenContext context;
+		context.verbose = false;
+		createCoreFunctions(context);
+		context.generateCode(*programCompUnit);
+		if (context.errors || !context.runCode(jit)) {
+			cerr << "soak: run " << i << " failed\n";
+			return 1;
+		}
+		if (i == warmup) {
+			baseline = residentKB();
+		}
+	}
+	long final = residentKB();
+	cerr << "soak: " << runs << " runs, RSS " << baseline << " KB after warm-up, "
+	     << final << " KB at the end\n";
+	if (final - baseline > SOAK_RSS_SLACK_KB) {
+		cerr << "soak: resident memory grew by " << final - baseline << " KB\n";
+		return 1;
+	}
+	return 0;
+}
+
+// 只需要做一次；编译服务器在 fork 出子进程之前就做好
+static void initializeLLVM() {
+	static bool initialized = false;
+	if (initialized) {
+		return;
+	}
+    // see http://comments.gmane.org/gmane.comp.compilers.llvm.devel/33877
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+	InitializeNativeTargetAsmParser();
+	initialized = true;
+}
+
+// 命令行入口，编译服务器的子进程也从这里开始处理一个请求
+int driverMain(int argc, char **argv)
 {
 	yydebug = 0;
-	if (argc > 1) {
-		open_file(argv[1]);
+	Options opts;
+	if (!parseOptions(argc, argv, opts)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (opts.lsp) {
+		return runLanguageServer();
+	}
+	if (opts.daemon) {
+		if (inCompileServer) {
+			cerr << "编译服务器内不能再启动编译服务器\n";
+			return 2;
+		}
+		initializeLLVM();
+		return runCompileServer(opts.daemon);
+	}
+	if (opts.input && !open_file(opts.input)) {
+		return 1;
+	}
+
+	if (opts.stream) {
+		keepTopLevelDecls = false;
+	}
+
+	if (opts.syntaxOnly) {
+		if (opts.stream) {
+			topLevelDeclHook = dropDecl;
+		}
+		parseInput(opts);
+		if (hasError) {
+			cout << "解析失败，存在语法错误。\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	initializeLLVM();
+	CodeGenContext context;
+	context.verbose = opts.verbose;
+	context.optLevel = opts.optLevel;
+	context.intBits = opts.int32 ? 32 : 64;
+	context.narrowInts = opts.narrowInts;
+	context.profile = opts.profile;
+	context.memoize = opts.memoize;
+	// JIT 在本机上运行，默认针对本机；目标文件可能拿到别的机器上运行，默认 generic
+	CpuTarget target{opts.cpu ? opts.cpu : (opts.run || opts.soak ? "native" : ""), opts.features};
+	if ((opts.cpu || !opts.features.empty()) && !createTargetMachine(target)) {
+		return 1;
+	}
+	context.target = target;
+	context.multiversion = opts.multiversion;
+	context.separate = opts.compileOnly || !opts.libraries.empty();
+	context.linkInputs = opts.libraries;
+	std::unique_ptr<RemarkLog> remarks;
+	if (!opts.remarksFormat.empty() || opts.remarksSummary) {
+		remarks.reset(new RemarkLog(opts.remarksPasses));
+		string error;
+		if (!remarks->valid(error)) {
+			cerr << "-foptimization-record-passes 的正则有误: " << error << "\n";
+			return 1;
+		}
+		context.remarks = remarks.get();
+	}
+	createCoreFunctions(context);
+	std::unique_ptr<MemoryReport> memory;
+	if (opts.memReport) {
+		memory.reset(new MemoryReport());
+	}
+
+	// 语法树缓存：命中时不再解析，没命中时照常解析，成功后写入缓存
+	string source, cachePath;
+	if (opts.astCache) {
+		ifstream in(opts.input, ios::binary);
+		source.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		cachePath = astCachePath(opts.astCache, source);
+		programCompUnit = loadAstCache(cachePath, source);
+		context.log() << (programCompUnit ? "语法树缓存命中: " : "语法树缓存未命中: ") << cachePath << "\n";
 	}
-	yyparse();
+	bool cached = programCompUnit != NULL;
+	// 只链接 .bc 时没有源码要解析，模块里只有内置函数，其余都来自链接
+	bool linkOnly = !opts.input && !opts.libraries.empty();
+
+	// 流水线：解析出一个顶层声明就交给代码生成线程，
+	// 使解析第 N+1 个函数与生成第 N 个函数的 IR 并行进行
+	context.log() << "Generating code...\n";
+	// 流式模式下声明生成完 IR 就释放，内存只与队列中的声明有关
+	bool release = opts.stream;
+	std::thread codegenWorker([&context, release]() {
+		DeclQueue::Item item;
+		while (declQueue.pop(item)) {
+			// 解析线程的报错和警告排在它之后归约出的声明前面，在这里按顺序打印
+			if (!item.decl) {
+				fputs(item.text.c_str(), item.stream);
+				continue;
+			}
+			context.generateDecl(*item.decl);
+			if (release) {
+				Node::deleteTree(item.decl);
+			}
+		}
+	});
+	// 裁剪时要等整棵树建好才知道哪些声明可达；统计内存时要把解析和生成分开，都不走流水线
+	if (!opts.prune && !memory && !cached) {
+		topLevelDeclHook = enqueueDecl;
+	}
+	if (cached || linkOnly) {
+		// 已经从缓存载入，或者没有源文件
+	} else {
+		// 代码生成线程在跑，解析时的诊断也交给它打印，两个线程不同时写 stdout / stderr
+		diagnosticHook = enqueueDiagnostic;
+		parseInput(opts);
+	}
+	declQueue.close();
+	codegenWorker.join();
+	diagnosticHook = NULL;
+
     if(hasError) {
         cout << "解析失败，存在语法错误。\n";
         return 1;
     }
-	// 提醒：对于新定义的 AST 节点，会将其打印为“$”
-    cout << "将语法树还原为源文件如下:\n";
-    if(programCompUnit) {
-        programCompUnit->print(); // 调用 print 方法打印 AST
-        cout << endl;
-    } else {
-        cout << "解析失败，无法还原为源文件。\n";
-    }
-	cout << programCompUnit << endl;
+	if (!programCompUnit && !linkOnly) {
+		cout << "解析失败，无法还原为源文件。\n";
+		return 1;
+	}
+	if (opts.astCache && !cached && !saveAstCache(cachePath, source, *programCompUnit)) {
+		cerr << "无法写入语法树缓存 " << cachePath << "\n";
+	}
+	if (memory) {
+		memory->lap(cached ? "load cached AST" : "lex/parse + AST");
+		memory->recordAst(*programCompUnit);
+	}
+	// 缓存命中时没有解析线程往队列里送声明，在这里统一生成
+	if (opts.prune || memory || cached) {
+		std::vector<NDecl*> decls = programCompUnit->decls;
+		if (opts.prune) {
+			// 可达性分析在扁平 AST 上做，只有它需要转换
+			decls.clear();
+			for (uint32_t i : reachableDecls(FlatAST::build(*programCompUnit))) {
+				decls.push_back(programCompUnit->decls[i]);
+			}
+			context.log() << "裁剪了 " << programCompUnit->decls.size() - decls.size()
+			              << " / " << programCompUnit->decls.size() << " 个顶层声明\n";
+		}
+		for (auto decl : decls) {
+			long long before = memory ? heapBytes() : 0;
+			context.generateDecl(*decl);
+			if (memory) {
+				memory->recordGenerated(*decl, heapBytes() - before);
+			}
+		}
+		if (memory) {
+			memory->lap("IR generation");
+		}
+	}
 
+	// 提醒：对于新定义的 AST 节点，会将其打印为“$”
+	if (opts.emitAst) {
+		ofstream file;
+		ostream *out = openOutput(opts, NULL, file);
+		if (!out) {
+			return 1;
+		}
+		context.log() << "将语法树还原为源文件如下:\n";
+		programCompUnit->print(*out);
+		*out << endl;
+	}
 
     // 生成 AST 的 DOT 文件
-    if(programCompUnit) {
-        ofstream dotFile("ast.dot");
-        if(!dotFile.is_open()) {
-            cerr << "无法创建 ast.dot 文件。\n";
-            return 1;
-        }
-        dotFile << "digraph AST {\n";
-        int currentId = 0;
-        programCompUnit->generateDot(dotFile, currentId);
-        dotFile << "}\n";
-        dotFile.close();
-        cout << "AST 已写入 ast.dot 文件。\n";
-    }
-    
-    // see http://comments.gmane.org/gmane.comp.compilers.llvm.devel/33877
-	InitializeNativeTarget();
-	InitializeNativeTargetAsmPrinter();
-	InitializeNativeTargetAsmParser();
-	CodeGenContext context;
-	createCoreFunctions(context);
-	context.generateCode(*programCompUnit);
-	context.runCode();
+	if (opts.emitDot) {
+		ofstream file;
+		ostream *out = openOutput(opts, "ast.dot", file);
+		if (!out) {
+			return 1;
+		}
+		*out << "digraph AST {\n";
+		int currentId = 0;
+		programCompUnit->generateDot(*out, currentId);
+		*out << "}\n";
+		context.log() << "AST 已写入 " << (opts.output ? opts.output : "ast.dot") << " 文件。\n";
+	}
+
+	if (memory && (opts.emitAst || opts.emitDot)) {
+		memory->lap("emit AST / DOT");
+	}
+
+	context.finishCode();
+	if (context.errors) {
+		cout << "代码生成失败。\n";
+		return 1;
+	}
+	if (memory) {
+		memory->lap(opts.optLevel > 0 ? "verify + optimize" : "verify");
+		memory->recordModule(*context.module);
+	}
+	if (remarks && !reportRemarks(opts, *remarks)) {
+		return 1;
+	}
+	if (opts.emitLLVM) {
+		if (opts.output) {
+			std::error_code ec;
+			raw_fd_ostream out(opts.output, ec, sys::fs::OF_Text);
+			if (ec) {
+				cerr << "无法创建 " << opts.output << " 文件。\n";
+				return 1;
+			}
+			context.printCode(out);
+		} else {
+			// outs() 与 cout 各有缓冲，先把前面的语法树和跟踪输出写出去
+			cout << flush;
+			context.printCode(outs());
+			outs().flush();
+		}
+	}
+	if (opts.compileOnly) {
+		if (!context.emitBitcode(opts.output ? opts.output : outputName(opts.input, ".bc"))) {
+			return 1;
+		}
+	}
+	else if (opts.output && !opts.emitAst && !opts.emitDot && !opts.emitLLVM) {
+		if (!context.emitObject(opts.output)) {
+			return 1;
+		}
+		if (memory) {
+			memory->lap("emit object");
+		}
+	}
+	if (opts.run || opts.soak) {
+		JitSession jit(opts.jitSymbols, target);
+		if (!jit.valid()) {
+			return 1;
+		}
+		if (opts.run && !context.runCode(jit)) {
+			return 1;
+		}
+		if (memory && opts.run) {
+			fflush(stdout);
+			memory->lap("JIT compile + run");
+		}
+		if (opts.soak) {
+			return soak(opts.soak, jit);
+		}
+	}
+	if (memory) {
+		memory->print(cerr);
+	}
 	
 	return 0;
 }
 
+int main(int argc, char **argv)
+{
+	return driverMain(argc, argv);
+}
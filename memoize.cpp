@@ -0,0 +1,234 @@
+// memoize.cpp
+#include "memoize.h"
+#include "codegen.h"
+#include "node.h"
+#include "parser.hpp" // 包含 token 定义
+#include <map>
+
+using namespace llvm;
+
+namespace {
+
+// 显式栈上的一项：访问节点、在当前作用域声明名字，或离开作用域
+enum class Step { Visit, Declare, Leave };
+
+struct Item {
+    Step step;
+    const Node *node;
+    const std::string *name;
+};
+
+Item visit(const Node *node) { return {Step::Visit, node, NULL}; }
+
+// 整数放进 64 位的槽里时做符号扩展，浮点按位存放
+Value *toWord(IRBuilder<>& builder, Value *value) {
+    Type *i64 = builder.getInt64Ty();
+    if (value->getType()->isDoubleTy()) {
+        return builder.CreateBitCast(value, i64);
+    }
+    return builder.CreateSExt(value, i64);
+}
+
+Value *fromWord(IRBuilder<>& builder, Value *word, Type *type) {
+    if (type->isDoubleTy()) {
+        return builder.CreateBitCast(word, type);
+    }
+    return builder.CreateTrunc(word, type);
+}
+
+} // namespace
+
+bool isPureFunction(const NFuncDecl& decl, CodeGenContext& context, bool& recursive) {
+    recursive = false;
+    if (decl.isPrototype || (decl.id.type != TINTTYPE && decl.id.type != TFLOATTYPE) ||
+        decl.arguments.empty() || decl.arguments.size() > MEMO_MAX_ARGS) {
+        return false;
+    }
+
+    // 每个名字当前可见的局部定义个数，和每层作用域里声明的名字
+    std::map<std::string, int> locals;
+    std::vector<std::vector<std::string> > scopes(1);
+    auto declare = [&](const std::string& name) {
+        scopes.back().push_back(name);
+        locals[name]++;
+    };
+    auto isLocal = [&](const std::string& name) {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second > 0;
+    };
+    for (auto argument : decl.arguments) {
+        if (argument->id.type != TINTTYPE) {
+            return false;
+        }
+        declare(argument->id.name);
+    }
+
+    std::vector<Item> work;
+    work.push_back(visit(&decl.block));
+    while (!work.empty()) {
+        Item item = work.back();
+        work.pop_back();
+        if (item.step == Step::Declare) {
+            declare(*item.name);
+            continue;
+        }
+        if (item.step == Step::Leave) {
+            for (auto& name : scopes.back()) {
+                locals[name]--;
+            }
+            scopes.pop_back();
+            continue;
+        }
+
+        const Node *node = item.node;
+        if (auto p = dynamic_cast<const NIdent*>(node)) {
+            // 不是局部变量时只能是 const 全局变量，它的值在编译期已知
+            if (!isLocal(p->name) && !context.globals.count(p->name)) {
+                return false;
+            }
+        }
+        else if (auto p = dynamic_cast<const NAssignment*>(node)) {
+            if (!isLocal(p->lhs.name)) {
+                return false;
+            }
+            work.push_back(visit(&p->rhs));
+        }
+        else if (auto p = dynamic_cast<const NMethodCall*>(node)) {
+            const std::string& callee = p->id.name;
+            if (callee == decl.id.name) {
+                recursive = true;
+            }
+            // 模块里没有的名字是向量内建函数
+            else if (!context.pureFunctions.count(callee) && context.module->getFunction(callee)) {
+                return false;
+            }
+            for (auto argument : p->arguments) {
+                work.push_back(visit(argument));
+            }
+        }
+        else if (auto p = dynamic_cast<const NBinaryExpr*>(node)) {
+            work.push_back(visit(&p->lhs));
+            work.push_back(visit(&p->rhs));
+        }
+        else if (auto p = dynamic_cast<const NLogicalBinaryExpr*>(node)) {
+            work.push_back(visit(&p->lhs));
+            work.push_back(visit(&p->rhs));
+        }
+        else if (auto p = dynamic_cast<const NUnaryExpr*>(node)) {
+            work.push_back(visit(&p->expr));
+        }
+        else if (auto p = dynamic_cast<const NLogicalUnaryExpr*>(node)) {
+            work.push_back(visit(&p->expr));
+        }
+        else if (auto p = dynamic_cast<const NBlock*>(node)) {
+            // 语句按源码顺序处理，声明之后的语句才看得到它
+            scopes.push_back(std::vector<std::string>());
+            work.push_back({Step::Leave, NULL, NULL});
+            for (size_t i = p->statements.size(); i-- > 0; ) {
+                work.push_back(visit(p->statements[i]));
+            }
+        }
+        else if (auto p = dynamic_cast<const NVarDecl*>(node)) {
+            // 初值里的同名变量还是外层的那个
+            work.push_back({Step::Declare, NULL, &p->id.name});
+            if (p->assignmentExpr) {
+                work.push_back(visit(p->assignmentExpr));
+            }
+        }
+        else if (auto p = dynamic_cast<const NExprStmt*>(node)) {
+            work.push_back(visit(&p->expression));
+        }
+        else if (auto p = dynamic_cast<const NReturnStmt*>(node)) {
+            work.push_back(visit(&p->expression));
+        }
+        else if (auto p = dynamic_cast<const NIfStmt*>(node)) {
+            work.push_back(visit(&p->condition));
+            work.push_back(visit(&p->trueBlock));
+            if (p->falseBlock) {
+                work.push_back(visit(p->falseBlock));
+            }
+        }
+        else if (auto p = dynamic_cast<const NWhileStmt*>(node)) {
+            work.push_back(visit(&p->condition));
+            work.push_back(visit(&p->block));
+        }
+        else if (dynamic_cast<const NInteger*>(node) || dynamic_cast<const NFloat*>(node) ||
+                 dynamic_cast<const NBreakStmt*>(node) || dynamic_cast<const NContinueStmt*>(node)) {
+        }
+        else {
+            // parallel for、嵌套函数等
+            return false;
+        }
+    }
+    return true;
+}
+
+void memoizeFunctions(Module& module, const std::vector<Function*>& functions) {
+    LLVMContext& context = module.getContext();
+    Type *voidType = Type::getVoidTy(context);
+    Type *i32 = Type::getInt32Ty(context);
+    Type *i64 = Type::getInt64Ty(context);
+    // 运行时的表对生成的代码是不透明的指针，每个函数一个，第一次调用时由运行时创建
+    PointerType *tableType = Type::getInt8PtrTy(context);
+    PointerType *wordsType = PointerType::getUnqual(i64);
+
+    FunctionCallee lookup = module.getOrInsertFunction("sysy_memo_lookup", i32,
+        PointerType::getUnqual(tableType), Type::getInt8PtrTy(context), i32, wordsType, wordsType);
+    FunctionCallee store = module.getOrInsertFunction("sysy_memo_store", voidType,
+        PointerType::getUnqual(tableType), wordsType, i64);
+    FunctionCallee report = module.getOrInsertFunction("sysy_memo_report", voidType);
+
+    for (Function *body : functions) {
+        FunctionType *type = body->getFunctionType();
+        unsigned arity = type->getNumParams();
+        Function *wrapper = Function::Create(type, body->getLinkage(), "", &module);
+        wrapper->takeName(body);
+        body->setName(wrapper->getName() + ".body");
+        body->setLinkage(GlobalValue::InternalLinkage);
+        // 包括函数体里的递归调用
+        body->replaceAllUsesWith(wrapper);
+        GlobalVariable *table = new GlobalVariable(module, tableType, false, GlobalValue::InternalLinkage,
+            ConstantPointerNull::get(tableType), wrapper->getName() + ".memo");
+
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", wrapper));
+        ArrayType *keyType = ArrayType::get(i64, arity);
+        Value *key = builder.CreateAlloca(keyType, NULL, "key");
+        Value *result = builder.CreateAlloca(i64, NULL, "result");
+        std::vector<Value*> args;
+        for (unsigned i = 0; i < arity; i++) {
+            Argument *arg = wrapper->getArg(i);
+            arg->setName(body->getArg(i)->getName());
+            args.push_back(arg);
+            builder.CreateStore(toWord(builder, arg), builder.CreateConstInBoundsGEP2_32(keyType, key, 0, i));
+        }
+        Value *keyStart = builder.CreateConstInBoundsGEP2_32(keyType, key, 0, 0);
+        Value *name = builder.CreateGlobalStringPtr(wrapper->getName(), "memo.name", 0, &module);
+        Value *found = builder.CreateCall(lookup, { table, name, ConstantInt::get(i32, arity), keyStart, result });
+
+        BasicBlock *hit = BasicBlock::Create(context, "hit", wrapper);
+        BasicBlock *miss = BasicBlock::Create(context, "miss", wrapper);
+        builder.CreateCondBr(builder.CreateICmpNE(found, ConstantInt::get(i32, 0)), hit, miss);
+        builder.SetInsertPoint(hit);
+        builder.CreateRet(fromWord(builder, builder.CreateLoad(i64, result), type->getReturnType()));
+        builder.SetInsertPoint(miss);
+        Value *value = builder.CreateCall(body, args);
+        builder.CreateCall(store, { table, keyStart, toWord(builder, value) });
+        builder.CreateRet(value);
+    }
+
+    // 别的模块里记忆化的函数也在 main 返回时报告，所以不管本模块有没有都插
+    Function *main = module.getFunction("main");
+    if (!main || main->isDeclaration()) {
+        return;
+    }
+    std::vector<ReturnInst*> returns;
+    for (BasicBlock& block : *main) {
+        if (ReturnInst *ret = dyn_cast_or_null<ReturnInst>(block.getTerminator())) {
+            returns.push_back(ret);
+        }
+    }
+    for (ReturnInst *ret : returns) {
+        IRBuilder<> builder(ret);
+        builder.CreateCall(report);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+
+class NFuncDecl;
+class CodeGenContext;
+namespace llvm {
+class Module;
+class Function;
+}
+
+// -fmemoize：自动记忆化纯的递归函数。
+//
+// 是否纯在语法树上判定：参数都是 int（最多 MEMO_MAX_ARGS 个），返回 int 或 float；
+// 函数体只读写参数和局部变量，可以读 const 全局变量，不含 parallel for 和嵌套函数，
+// 只调用自己、已判定为纯的函数和向量内建函数（echo、getint 等输入输出都不算）。
+// 函数只能调用在它之前声明的函数，所以按生成顺序逐个判定即可，流水线和 --stream 下也成立。
+//
+// 纯且直接递归的函数在 finishCode 时改名为 <名字>.body，原名换成包装函数：
+// 先按参数查运行时的哈希表（memort.cpp），查不到再调用函数体并记下结果。
+// 函数体里的递归调用也改指向包装函数，子问题因此只算一次。
+// main 返回前调用 sysy_memo_report，在标准错误打印各函数的命中率。
+const int MEMO_MAX_ARGS = 4;
+
+// recursive 返回函数体是否调用了自己
+bool isPureFunction(const NFuncDecl& decl, CodeGenContext& context, bool& recursive);
+void memoizeFunctions(llvm::Module& module, const std::vector<llvm::Function*>& functions);
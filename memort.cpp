@@ -0,0 +1,164 @@
+// memort.cpp: -fmemoize 的运行时，由记忆化函数的包装函数调用，见 memoize.h
+// 每个函数一张开放定址、线性探测的哈希表，条目是连续存放的参数和 64 位返回值。
+// 表按 2 的幂增长，装载因子不超过 1/2；条目数到达上限（环境变量 SYSY_MEMO_LIMIT，
+// 默认 2^20）后不再记录新结果，只继续查已有的。parallel for 里也可能调用，每张表一把锁。
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" void sysy_memo_report();
+
+namespace {
+
+struct MemoTable {
+    std::string name;
+    int arity;
+    std::mutex lock;
+    std::vector<int64_t> entries;   // capacity 个条目，每个 arity + 1 个字
+    std::vector<uint8_t> used;
+    size_t capacity = 0;
+    size_t size = 0;
+    size_t limit;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    bool full = false;
+};
+
+std::mutex registryLock;
+std::vector<MemoTable*> tables;
+
+size_t memoLimit() {
+    const char *value = getenv("SYSY_MEMO_LIMIT");
+    long long limit = value ? atoll(value) : 0;
+    return limit > 0 ? (size_t)limit : (size_t)1 << 20;
+}
+
+uint64_t hashKey(const int64_t *args, int arity) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < arity; i++) {
+        h ^= (uint64_t)args[i];
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 31;
+    }
+    return h;
+}
+
+// 键所在的条目，或者应该放进去的空位
+size_t probe(const MemoTable& table, const int64_t *args) {
+    size_t mask = table.capacity - 1;
+    size_t stride = table.arity + 1;
+    for (size_t i = hashKey(args, table.arity) & mask; ; i = (i + 1) & mask) {
+        if (!table.used[i] || std::equal(args, args + table.arity, &table.entries[i * stride])) {
+            return i;
+        }
+    }
+}
+
+void grow(MemoTable& table) {
+    size_t stride = table.arity + 1;
+    std::vector<int64_t> entries;
+    std::vector<uint8_t> used;
+    entries.swap(table.entries);
+    used.swap(table.used);
+    size_t old = table.capacity;
+    table.capacity = old ? old * 2 : 64;
+    table.entries.assign(table.capacity * stride, 0);
+    table.used.assign(table.capacity, 0);
+    for (size_t i = 0; i < old; i++) {
+        if (used[i]) {
+            size_t j = probe(table, &entries[i * stride]);
+            std::copy(&entries[i * stride], &entries[i * stride] + stride, &table.entries[j * stride]);
+            table.used[j] = 1;
+        }
+    }
+}
+
+// 第一次调用时建表并登记，之后直接从包装函数的全局变量里取
+MemoTable *tableFor(MemoTable **slot, const char *name, int arity) {
+    MemoTable *table = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (table) {
+        return table;
+    }
+    std::lock_guard<std::mutex> guard(registryLock);
+    table = *slot;
+    if (!table) {
+        table = new MemoTable();
+        table->name = name;
+        table->arity = arity;
+        table->limit = memoLimit();
+        // main 所在的模块没有加 -fmemoize 时，退出前也要报告
+        static bool registered = false;
+        if (!registered) {
+            atexit(sysy_memo_report);
+            registered = true;
+        }
+        tables.push_back(table);
+        __atomic_store_n(slot, table, __ATOMIC_RELEASE);
+    }
+    return table;
+}
+
+} // namespace
+
+extern "C" {
+
+int sysy_memo_lookup(MemoTable **slot, const char *name, int arity, const int64_t *args, int64_t *result) {
+    MemoTable *table = tableFor(slot, name, arity);
+    std::lock_guard<std::mutex> guard(table->lock);
+    if (table->capacity) {
+        size_t i = probe(*table, args);
+        if (table->used[i]) {
+            *result = table->entries[i * (arity + 1) + arity];
+            table->hits++;
+            return 1;
+        }
+    }
+    table->misses++;
+    return 0;
+}
+
+void sysy_memo_store(MemoTable **slot, const int64_t *args, int64_t result) {
+    MemoTable *table = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    std::lock_guard<std::mutex> guard(table->lock);
+    if (table->size >= table->limit) {
+        table->full = true;
+        return;
+    }
+    if ((table->size + 1) * 2 > table->capacity) {
+        grow(*table);
+    }
+    size_t stride = table->arity + 1;
+    size_t i = probe(*table, args);
+    // 并行时两个线程可能先后算出同一个键，结果相同，覆盖即可
+    if (!table->used[i]) {
+        table->used[i] = 1;
+        table->size++;
+    }
+    std::copy(args, args + table->arity, &table->entries[i * stride]);
+    table->entries[i * stride + table->arity] = result;
+}
+
+// 打印后释放所有表：JIT 模块卸载以后表里的函数名和槽位都不再有效
+void sysy_memo_report() {
+    std::lock_guard<std::mutex> guard(registryLock);
+    if (tables.empty()) {
+        return;
+    }
+    FILE *out = stderr;
+    fprintf(out, "\n记忆化:\n");
+    fprintf(out, "%14s %14s %8s %10s  %s\n", "hits", "misses", "hit%", "entries", "name");
+    for (MemoTable *table : tables) {
+        uint64_t calls = table->hits + table->misses;
+        fprintf(out, "%14llu %14llu %7.2f%% %10zu  %s%s\n", (unsigned long long)table->hits,
+                (unsigned long long)table->misses, calls ? 100.0 * table->hits / calls : 0.0,
+                table->size, table->name.c_str(), table->full ? "（已满，之后的结果没有记录）" : "");
+        delete table;
+    }
+    tables.clear();
+}
+
+}
@@ -0,0 +1,241 @@
+// memstats.cpp
+#include "memstats.h"
+#include "node.h"
+#include <algorithm>
+#include <cstdio>
+#include <cxxabi.h>
+#include <fstream>
+#include <iomanip>
+#include <malloc.h>
+#include <typeinfo>
+#include <unistd.h>
+#include <llvm/IR/Module.h>
+
+long residentKB() {
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+long long heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (long long)(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    // 老的 mallinfo 是 int，超过 2GB 会回绕
+    struct mallinfo info = mallinfo();
+    return (long long)(unsigned)info.uordblks + (unsigned)info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// /proc/self/status 里的 VmHWM（峰值 RSS），单位 KB
+static long peakResidentKB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+static void resetPeakResident() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+}
+
+MemoryReport::MemoryReport() {
+    resetPeakResident();
+    lastHeap = heapBytes();
+}
+
+void MemoryReport::lap(const std::string& phase) {
+    long long heap = heapBytes();
+    phases.push_back({phase, heap - lastHeap, heap, residentKB(), peakResidentKB()});
+    resetPeakResident();
+    // 统计本身的分配不算进下一个阶段
+    lastHeap = heapBytes();
+}
+
+// 节点自身按 malloc 实际给的块大小算，再加上它独占的字符串和数组
+void MemoryReport::recordAst(const NCompUnit& unit) {
+    std::vector<const Node*> work;
+    work.push_back(&unit);
+    while (!work.empty()) {
+        const Node *node = work.back();
+        work.pop_back();
+        size_t bytes = malloc_usable_size(const_cast<Node*>(node));
+
+        if (auto p = dynamic_cast<const NIdent*>(node)) {
+            if (p->name.capacity() > std::string().capacity()) {
+                bytes += p->name.capacity() + 1;
+            }
+        }
+        else if (auto p = dynamic_cast<const NMethodCall*>(node)) {
+            bytes += p->arguments.capacity() * sizeof(NExpr*);
+            work.push_back(&p->id);
+            work.insert(work.end(), p->arguments.begin(), p->arguments.end());
+        }
+        else if (auto p = dynamic_cast<const NBinaryExpr*>(node)) {
+            work.push_back(&p->lhs);
+            work.push_back(&p->rhs);
+        }
+        else if (auto p = dynamic_cast<const NLogicalBinaryExpr*>(node)) {
+            work.push_back(&p->lhs);
+            work.push_back(&p->rhs);
+        }
+        else if (auto p = dynamic_cast<const NUnaryExpr*>(node)) {
+            work.push_back(&p->expr);
+        }
+        else if (auto p = dynamic_cast<const NLogicalUnaryExpr*>(node)) {
+            work.push_back(&p->expr);
+        }
+        else if (auto p = dynamic_cast<const NAssignment*>(node)) {
+            work.push_back(&p->lhs);
+            work.push_back(&p->rhs);
+        }
+        else if (auto p = dynamic_cast<const NBlock*>(node)) {
+            bytes += p->statements.capacity() * sizeof(NStmt*);
+            work.insert(work.end(), p->statements.begin(), p->statements.end());
+        }
+        else if (auto p = dynamic_cast<const NExprStmt*>(node)) {
+            work.push_back(&p->expression);
+        }
+        else if (auto p = dynamic_cast<const NReturnStmt*>(node)) {
+            work.push_back(&p->expression);
+        }
+        else if (auto p = dynamic_cast<const NIfStmt*>(node)) {
+            work.push_back(&p->condition);
+            work.push_back(&p->trueBlock);
+            if (p->falseBlock) {
+                work.push_back(p->falseBlock);
+            }
+        }
+        else if (auto p = dynamic_cast<const NWhileStmt*>(node)) {
+            bytes += p->pragmas.capacity() * sizeof(std::string);
+            for (const std::string& pragma : p->pragmas) {
+                bytes += pragma.capacity() > std::string().capacity() ? pragma.capacity() + 1 : 0;
+            }
+            work.push_back(&p->condition);
+            work.push_back(&p->block);
+        }
+        else if (auto p = dynamic_cast<const NParallelFor*>(node)) {
+            bytes += p->reductions.capacity() * sizeof(Reduction);
+            for (auto& reduction : p->reductions) {
+                bytes += reduction.name.capacity() > std::string().capacity() ? reduction.name.capacity() + 1 : 0;
+            }
+            work.push_back(&p->init);
+            work.push_back(&p->condition);
+            work.push_back(&p->step);
+            work.push_back(&p->block);
+        }
+        else if (auto p = dynamic_cast<const NVarDecl*>(node)) {
+            work.push_back(&p->id);
+            if (p->assignmentExpr) {
+                work.push_back(p->assignmentExpr);
+            }
+        }
+        else if (auto p = dynamic_cast<const NFuncDecl*>(node)) {
+            bytes += p->arguments.capacity() * sizeof(NVarDecl*);
+            work.push_back(&p->id);
+            work.insert(work.end(), p->arguments.begin(), p->arguments.end());
+            work.push_back(&p->block);
+        }
+        else if (auto p = dynamic_cast<const NCompUnit*>(node)) {
+            bytes += p->decls.capacity() * sizeof(NDecl*);
+            work.insert(work.end(), p->decls.begin(), p->decls.end());
+        }
+
+        int status = 0;
+        const char *mangled = typeid(*node).name();
+        char *demangled = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+        NodeClass& stats = nodes[status == 0 ? demangled : mangled];
+        free(demangled);
+        stats.count++;
+        stats.bytes += bytes;
+    }
+}
+
+void MemoryReport::recordGenerated(const NDecl& decl, long long bytes) {
+    if (auto p = dynamic_cast<const NFuncDecl*>(&decl)) {
+        functions[p->id.name].generated += bytes;
+    }
+    else if (dynamic_cast<const NVarDecl*>(&decl)) {
+        functions["(globals)"].generated += bytes;
+    }
+}
+
+void MemoryReport::recordModule(const llvm::Module& module) {
+    for (const llvm::Function& function : module) {
+        if (function.isDeclaration()) {
+            continue;
+        }
+        FunctionIR& stats = functions[function.getName().str()];
+        stats.blocks = function.size();
+        stats.instructions = function.getInstructionCount();
+    }
+}
+
+static std::string kb(long long bytes) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", bytes / 1024.0);
+    return text;
+}
+
+void MemoryReport::print(std::ostream& out) const {
+    out << "memory report\n";
+    out << std::left << std::setw(24) << "phase" << std::right
+        << std::setw(14) << "heap +KB" << std::setw(12) << "heap KB"
+        << std::setw(10) << "RSS KB" << std::setw(12) << "peak RSS KB" << "\n";
+    for (const Phase& phase : phases) {
+        out << std::left << std::setw(24) << phase.name << std::right
+            << std::setw(14) << kb(phase.heapDelta) << std::setw(12) << kb(phase.heap)
+            << std::setw(10) << phase.rssKB << std::setw(12) << phase.peakKB << "\n";
+    }
+
+    if (!nodes.empty()) {
+        std::vector<std::pair<std::string, NodeClass>> sorted(nodes.begin(), nodes.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, NodeClass>& a,
+                                                   const std::pair<std::string, NodeClass>& b) {
+            return a.second.bytes > b.second.bytes;
+        });
+        size_t count = 0, bytes = 0;
+        for (auto& entry : sorted) {
+            count += entry.second.count;
+            bytes += entry.second.bytes;
+        }
+        out << "\nAST: " << count << " nodes, " << kb(bytes) << " KB\n";
+        out << std::left << std::setw(24) << "class" << std::right
+            << std::setw(14) << "nodes" << std::setw(12) << "KB" << std::setw(10) << "B/node" << "\n";
+        for (auto& entry : sorted) {
+            out << std::left << std::setw(24) << entry.first << std::right
+                << std::setw(14) << entry.second.count << std::setw(12) << kb(entry.second.bytes)
+                << std::setw(10) << entry.second.bytes / entry.second.count << "\n";
+        }
+    }
+
+    if (!functions.empty()) {
+        std::vector<std::pair<std::string, FunctionIR>> sorted(functions.begin(), functions.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, FunctionIR>& a,
+                                                   const std::pair<std::string, FunctionIR>& b) {
+            return a.second.generated > b.second.generated;
+        });
+        out << "\nIR by function (generated = heap used by codegen, blocks / insts after optimization)\n";
+        out << std::left << std::setw(24) << "function" << std::right
+            << std::setw(14) << "generated KB" << std::setw(12) << "blocks" << std::setw(10) << "insts" << "\n";
+        for (auto& entry : sorted) {
+            out << std::left << std::setw(24) << entry.first << std::right
+                << std::setw(14) << kb(entry.second.generated) << std::setw(12) << entry.second.blocks
+                << std::setw(10) << entry.second.instructions << "\n";
+        }
+    }
+}
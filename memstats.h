@@ -0,0 +1,57 @@
+#pragma once
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+class NCompUnit;
+class NDecl;
+namespace llvm {
+class Module;
+}
+
+// 当前进程的常驻内存，单位 KB
+long residentKB();
+// malloc 当前分配出去的字节数（mallinfo2，包含所有 arena 和 mmap 的大块）
+long long heapBytes();
+
+// --mem-report：按编译阶段统计内存。lap() 结束从上一次 lap 到现在的阶段，
+// 记下堆的净增量、阶段结束时的 RSS 和阶段内的峰值 RSS（每个阶段开始时
+// 写 /proc/self/clear_refs 重置 VmHWM，内核不支持时退化为进程的峰值）。
+// 另外按节点类统计语法树的个数和字节数，按函数统计 IR 的大小，
+// 最后由 print 一并输出到标准错误
+class MemoryReport {
+public:
+    MemoryReport();
+
+    void lap(const std::string& phase);
+    // 整棵语法树建好后调用
+    void recordAst(const NCompUnit& unit);
+    // 为一个顶层声明生成 IR 用掉的堆内存
+    void recordGenerated(const NDecl& decl, long long bytes);
+    // 模块定稿（优化之后、交给 JIT 之前）调用
+    void recordModule(const llvm::Module& module);
+    void print(std::ostream& out) const;
+
+private:
+    struct Phase {
+        std::string name;
+        long long heapDelta;
+        long long heap;
+        long rssKB;
+        long peakKB;
+    };
+    struct NodeClass {
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+    struct FunctionIR {
+        long long generated = 0;   // 生成时的堆增量
+        size_t blocks = 0;
+        size_t instructions = 0;
+    };
+    long long lastHeap;
+    std::vector<Phase> phases;
+    std::map<std::string, NodeClass> nodes;
+    std::map<std::string, FunctionIR> functions;
+};
@@ -0,0 +1,193 @@
+// multiversion.cpp
+#include "multiversion.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/X86TargetParser.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+using namespace llvm;
+
+// native.cpp：运行时能否检查这个特性
+extern "C" int sysy_cpu_feature_known(const char *name);
+
+namespace {
+
+// 只看从入口可达的块里的回边。代码生成在 return 之后留下的不可达块会跳回前面的块，
+// 不是循环，先删掉，也免得克隆它们
+bool hasLoop(Function& function) {
+    removeUnreachableBlocks(function);
+    SmallVector<std::pair<const BasicBlock*, const BasicBlock*>, 8> backedges;
+    FindFunctionBackedges(function, backedges);
+    return !backedges.empty();
+}
+
+struct Variant {
+    std::string name;                   // 命令行上的 CPU 名，用作克隆的后缀
+    std::string cpu;                    // 展开 native 后的 CPU 名和特性串，写进克隆的函数属性
+    std::string targetFeatures;
+    std::vector<std::string> features;  // 运行时要检查的特性
+};
+
+// target 的指令集特性：CPU 自带的（X86TargetParser 给出，不含只影响调优的特性），
+// 再按特性串加上 +特性、去掉 -特性。generic 按 x86-64 算。CPU 名不认识时返回 false。
+// cpu 和 string 是展开 native 后的 CPU 名和特性串
+bool isaFeatures(const CpuTarget& target, std::set<std::string>& features, std::string& cpu, std::string& string) {
+    resolveCpuTarget(target, cpu, string);
+    std::string arch = cpu;
+    if (arch == "generic") {
+        arch = "x86-64";
+    }
+    if (X86::parseArchX86(arch) == X86::CK_None) {
+        return false;
+    }
+    SmallVector<StringRef, 32> implied;
+    X86::getFeaturesForCPU(arch, implied);
+    for (StringRef feature : implied) {
+        features.insert(feature.str());
+    }
+    SubtargetFeatures flags(string);
+    for (const std::string& flag : flags.getFeatures()) {
+        if (flag[0] == '-') {
+            features.erase(flag.substr(1));
+        } else {
+            features.insert(flag[0] == '+' ? flag.substr(1) : flag);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool multiversionFunctions(Module& module, const std::vector<std::string>& cpus, const CpuTarget& base) {
+    if (!Triple(sys::getDefaultTargetTriple()).isX86()) {
+        std::cerr << "warning: -fmultiversion 只支持 x86，已忽略" << std::endl;
+        return true;
+    }
+    std::set<std::string> assumed;
+    std::string baseCpu, baseFeatures;
+    if (!isaFeatures(base, assumed, baseCpu, baseFeatures)) {
+        std::cerr << "-fmultiversion: 不认识默认版本的 CPU " << base.cpu << std::endl;
+        return false;
+    }
+    std::vector<Variant> variants;
+    for (const std::string& cpu : cpus) {
+        std::set<std::string> features;
+        Variant variant{cpu, "", "", {}};
+        if (!isaFeatures(CpuTarget{cpu, base.features}, features, variant.cpu, variant.targetFeatures)) {
+            std::cerr << "-fmultiversion: 不认识的 CPU " << cpu << std::endl;
+            return false;
+        }
+        // 默认版本已经假定了的特性不必再查，其余的每一个都要在运行时确认
+        for (const std::string& feature : features) {
+            if (assumed.count(feature)) {
+                continue;
+            }
+            if (!sysy_cpu_feature_known(feature.c_str())) {
+                std::cerr << "-fmultiversion: " << cpu << " 需要的特性 " << feature
+                          << " 无法在运行时检查，不能为它生成版本" << std::endl;
+                return false;
+            }
+            variant.features.push_back(feature);
+        }
+        variants.push_back(variant);
+    }
+
+    std::vector<Function*> hot;
+    for (Function& function : module) {
+        if (!function.isDeclaration() && hasLoop(function)) {
+            hot.push_back(&function);
+        }
+    }
+
+    LLVMContext& context = module.getContext();
+    FunctionCallee supports = module.getOrInsertFunction("sysy_cpu_supports",
+        Type::getInt32Ty(context), Type::getInt8PtrTy(context));
+    std::map<std::string, Constant*> featureNames;
+    IRBuilder<> builder(context);
+    // 分派函数可能同时在 parallel for 的多个线程里第一次被调用，缓存的函数指针按原子变量读写；
+    // 各线程选出的版本相同，monotonic 就够了
+    Align pointerAlign = module.getDataLayout().getPointerABIAlignment(0);
+
+    for (Function *function : hot) {
+        std::string name = function->getName().str();
+        GlobalValue::LinkageTypes linkage = function->getLinkage();
+
+        std::vector<Function*> versions;
+        for (const Variant& variant : variants) {
+            ValueToValueMapTy map;
+            Function *clone = CloneFunction(function, map);
+            clone->setName(name + "." + variant.name);
+            clone->setLinkage(GlobalValue::InternalLinkage);
+            clone->addFnAttr("target-cpu", variant.cpu);
+            if (!variant.targetFeatures.empty()) {
+                clone->addFnAttr("target-features", variant.targetFeatures);
+            }
+            versions.push_back(clone);
+        }
+        ValueToValueMapTy map;
+        Function *fallback = CloneFunction(function, map);
+        fallback->setName(name + ".default");
+        fallback->setLinkage(GlobalValue::InternalLinkage);
+
+        // 原函数只留下分派：函数指针为空时先选版本
+        function->deleteBody();
+        function->setLinkage(linkage);
+        PointerType *pointerType = function->getType();
+        GlobalVariable *impl = new GlobalVariable(module, pointerType, false, GlobalValue::InternalLinkage,
+            ConstantPointerNull::get(pointerType), name + ".impl");
+        impl->setAlignment(pointerAlign);
+
+        BasicBlock *entry = BasicBlock::Create(context, "entry", function);
+        BasicBlock *resolve = BasicBlock::Create(context, "resolve", function);
+        BasicBlock *call = BasicBlock::Create(context, "call", function);
+
+        builder.SetInsertPoint(entry);
+        LoadInst *cached = builder.CreateAlignedLoad(pointerType, impl, pointerAlign, "impl");
+        cached->setAtomic(AtomicOrdering::Monotonic);
+        builder.CreateCondBr(builder.CreateIsNotNull(cached), call, resolve);
+
+        // 从后往前套 select，排在前面的版本优先
+        builder.SetInsertPoint(resolve);
+        Value *chosen = fallback;
+        for (size_t i = variants.size(); i-- > 0; ) {
+            Value *usable = builder.getTrue();
+            for (const std::string& feature : variants[i].features) {
+                Constant *&string = featureNames[feature];
+                if (!string) {
+                    string = builder.CreateGlobalStringPtr(feature, "cpu.feature");
+                }
+                Value *has = builder.CreateIsNotNull(builder.CreateCall(supports, string));
+                usable = builder.CreateAnd(usable, has);
+            }
+            chosen = builder.CreateSelect(usable, versions[i], chosen);
+        }
+        builder.CreateAlignedStore(chosen, impl, pointerAlign)->setAtomic(AtomicOrdering::Monotonic);
+        builder.CreateBr(call);
+
+        builder.SetInsertPoint(call);
+        PHINode *target = builder.CreatePHI(pointerType, 2, "version");
+        target->addIncoming(cached, entry);
+        target->addIncoming(chosen, resolve);
+        std::vector<Value*> args;
+        for (Argument& arg : function->args()) {
+            args.push_back(&arg);
+        }
+        CallInst *result = builder.CreateCall(function->getFunctionType(), target, args);
+        result->setTailCall();
+        if (function->getReturnType()->isVoidTy()) {
+            builder.CreateRetVoid();
+        } else {
+            builder.CreateRet(result);
+        }
+    }
+    return true;
+}
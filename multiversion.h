@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "target.h"
+
+namespace llvm {
+class Module;
+}
+
+// -fmultiversion=<cpu>,...：含循环的函数按列出的每个 CPU 各克隆一份（函数属性
+// target-cpu 让优化和指令选择针对那个 CPU），另留一份按 base 生成的默认版本。
+// 原函数变成分派函数：第一次调用时用运行时的 sysy_cpu_supports（native.cpp）
+// 检查各版本需要的特性，选中排在最前且可用的版本，之后经函数指针直接跳转。
+// 每个版本要检查的特性是它的 CPU 比默认版本多出的全部指令集特性；有不认识的 CPU，
+// 或有运行时查不到的特性时打印原因并返回 false。只支持 x86，其他目标打印警告后什么也不做。
+bool multiversionFunctions(llvm::Module& module, const std::vector<std::string>& cpus, const CpuTarget& base);
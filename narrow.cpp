@@ -0,0 +1,122 @@
+// narrow.cpp
+#include "narrow.h"
+#include <llvm/Analysis/LazyValueInfo.h>
+#include <llvm/IR/ConstantRange.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// 一条可以收窄的指令和选定的位宽
+struct Narrowing {
+    Instruction *inst;
+    unsigned bits;
+};
+
+bool isNarrowable(const Instruction& inst) {
+    switch (inst.getOpcode()) {
+        case Instruction::Add:
+        case Instruction::Sub:
+        case Instruction::Mul:
+        case Instruction::SDiv:
+        case Instruction::SRem:
+        case Instruction::And:
+        case Instruction::Or:
+        case Instruction::Xor:
+        case Instruction::ICmp:
+            return true;
+    }
+    return false;
+}
+
+// 能装下 range 中所有有符号值的最窄位宽，装不下时返回 0
+unsigned signedBitsFor(const ConstantRange& range) {
+    if (range.isEmptySet()) {
+        return 0;
+    }
+    unsigned bits = range.getMinSignedBits();
+    for (unsigned width : { 8u, 16u, 32u }) {
+        if (bits <= width) {
+            return width;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+PreservedAnalyses NarrowIntegersPass::run(Function& function, FunctionAnalysisManager& analyses) {
+    LazyValueInfo& lvi = analyses.getResult<LazyValueAnalysis>(function);
+
+    // 先求出全部范围再改写，改写时不会看到 LVI 的过期缓存
+    std::vector<Narrowing> work;
+    for (BasicBlock& block : function) {
+        for (Instruction& inst : block) {
+            if (!isNarrowable(inst) || !inst.getOperand(0)->getType()->isIntegerTy()) {
+                continue;
+            }
+            unsigned width = inst.getOperand(0)->getType()->getIntegerBitWidth();
+            unsigned bits = 8;
+            // 操作数都装得下才能截断；算术运算的结果也要装得下，窄类型上才不会溢出
+            for (Value *operand : inst.operands()) {
+                unsigned need = signedBitsFor(lvi.getConstantRange(operand, &inst, false));
+                if (need == 0) {
+                    bits = 0;
+                    break;
+                }
+                bits = std::max(bits, need);
+            }
+            if (bits != 0 && !isa<ICmpInst>(inst)) {
+                unsigned need = signedBitsFor(lvi.getConstantRange(&inst, inst.getNextNode(), false));
+                bits = need == 0 ? 0 : std::max(bits, need);
+            }
+            // 窄类型的最小值除以 -1 会溢出（x86 上直接陷入），被除数可能取到它时再放宽一档
+            if (bits != 0 && bits < width &&
+                (inst.getOpcode() == Instruction::SDiv || inst.getOpcode() == Instruction::SRem)) {
+                ConstantRange dividend = lvi.getConstantRange(inst.getOperand(0), &inst, false);
+                if (dividend.contains(APInt::getSignedMinValue(bits).sext(width))) {
+                    bits *= 2;
+                }
+            }
+            if (bits != 0 && bits < width) {
+                work.push_back({&inst, bits});
+            }
+        }
+    }
+    if (work.empty()) {
+        return PreservedAnalyses::all();
+    }
+
+    for (Narrowing& narrowing : work) {
+        Instruction *inst = narrowing.inst;
+        IRBuilder<> builder(inst);
+        Type *narrow = builder.getIntNTy(narrowing.bits);
+        Value *lhs = builder.CreateTrunc(inst->getOperand(0), narrow);
+        Value *rhs = builder.CreateTrunc(inst->getOperand(1), narrow);
+        Value *replacement;
+        if (ICmpInst *cmp = dyn_cast<ICmpInst>(inst)) {
+            // 符号扩展保持有符号和无符号两种顺序，比较谓词不变
+            replacement = builder.CreateICmp(cmp->getPredicate(), lhs, rhs);
+        }
+        else {
+            Value *value = builder.CreateBinOp(static_cast<Instruction::BinaryOps>(inst->getOpcode()), lhs, rhs);
+            // 结果范围装得下，窄类型上的加减乘不会有符号溢出
+            if (Instruction *op = dyn_cast<Instruction>(value)) {
+                if (isa<OverflowingBinaryOperator>(op)) {
+                    op->setHasNoSignedWrap(true);
+                }
+            }
+            replacement = builder.CreateSExt(value, inst->getType());
+        }
+        replacement->takeName(inst);
+        inst->replaceAllUsesWith(replacement);
+        inst->eraseFromParent();
+    }
+
+    PreservedAnalyses preserved;
+    preserved.preserveSet<CFGAnalyses>();
+    return preserved;
+}
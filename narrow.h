@@ -0,0 +1,10 @@
+#pragma once
+#include <llvm/IR/PassManager.h>
+
+// 整数收窄（-fnarrow-ints）：用 LazyValueInfo 求出整数运算的操作数和结果的取值范围，
+// 能放进 i8 / i16 / i32 的就改在窄类型上做，再符号扩展回原来的类型。
+// 放在向量化之前，InstCombine 消掉多余的扩展和截断后，
+// 同样宽度的向量寄存器能装下更多元素。
+struct NarrowIntegersPass : llvm::PassInfoMixin<NarrowIntegersPass> {
+    llvm::PreservedAnalyses run(llvm::Function& function, llvm::FunctionAnalysisManager& analyses);
+};
@@ -1,7 +1,88 @@
 #include <cstdio>
+#include <cstring>
 
 extern "C"
 void printi(long long val)
 {
     printf("%lld\n", val);
 }
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+// __builtin_cpu_supports 不认识的特性直接查 cpuid：叶、子叶、寄存器（0..3 为 eax..edx）和位。
+// cpuid 不管操作系统是否开启了 YMM / ZMM 状态；avxvnni、avx512fp16 这样的特性总与
+// avx2 / avx512f 一起要求，后两者由 __builtin_cpu_supports 连同操作系统的支持一起检查
+struct CpuidFeature {
+    const char *name;
+    unsigned leaf, subleaf, reg, bit;
+};
+
+static const CpuidFeature cpuidFeatures[] = {
+    {"x87", 1, 0, 3, 0},         {"cx8", 1, 0, 3, 8},          {"fxsr", 1, 0, 3, 24},
+    {"cx16", 1, 0, 2, 13},       {"movbe", 1, 0, 2, 22},       {"xsave", 1, 0, 2, 26},
+    {"f16c", 1, 0, 2, 29},       {"rdrnd", 1, 0, 2, 30},       {"crc32", 1, 0, 2, 20},
+    {"fsgsbase", 7, 0, 1, 0},    {"sgx", 7, 0, 1, 2},          {"invpcid", 7, 0, 1, 10},
+    {"rdseed", 7, 0, 1, 18},     {"adx", 7, 0, 1, 19},         {"clflushopt", 7, 0, 1, 23},
+    {"clwb", 7, 0, 1, 24},       {"sha", 7, 0, 1, 29},         {"pku", 7, 0, 2, 3},
+    {"waitpkg", 7, 0, 2, 5},     {"shstk", 7, 0, 2, 7},        {"vaes", 7, 0, 2, 9},
+    {"rdpid", 7, 0, 2, 22},      {"cldemote", 7, 0, 2, 25},    {"movdiri", 7, 0, 2, 27},
+    {"movdir64b", 7, 0, 2, 28},  {"enqcmd", 7, 0, 2, 29},      {"uintr", 7, 0, 3, 5},
+    {"serialize", 7, 0, 3, 14},  {"tsxldtrk", 7, 0, 3, 16},    {"pconfig", 7, 0, 3, 18},
+    {"avx512fp16", 7, 0, 3, 23}, {"amx-bf16", 7, 0, 3, 22},    {"amx-tile", 7, 0, 3, 24},
+    {"amx-int8", 7, 0, 3, 25},   {"avxvnni", 7, 1, 0, 4},      {"xsaveopt", 0xd, 1, 0, 0},
+    {"xsavec", 0xd, 1, 0, 1},    {"xsaves", 0xd, 1, 0, 3},     {"ptwrite", 0x14, 0, 1, 4},
+    {"sahf", 0x80000001, 0, 2, 0},   {"lzcnt", 0x80000001, 0, 2, 5},   {"prfchw", 0x80000001, 0, 2, 8},
+    {"mwaitx", 0x80000001, 0, 2, 29}, {"64bit", 0x80000001, 0, 3, 29},  {"clzero", 0x80000008, 0, 1, 0},
+    {"wbnoinvd", 0x80000008, 0, 1, 9},
+};
+
+// 查 name 的支持情况；known 置为能否检查这个特性，不能检查时返回 0
+static int cpuSupports(const char *name, int *known) {
+    *known = 1;
+    __builtin_cpu_init();
+#define FEATURE(f) if (strcmp(name, f) == 0) return __builtin_cpu_supports(f) != 0;
+    FEATURE("cmov") FEATURE("mmx") FEATURE("popcnt") FEATURE("sse") FEATURE("sse2") FEATURE("sse3")
+    FEATURE("ssse3") FEATURE("sse4.1") FEATURE("sse4.2") FEATURE("avx") FEATURE("avx2") FEATURE("sse4a")
+    FEATURE("fma4") FEATURE("xop") FEATURE("fma") FEATURE("bmi") FEATURE("bmi2") FEATURE("aes")
+    FEATURE("pclmul") FEATURE("avx512f") FEATURE("avx512vl") FEATURE("avx512bw") FEATURE("avx512dq")
+    FEATURE("avx512cd") FEATURE("avx512er") FEATURE("avx512pf") FEATURE("avx512vbmi") FEATURE("avx512ifma")
+    FEATURE("avx512vpopcntdq") FEATURE("avx512vbmi2") FEATURE("gfni") FEATURE("vpclmulqdq")
+    FEATURE("avx512vnni") FEATURE("avx512bitalg") FEATURE("avx512bf16") FEATURE("avx512vp2intersect")
+#undef FEATURE
+    for (const CpuidFeature& feature : cpuidFeatures) {
+        if (strcmp(name, feature.name) == 0) {
+            unsigned regs[4];
+            if (!__get_cpuid_count(feature.leaf, feature.subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+                return 0;
+            }
+            return (regs[feature.reg] >> feature.bit) & 1;
+        }
+    }
+    *known = 0;
+    return 0;
+}
+#else
+static int cpuSupports(const char *name, int *known) {
+    *known = 0;
+    return 0;
+}
+#endif
+
+// -fmultiversion 生成的分派函数用它检查 CPU 特性，name 是 LLVM 的特性名。
+// 不认识的特性按不支持处理，需要它的版本不会被选中
+extern "C"
+int sysy_cpu_supports(const char *name)
+{
+    int known;
+    return cpuSupports(name, &known);
+}
+
+// 编译器生成分派函数前用它确认每个要检查的特性在运行时都查得到
+extern "C"
+int sysy_cpu_feature_known(const char *name)
+{
+    int known;
+    cpuSupports(name, &known);
+    return known;
+}
@@ -1,185 +1,210 @@
 // node.cpp
 #include "node.h"
 #include "parser.hpp" // 包含 token 定义
+#include <cstdlib>
 #include <fstream>
 #include <map>
+#include <sstream>
 #include <typeinfo>  // 包含 typeid 的头文件
 
+// 把节点登记的片段逆序压栈，使之按登记顺序出栈
+template <typename Item, typename Work>
+static void pushReversed(const std::vector<Item>& items, Work& work) {
+    for (size_t i = items.size(); i-- > 0; ) {
+        work.push_back(items[i]);
+    }
+}
 
+// print 的入口：显式栈代替递归
+void Node::print(std::ostream& out, int indent) const {
+    std::vector<PrintParts::Item> work;
+    work.push_back({this, indent, std::string()});
+    while (!work.empty()) {
+        PrintParts::Item item = work.back();
+        work.pop_back();
+        if (item.node == NULL) {
+            out << item.text;
+            continue;
+        }
+        PrintParts parts;
+        item.node->printParts(item.indent, parts);
+        pushReversed(parts.items, work);
+    }
+}
 
-void Node::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "$";
+void Node::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("$");
 }
 
-void NCompUnit::print(int indent) const {
+void NCompUnit::printParts(int indent, PrintParts& parts) const {
     for(auto decl : decls) {
-        decl->print(indent);
-        std::cout << "\n";
+        parts.child(*decl, indent);
+        parts.text("\n");
     }
 }
 
 // NInteger 的 print 实现
-void NInteger::print(int indent) const {
-    std::cout << value;
+void NInteger::printParts(int indent, PrintParts& parts) const {
+    std::ostringstream out;
+    out << value;
+    parts.text(out.str());
 }
 
 // NDouble 的 print 实现
-void NFloat::print(int indent) const {
-    std::cout << value;
+void NFloat::printParts(int indent, PrintParts& parts) const {
+    std::ostringstream out;
+    out << value;
+    parts.text(out.str());
 }
 
 // NIdentifier 的 print 实现
-void NIdent::print(int indent) const {
-    switch (type)
-    {
-    case TINTTYPE:
-        std::cout << "int ";
-        break;
-    case TFLOATTYPE:
-        std::cout << "float ";
-        break;
-    case TVOIDTYPE:
-        std::cout << "void ";
-        break;
-    default:
-        break;
+void NIdent::printParts(int indent, PrintParts& parts) const {
+    if (const char *keyword = typeName(type)) {
+        parts.text(std::string(keyword) + " ");
     }
-    std::cout << name;
+    parts.text(name);
 }
 
 // NMethodCall 的 print 实现
-void NMethodCall::print(int indent) const {
-    id.print();
-    std::cout << "(";
+void NMethodCall::printParts(int indent, PrintParts& parts) const {
+    parts.child(id);
+    parts.text("(");
     for (size_t i = 0; i < arguments.size(); ++i) {
-        arguments[i]->print();
+        parts.child(*arguments[i]);
         if (i != arguments.size() - 1)
-            std::cout << ", ";
+            parts.text(", ");
     }
-    std::cout << ")";
+    parts.text(")");
+}
+
+// 未知运算符的打印形式
+static std::string unknownOp(int op) {
+    return " op(" + std::to_string(op) + ") ";
 }
 
 // NBinaryOperator 的 print 实现
-void NBinaryExpr::print(int indent) const {
-    lhs.print();
+void NBinaryExpr::printParts(int indent, PrintParts& parts) const {
+    parts.child(lhs);
     switch(op) {
-        case TPLUS: std::cout << " + "; break;
-        case TMINUS: std::cout << " - "; break;
-        case TMUL: std::cout << " * "; break;
-        case TDIV: std::cout << " / "; break;
-        case TMOD: std::cout << " %"; break;
-        default: std::cout << " op(" << op << ") "; break;
+        case TPLUS: parts.text(" + "); break;
+        case TMINUS: parts.text(" - "); break;
+        case TMUL: parts.text(" * "); break;
+        case TDIV: parts.text(" / "); break;
+        case TMOD: parts.text(" %"); break;
+        default: parts.text(unknownOp(op)); break;
     }
-    rhs.print();
+    parts.child(rhs);
 }
 
-void NLogicalBinaryExpr::print(int ident) const {
-    lhs.print();
+void NLogicalBinaryExpr::printParts(int indent, PrintParts& parts) const {
+    parts.child(lhs);
     switch (op)
     {
     case TCEQ:
-        std::cout << " == ";
+        parts.text(" == ");
         break;
     case TCNE:
-        std::cout << " != ";
+        parts.text(" != ");
         break;
     case TCLT:
-        std::cout << " < ";
+        parts.text(" < ");
         break;
     case TCLE:
-        std::cout << " <= ";
+        parts.text(" <= ");
         break;
     case TCGT:
-        std::cout << " > ";
+        parts.text(" > ");
         break;
     case TCGE:
-        std::cout << " >= ";
+        parts.text(" >= ");
         break;
     case TAND:
-        std::cout << " && ";
+        parts.text(" && ");
         break;
     case TOR:
-        std::cout << " || ";
+        parts.text(" || ");
         break;
     default:
-        std::cout << " op(" << op << ") ";
+        parts.text(unknownOp(op));
         break;
     }
-    rhs.print();
+    parts.child(rhs);
 }
 
-void NUnaryExpr::print(int indent) const {
+void NUnaryExpr::printParts(int indent, PrintParts& parts) const {
     switch (op)
     {
     case TMINUS:
-        std::cout << "-";
+        parts.text("-");
         break;
     default:
-        std::cout << " op(" << op << ") ";
+        parts.text(unknownOp(op));
         break;
     }
-    expr.print();
+    parts.child(expr);
 }
 
-void NLogicalUnaryExpr::print(int indent) const {
+void NLogicalUnaryExpr::printParts(int indent, PrintParts& parts) const {
     switch (op)
     {
     case TNOT:
-        std::cout << "!";
+        parts.text("!");
         break;
-    
+
     default:
-        std::cout << " op(" << op << ") ";
+        parts.text(unknownOp(op));
         break;
     }
+    parts.child(expr);
 }
 
 // NAssignment 的 print 实现
-void NAssignment::print(int indent) const {
-    lhs.print();
-    std::cout << " = ";
-    rhs.print();
+void NAssignment::printParts(int indent, PrintParts& parts) const {
+    parts.child(lhs);
+    parts.text(" = ");
+    parts.child(rhs);
 }
 
 // NBlock 的 print 实现
-void NBlock::print(int indent) const {
-    std::cout << "{\n";
+void NBlock::printParts(int indent, PrintParts& parts) const {
+    parts.text("{\n");
     for(auto stmt : statements) {
-        stmt->print(indent + 2);
-        std::cout << "\n";
+        parts.child(*stmt, indent + 2);
+        parts.text("\n");
     }
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "}";
+    parts.spaces(indent);
+    parts.text("}");
 }
 
 // NExpressionStatement 的 print 实现
-void NExprStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    expression.print();
-    std::cout << ";";
+void NExprStmt::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.child(expression);
+    parts.text(";");
 }
 
 // NReturnStatement 的 print 实现
-void NReturnStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "return ";
-    expression.print();
-    std::cout << ";";
+void NReturnStmt::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("return ");
+    parts.child(expression);
+    parts.text(";");
 }
 
 
 
 // NVariableDeclaration 的 print 实现
-void NVarDecl::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    if(isConst) std::cout << "const ";
-    id.print();
+void NVarDecl::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    if(isExtern) parts.text("extern ");
+    if(isConst) parts.text("const ");
+    parts.child(id);
     if(assignmentExpr) {
-        std::cout << " = ";
-        assignmentExpr->print();
+        parts.text(" = ");
+        parts.child(*assignmentExpr);
     }
-    std::cout << ";";
+    parts.text(";");
 }
 
 // NConstDeclaration 的 print 实现
@@ -197,53 +222,119 @@ void NVarDecl::print(int indent) const {
 // }
 
 // NFunctionDeclaration 的 print 实现
-void NFuncDecl::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    id.print();
-    std::cout << "(";
+void NFuncDecl::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.child(id);
+    parts.text("(");
     for(size_t i = 0; i < arguments.size(); ++i) {
-        arguments[i]->id.print();
+        parts.child(arguments[i]->id);
         if(i != arguments.size() - 1)
-            std::cout << ", ";
+            parts.text(", ");
+    }
+    if (isPrototype) {
+        parts.text(");");
+        return;
     }
-    std::cout << ") ";
-    block.print(indent); 
+    parts.text(") ");
+    parts.child(block, indent);
 }
 
 // NIfStatement 的 print 实现
-void NIfStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "if (";
-    condition.print();
-    std::cout << ") ";
-    trueBlock.print(indent);
+void NIfStmt::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("if (");
+    parts.child(condition);
+    parts.text(") ");
+    parts.child(trueBlock, indent);
     if (falseBlock) {
-        std::cout << "\n";
-        for(int i = 0; i < indent; ++i) std::cout << " ";
-        std::cout << "else ";
-        falseBlock->print(indent);
+        parts.text("\n");
+        parts.spaces(indent);
+        parts.text("else ");
+        parts.child(*falseBlock, indent);
     }
 }
 
 // NWhileStatement 的 print 实现
-void NWhileStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "while (";
-    condition.print();
-    std::cout << ") ";
-    block.print(indent);
+void NWhileStmt::printParts(int indent, PrintParts& parts) const {
+    for (auto& pragma : pragmas) {
+        parts.spaces(indent);
+        parts.text(pragma + "\n");
+    }
+    parts.spaces(indent);
+    parts.text("while (");
+    parts.child(condition);
+    parts.text(") ");
+    parts.child(block, indent);
+}
+
+static std::string reductionClause(const Reduction& reduction) {
+    return "reduction(" + reduction.op + ": " + reduction.name + ")";
+}
+
+void NParallelFor::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("parallel for (");
+    parts.child(init);
+    parts.text("; ");
+    parts.child(condition);
+    parts.text("; ");
+    parts.child(step);
+    parts.text(") ");
+    for (auto& reduction : reductions) {
+        parts.text(reductionClause(reduction) + " ");
+    }
+    parts.child(block, indent);
+}
+
+bool LoopHints::parse(const std::string& pragma) {
+    std::istringstream in(pragma);
+    std::string directive, rest;
+    in >> directive;
+    if (directive != "#pragma") {
+        return false;
+    }
+    std::getline(in >> std::ws, rest);
+    // 名字后面可以跟一个括号括起的正整数
+    size_t paren = rest.find('(');
+    std::string name = rest.substr(0, paren);
+    name.erase(name.find_last_not_of(" \t\r") + 1);
+    long long count = 0;
+    if (paren != std::string::npos) {
+        char *end;
+        count = std::strtoll(rest.c_str() + paren + 1, &end, 10);
+        while (*end == ' ' || *end == '\t') {
+            end++;
+        }
+        if (count <= 0 || count > 1024 || *end != ')') {
+            return false;
+        }
+    }
+    // 次数或宽度为 1 与禁止等价
+    int value = count == 0 ? 1 : count == 1 ? -1 : count;
+    if (name == "unroll") {
+        unroll = value;
+    } else if (name == "vectorize") {
+        vectorize = value;
+    } else if (name == "nounroll" && paren == std::string::npos) {
+        unroll = -1;
+    } else if (name == "novectorize" && paren == std::string::npos) {
+        vectorize = -1;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 // NBreakStmt 的 print 实现
-void NBreakStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "break;";
+void NBreakStmt::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("break;");
 }
 
 // NContinueStmt 的 print 实现
-void NContinueStmt::print(int indent) const {
-    for(int i = 0; i < indent; ++i) std::cout << " ";
-    std::cout << "continue;";
+void NContinueStmt::printParts(int indent, PrintParts& parts) const {
+    parts.spaces(indent);
+    parts.text("continue;");
 }
 
 // 以上为print实现
@@ -260,235 +351,201 @@ std::string escapeQuotes(const std::string& str) {
     return escaped;
 }
 
-// 基类 Node 的默认实现（如果有需要，可以保留或删除）
+// generateDot 的入口：显式栈代替递归。
+// 每个片段记着它要挂到哪个 DOT 结点下；结点编号按先序分配，与原先的递归版本一致
 int Node::generateDot(std::ostream& out, int& currentId) const {
-    // 基类不直接实例化，返回-1
-    return -1;
+    struct Task {
+        DotParts::Item item;
+        int parentId;
+    };
+    std::vector<Task> work;
+    int rootId = -1;
+    work.push_back({{this, std::string(), NULL, false}, -1});
+    while (!work.empty()) {
+        Task task = work.back();
+        work.pop_back();
+        if (task.item.node == NULL) {
+            int myId = currentId++;
+            out << "  node" << myId << " [label=\"" << task.item.label << "\", shape=" << task.item.shape << "];\n";
+            if (task.parentId != -1) {
+                out << "  node" << task.parentId << " -> node" << myId << ";\n";
+            }
+            else if (rootId == -1) {
+                rootId = myId;
+            }
+            continue;
+        }
+
+        DotParts parts;
+        task.item.node->dotParts(parts);
+        // 节点自身的 DOT 结点最先分配编号，其余片段都挂在它下面
+        int parentId = task.parentId;
+        std::vector<Task> children;
+        for (auto& item : parts.items) {
+            if (item.self) {
+                int myId = currentId++;
+                out << "  node" << myId << " [label=\"" << item.label << "\", shape=" << item.shape << "];\n";
+                if (parentId != -1) {
+                    out << "  node" << parentId << " -> node" << myId << ";\n";
+                }
+                else if (rootId == -1) {
+                    rootId = myId;
+                }
+                parentId = myId;
+                continue;
+            }
+            children.push_back({item, parentId});
+        }
+        pushReversed(children, work);
+    }
+    return rootId;
+}
+
+// 基类 Node 的默认实现：不生成结点
+void Node::dotParts(DotParts& parts) const {
+}
+
+const char *typeName(int type) {
+    switch(type) {
+        case TINTTYPE:
+            return "int";
+        case TFLOATTYPE:
+            return "float";
+        case TVOIDTYPE:
+            return "void";
+        case TINT4TYPE:
+            return "int4";
+        case TINT8TYPE:
+            return "int8";
+        case TFLOAT4TYPE:
+            return "float4";
+        case TFLOAT8TYPE:
+            return "float8";
+        default:
+            return NULL;
+    }
 }
 
 // NCompUnit 的 generateDot 实现
-int NCompUnit::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NCompUnit\", shape=rectangle];\n";
+void NCompUnit::dotParts(DotParts& parts) const {
+    parts.node("NCompUnit");
     for(auto decl : decls) {
-        int childId = decl->generateDot(out, currentId);
-        if(childId != -1) {
-            out << "  node" << myId << " -> node" << childId << ";\n";
-                     
-            // 根据 stmt 的具体类型进行判断
-            if (typeid(*decl) == typeid(NFuncDecl)) {
-                // 逻辑1: 当 stmt 是 NFuncDecl 类型时不打印分号
-            }
-            else {
-                // 其他类型时打印分号
-                // 分号
-                int semicolonId = currentId++;
-                out << "  node" << semicolonId << " [label=\";\", shape=ellipse];\n";
-                out << "  node" << myId << " -> node" << semicolonId << ";\n";
-            }
+        parts.child(*decl);
+        // 根据 stmt 的具体类型进行判断
+        if (typeid(*decl) == typeid(NFuncDecl)) {
+            // 逻辑1: 当 stmt 是 NFuncDecl 类型时不打印分号
+        }
+        else {
+            // 其他类型时打印分号
+            parts.leaf(";");
         }
     }
-    return myId;
 }
 
 
 // NVarDecl 的 generateDot 实现
-int NVarDecl::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NVarDecl\", shape=rectangle];\n";
+void NVarDecl::dotParts(DotParts& parts) const {
+    parts.node("NVarDecl");
+    if(isExtern){
+        parts.leaf("extern");
+    }
     if(isConst){
         // const符号
-        int constId = currentId++;
-        out << "  node" << constId << " [label=\"const\", shape=ellipse];\n";
-        out << "  node" << myId << " -> node" << constId << ";\n";
-        
+        parts.leaf("const");
     }
     // 类型节点
-    int typeId = currentId++;
-    std::string typeStr;
-    switch(id.type) {
-        case TINTTYPE:
-            typeStr = "int";
-            break;
-        case TFLOATTYPE:
-            typeStr = "float";
-            break;
-        case TVOIDTYPE:
-            typeStr = "void";
-            break;
-        default:
-            typeStr = "unknown";
-            break;
-    }
-    out << "  node" << typeId << " [label=\"" << typeStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << typeId << ";\n";
-    
+    parts.leaf(typeName(id.type) ? typeName(id.type) : "unknown");
     // 标识符节点
-    int idId = id.generateDot(out, currentId);
-    if(idId != -1) {
-        out << "  node" << myId << " -> node" << idId << ";\n";
-    }
-    
+    parts.child(id);
+
     // 赋值操作符和赋值表达式
     if(assignmentExpr) {
         // 赋值操作符节点
-        int assignOpId = currentId++;
-        out << "  node" << assignOpId << " [label=\"=\", shape=ellipse];\n";
-        out << "  node" << myId << " -> node" << assignOpId << ";\n";
-        
+        parts.leaf("=");
         // 赋值表达式节点
-        int exprId = assignmentExpr->generateDot(out, currentId);
-        if(exprId != -1) {
-            out << "  node" << myId << " -> node" << exprId << ";\n";
-        }
+        parts.child(*assignmentExpr);
     }
-    
-    return myId;
 }
 
 
 
 // NFuncDecl 的 generateDot 实现
-int NFuncDecl::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NFuncDecl\", shape=rectangle];\n";
+void NFuncDecl::dotParts(DotParts& parts) const {
+    parts.node("NFuncDecl");
     // 类型节点
-    int typeId = currentId++;
-    std::string typeStr;
-    switch(id.type) {
-        case TINTTYPE:
-            typeStr = "int";
-            break;
-        case TFLOATTYPE:
-            typeStr = "float";
-            break;
-        case TVOIDTYPE:
-            typeStr = "void";
-            break;
-        default:
-            typeStr = "unknown";
-            break;
-    }
-    out << "  node" << typeId << " [label=\"" << typeStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << typeId << ";\n";
-    
+    parts.leaf(typeName(id.type) ? typeName(id.type) : "unknown");
     // 函数名
-    int idId = id.generateDot(out, currentId);
-    if(idId != -1) {
-        out << "  node" << myId << " -> node" << idId << ";\n";
-    }
+    parts.child(id);
     // 左圆括号
-    int leftBracketId = currentId++;
-    out << "  node" << leftBracketId << " [label=\"(\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << leftBracketId << ";\n";
-    
-    // 参数列表
-    int numArguments = arguments.size();  // 获取参数总数
-    int currentIndex = 0;  // 用于跟踪当前是第几个参数
+    parts.leaf("(");
+
     // 参数列表
-    for(const auto& arg : arguments) {
-        int argId = arg->generateDot(out, currentId);
-        if(argId != -1) {
-            out << "  node" << myId << " -> node" << argId << ";\n";
-            currentIndex++;
-            if (currentIndex < numArguments) {
-                // 如果不是最后一个参数，添加逗号
-                int commaId = currentId++;
-                out << "  node" << commaId << " [label=\",\", shape=ellipse];\n";
-                out << "  node" << myId << " -> node" << commaId << ";\n";
-                
-            }
+    for(size_t i = 0; i < arguments.size(); ++i) {
+        parts.child(*arguments[i]);
+        if (i + 1 < arguments.size()) {
+            // 如果不是最后一个参数，添加逗号
+            parts.leaf(",");
         }
     }
     // 右圆括号
-    int rightBracketId = currentId++;
-    out << "  node" << rightBracketId << " [label=\")\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << rightBracketId << ";\n";
-    
-    // 函数体
-    int blockId = block.generateDot(out, currentId);
-    if(blockId != -1) {
-        out << "  node" << myId << " -> node" << blockId << ";\n";
+    parts.leaf(")");
+
+    // 函数体，原型只有分号
+    if (isPrototype) {
+        parts.leaf(";");
+        return;
     }
-    return myId;
+    parts.child(block);
 }
 
 // NInteger 的 generateDot 实现
-int NInteger::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"" << value << "\", shape=ellipse];\n";
-    return myId;
+void NInteger::dotParts(DotParts& parts) const {
+    std::ostringstream label;
+    label << value;
+    parts.leaf(label.str());
 }
 
 // NFloat 的 generateDot 实现
-int NFloat::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"" << value << "\", shape=ellipse];\n";
-    return myId;
+void NFloat::dotParts(DotParts& parts) const {
+    std::ostringstream label;
+    label << value;
+    parts.leaf(label.str());
 }
 
 // NIdent 的 generateDot 实现
-int NIdent::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"" << escapeQuotes(name) << "\", shape=ellipse];\n";
-    return myId;
+void NIdent::dotParts(DotParts& parts) const {
+    parts.leaf(escapeQuotes(name));
 }
 
 // NMethodCall 的 generateDot 实现
-int NMethodCall::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NMethodCall\", shape=rectangle];\n";
+void NMethodCall::dotParts(DotParts& parts) const {
+    parts.node("NMethodCall");
     // 方法名
-    int idId = id.generateDot(out, currentId);
-    if(idId != -1) {
-        out << "  node" << myId << " -> node" << idId << ";\n";
-    }
+    parts.child(id);
     // 左圆括号
-    int leftBracketId = currentId++;
-    out << "  node" << leftBracketId << " [label=\"(\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << leftBracketId << ";\n";
-    
-    // 参数列表
-    int numArguments = arguments.size();  // 获取参数总数
-    int currentIndex = 0;  // 用于跟踪当前是第几个参数
+    parts.leaf("(");
+
     // 参数列表
-    for(const auto& arg : arguments) {
-        int argId = arg->generateDot(out, currentId);
-        if(argId != -1) {
-            out << "  node" << myId << " -> node" << argId << ";\n";
-            currentIndex++;
-            if (currentIndex < numArguments) {
-                // 如果不是最后一个参数，添加逗号
-                int commaId = currentId++;
-                out << "  node" << commaId << " [label=\",\", shape=ellipse];\n";
-                out << "  node" << myId << " -> node" << commaId << ";\n";
-                
-            }
+    for(size_t i = 0; i < arguments.size(); ++i) {
+        parts.child(*arguments[i]);
+        if (i + 1 < arguments.size()) {
+            // 如果不是最后一个参数，添加逗号
+            parts.leaf(",");
         }
     }
-    
-    // 右圆括号
-    int rightBracketId = currentId++;
-    out << "  node" << rightBracketId << " [label=\")\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << rightBracketId << ";\n";
 
-
-    return myId;
+    // 右圆括号
+    parts.leaf(")");
 }
 
 // NBinaryExpr 的 generateDot 实现
-int NBinaryExpr::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NBinaryExpr\", shape=rectangle];\n";
+void NBinaryExpr::dotParts(DotParts& parts) const {
+    parts.node("NBinaryExpr");
 
     // 左子表达式
-    int lhsId = lhs.generateDot(out, currentId);
-    if(lhsId != -1) {
-        out << "  node" << myId << " -> node" << lhsId << ";\n";
-    }
+    parts.child(lhs);
 
     // 操作符叶子节点
-    int opId = currentId++;
     std::string opStr;
     switch(op) {
         case TPLUS:  opStr = "+"; break;
@@ -498,33 +555,20 @@ int NBinaryExpr::generateDot(std::ostream& out, int& currentId) const {
         case TMOD:   opStr = "%"; break;
         default:     opStr = "op"; break;
     }
-    out << "  node" << opId << " [label=\"" << opStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << opId << ";\n";
-
+    parts.leaf(opStr);
 
     // 右子表达式
-    int rhsId = rhs.generateDot(out, currentId);
-    if(rhsId != -1) {
-        out << "  node" << myId << " -> node" << rhsId << ";\n";
-    }
-
-    return myId;
+    parts.child(rhs);
 }
 
 // NLogicalBinaryExpr 的 generateDot 实现
-int NLogicalBinaryExpr::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NLogicalBinaryExpr\", shape=rectangle];\n";
+void NLogicalBinaryExpr::dotParts(DotParts& parts) const {
+    parts.node("NLogicalBinaryExpr");
 
     // 左子表达式
-    int lhsId = lhs.generateDot(out, currentId);
-    if(lhsId != -1) {
-        out << "  node" << myId << " -> node" << lhsId << ";\n";
-    }
-
+    parts.child(lhs);
 
     // 操作符叶子节点
-    int opId = currentId++;
     std::string opStr;
     switch(op) {
         case TCEQ: opStr = "=="; break;
@@ -537,259 +581,271 @@ int NLogicalBinaryExpr::generateDot(std::ostream& out, int& currentId) const {
         case TOR:  opStr = "||"; break;
         default:   opStr = "op"; break;
     }
-    out << "  node" << opId << " [label=\"" << opStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << opId << ";\n";
-
+    parts.leaf(opStr);
 
     // 右子表达式
-    int rhsId = rhs.generateDot(out, currentId);
-    if(rhsId != -1) {
-        out << "  node" << myId << " -> node" << rhsId << ";\n";
-    }
-
-    return myId;
+    parts.child(rhs);
 }
 
 // NUnaryExpr 的 generateDot 实现
-int NUnaryExpr::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NUnaryExpr\", shape=rectangle];\n";
+void NUnaryExpr::dotParts(DotParts& parts) const {
+    parts.node("NUnaryExpr");
 
     // 操作符叶子节点
-    int opId = currentId++;
     std::string opStr;
     switch(op) {
         case TMINUS: opStr = "-"; break;
         // 添加更多操作符如 TNOT 等
         default:     opStr = "op"; break;
     }
-    out << "  node" << opId << " [label=\"" << opStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << opId << ";\n";
+    parts.leaf(opStr);
 
     // 子表达式
-    int exprId = expr.generateDot(out, currentId);
-    if(exprId != -1) {
-        out << "  node" << myId << " -> node" << exprId << ";\n";
-    }
-
-    return myId;
+    parts.child(expr);
 }
 
 // NLogicalUnaryExpr 的 generateDot 实现
-int NLogicalUnaryExpr::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NLogicalUnaryExpr\", shape=rectangle];\n";
+void NLogicalUnaryExpr::dotParts(DotParts& parts) const {
+    parts.node("NLogicalUnaryExpr");
 
     // 操作符叶子节点
-    int opId = currentId++;
     std::string opStr;
     switch(op) {
         case TNOT: opStr = "!"; break;
         // 添加更多操作符如其他逻辑操作符
         default:   opStr = "op"; break;
     }
-    out << "  node" << opId << " [label=\"" << opStr << "\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << opId << ";\n";
+    parts.leaf(opStr);
 
     // 子表达式
-    int exprId = expr.generateDot(out, currentId);
-    if(exprId != -1) {
-        out << "  node" << myId << " -> node" << exprId << ";\n";
-    }
-
-    return myId;
+    parts.child(expr);
 }
 
 // NAssignment 的 generateDot 实现
-int NAssignment::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NAssignment\", shape=rectangle];\n";
-    
+void NAssignment::dotParts(DotParts& parts) const {
+    parts.node("NAssignment");
+
     // 左值
-    int lhsId = lhs.generateDot(out, currentId);
-    if(lhsId != -1) {
-        out << "  node" << myId << " -> node" << lhsId << ";\n";
-    }
+    parts.child(lhs);
     // =符号
-    int equalSignId = currentId++;
-    out << "  node" << equalSignId << " [label=\"=\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << equalSignId << ";\n";
-    
+    parts.leaf("=");
 
     // 右值
-    int rhsId = rhs.generateDot(out, currentId);
-    if(rhsId != -1) {
-        out << "  node" << myId << " -> node" << rhsId << ";\n";
-    }
-
-    return myId;
+    parts.child(rhs);
 }
 
 // NBlock 的 generateDot 实现
-int NBlock::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NBlock\", shape=rectangle];\n";
+void NBlock::dotParts(DotParts& parts) const {
+    parts.node("NBlock");
     // 左花括号
-    int leftBraceId = currentId++;
-    out << "  node" << leftBraceId << " [label=\"{\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << leftBraceId << ";\n";
+    parts.leaf("{");
     // 语句列表
-    
+
     for(auto stmt : statements) {
-        int stmtId = stmt->generateDot(out, currentId);
-        if(stmtId != -1) {
-            out << "  node" << myId << " -> node" << stmtId << ";\n";
-            
-            // 根据 stmt 的具体类型进行判断
-            if (typeid(*stmt) == typeid(NBlock)) {
-                // 逻辑1: 当 stmt 是 NBlock 类型时不打印分号
-            }
-            else if (typeid(*stmt) == typeid(NIfStmt)) {
-                // 逻辑2: 当 stmt 是 NIfStmt 类型时不打印分号
-            }
-            else if (typeid(*stmt) == typeid(NWhileStmt)) {
-                // 逻辑3: 当 stmt 是 NWhileStmt 类型时不打印分号
-            }
-            else {
-                // 其他类型时打印分号
-                // 分号
-                int semicolonId = currentId++;
-                out << "  node" << semicolonId << " [label=\";\", shape=ellipse];\n";
-                out << "  node" << myId << " -> node" << semicolonId << ";\n";
-            }
-         
+        parts.child(*stmt);
+
+        // 根据 stmt 的具体类型进行判断
+        if (typeid(*stmt) == typeid(NBlock)) {
+            // 逻辑1: 当 stmt 是 NBlock 类型时不打印分号
+        }
+        else if (typeid(*stmt) == typeid(NIfStmt)) {
+            // 逻辑2: 当 stmt 是 NIfStmt 类型时不打印分号
+        }
+        else if (typeid(*stmt) == typeid(NWhileStmt) || typeid(*stmt) == typeid(NParallelFor)) {
+            // 逻辑3: 当 stmt 是循环时不打印分号
+        }
+        else {
+            // 其他类型时打印分号
+            parts.leaf(";");
         }
     }
     // 右花括号
-    int rightBraceId = currentId++;
-    out << "  node" << rightBraceId << " [label=\"}\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << rightBraceId << ";\n";
-    return myId;
+    parts.leaf("}");
 }
 
 // NExprStmt 的 generateDot 实现
-int NExprStmt::generateDot(std::ostream& out, int& currentId) const {
-    return expression.generateDot(out, currentId);
+void NExprStmt::dotParts(DotParts& parts) const {
+    // 不单独建结点，表达式直接挂到父结点下
+    parts.child(expression);
 }
 
 // NReturnStmt 的 generateDot 实现
-int NReturnStmt::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NReturnStmt\", shape=rectangle];\n";
-    
+void NReturnStmt::dotParts(DotParts& parts) const {
+    parts.node("NReturnStmt");
+
     // return符号
-    int returnId = currentId++;
-    out << "  node" << returnId << " [label=\"return\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << returnId << ";\n";
-    
+    parts.leaf("return");
+
     // 返回表达式
-    int exprId = expression.generateDot(out, currentId);
-    if(exprId != -1) {
-        out << "  node" << myId << " -> node" << exprId << ";\n";
-    }
-    
-    return myId;
+    parts.child(expression);
 }
 
 // NIfStmt 的 generateDot 实现
-int NIfStmt::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NIfStmt\", shape=rectangle];\n";
+void NIfStmt::dotParts(DotParts& parts) const {
+    parts.node("NIfStmt");
 
     // if符号
-    int ifId = currentId++;
-    out << "  node" << ifId << " [label=\"if\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << ifId << ";\n";
-    
+    parts.leaf("if");
+
     // 左圆括号
-    int leftBracketId = currentId++;
-    out << "  node" << leftBracketId << " [label=\"(\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << leftBracketId << ";\n";
-    
+    parts.leaf("(");
+
     // 条件表达式
-    int condId = condition.generateDot(out, currentId);
-    if(condId != -1) {
-        out << "  node" << myId << " -> node" << condId << ";\n";
-    }
+    parts.child(condition);
     // 右圆括号
-    int rightBracketId = currentId++;
-    out << "  node" << rightBracketId << " [label=\")\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << rightBracketId << ";\n";
-    
+    parts.leaf(")");
 
     // 真分支
-    int trueBlockId = trueBlock.generateDot(out, currentId);
-    if(trueBlockId != -1) {
-        out << "  node" << myId << " -> node" << trueBlockId << ";\n";
-    }
+    parts.child(trueBlock);
 
     // 假分支（如果存在）
     if(falseBlock) {
         // else符号
-        int elseId = currentId++;
-        out << "  node" << elseId << " [label=\"else\", shape=ellipse];\n";
-        out << "  node" << myId << " -> node" << elseId << ";\n";
-        
-        int falseBlockId = falseBlock->generateDot(out, currentId);
-        if(falseBlockId != -1) {
-            out << "  node" << myId << " -> node" << falseBlockId << ";\n";
-        }
+        parts.leaf("else");
+        parts.child(*falseBlock);
     }
-
-    return myId;
 }
 
 // NWhileStmt 的 generateDot 实现
-int NWhileStmt::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NWhileStmt\", shape=rectangle];\n";
+void NWhileStmt::dotParts(DotParts& parts) const {
+    parts.node("NWhileStmt");
+    for (auto& pragma : pragmas) {
+        parts.leaf(pragma);
+    }
     // while符号
-    int whileId = currentId++;
-    out << "  node" << whileId << " [label=\"while\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << whileId << ";\n";
+    parts.leaf("while");
     // 左圆括号
-    int leftBracketId = currentId++;
-    out << "  node" << leftBracketId << " [label=\"(\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << leftBracketId << ";\n";
-    
+    parts.leaf("(");
+
     // 条件表达式
-    int condId = condition.generateDot(out, currentId);
-    if(condId != -1) {
-        out << "  node" << myId << " -> node" << condId << ";\n";
-    }
+    parts.child(condition);
     // 右圆括号
-    int rightBracketId = currentId++;
-    out << "  node" << rightBracketId << " [label=\")\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << rightBracketId << ";\n";
-    
+    parts.leaf(")");
 
     // 循环体
-    int blockId = block.generateDot(out, currentId);
-    if(blockId != -1) {
-        out << "  node" << myId << " -> node" << blockId << ";\n";
-    }
+    parts.child(block);
+}
 
-    return myId;
+// NParallelFor 的 generateDot 实现
+void NParallelFor::dotParts(DotParts& parts) const {
+    parts.node("NParallelFor");
+    parts.leaf("parallel for");
+    parts.leaf("(");
+    parts.child(init);
+    parts.leaf(";");
+    parts.child(condition);
+    parts.leaf(";");
+    parts.child(step);
+    parts.leaf(")");
+    for (auto& reduction : reductions) {
+        parts.leaf(reductionClause(reduction));
+    }
+    parts.child(block);
 }
 
 // NBreakStmt 的 generateDot 实现
-int NBreakStmt::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NBreakStmt\", shape=rectangle];\n";
+void NBreakStmt::dotParts(DotParts& parts) const {
+    parts.node("NBreakStmt");
     // break符号
-    int breakId = currentId++;
-    out << "  node" << breakId << " [label=\"break\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << breakId << ";\n";
-    return myId;
+    parts.leaf("break");
 }
 
 // NContinueStmt 的 generateDot 实现
-int NContinueStmt::generateDot(std::ostream& out, int& currentId) const {
-    int myId = currentId++;
-    out << "  node" << myId << " [label=\"NContinueStmt\", shape=rectangle];\n";
+void NContinueStmt::dotParts(DotParts& parts) const {
+    parts.node("NContinueStmt");
     // continue符号
-    int continueId = currentId++;
-    out << "  node" << continueId << " [label=\"continue\", shape=ellipse];\n";
-    out << "  node" << myId << " -> node" << continueId << ";\n";
-    return myId;
-}
\ No newline at end of file
+    parts.leaf("continue");
+}
+
+// deleteTree 的入口：显式栈代替递归，深层嵌套的树也能释放
+void Node::deleteTree(Node *root) {
+    std::vector<Node*> work;
+    if (root) {
+        work.push_back(root);
+    }
+    while (!work.empty()) {
+        Node *node = work.back();
+        work.pop_back();
+        node->releaseChildren(work);
+        delete node;
+    }
+}
+
+void NCompUnit::releaseChildren(std::vector<Node*>& out) {
+    out.insert(out.end(), decls.begin(), decls.end());
+    // 析构函数不再重复释放
+    decls.clear();
+}
+
+void NVarDecl::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&id);
+    if (assignmentExpr) {
+        out.push_back(assignmentExpr);
+    }
+}
+
+void NFuncDecl::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(const_cast<NIdent*>(&id));
+    out.insert(out.end(), arguments.begin(), arguments.end());
+    out.push_back(&block);
+}
+
+void NMethodCall::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(const_cast<NIdent*>(&id));
+    out.insert(out.end(), arguments.begin(), arguments.end());
+}
+
+void NBinaryExpr::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&lhs);
+    out.push_back(&rhs);
+}
+
+void NLogicalBinaryExpr::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&lhs);
+    out.push_back(&rhs);
+}
+
+void NUnaryExpr::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&expr);
+}
+
+void NLogicalUnaryExpr::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&expr);
+}
+
+void NAssignment::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&lhs);
+    out.push_back(&rhs);
+}
+
+void NBlock::releaseChildren(std::vector<Node*>& out) {
+    out.insert(out.end(), statements.begin(), statements.end());
+}
+
+void NExprStmt::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&expression);
+}
+
+void NReturnStmt::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&expression);
+}
+
+void NIfStmt::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&condition);
+    out.push_back(&trueBlock);
+    if (falseBlock) {
+        out.push_back(falseBlock);
+    }
+}
+
+void NWhileStmt::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&condition);
+    out.push_back(&block);
+}
+
+void NParallelFor::releaseChildren(std::vector<Node*>& out) {
+    out.push_back(&init);
+    out.push_back(&condition);
+    out.push_back(&step);
+    out.push_back(&block);
+}
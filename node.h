@@ -1,9 +1,11 @@
 #include <iostream>
+#include <string>
 #include <vector>
 #include <llvm/IR/Value.h>
 
 // 前向声明
 class CodeGenContext;
+class Node;
 class NCompUnit;
 class NStmt;
 class NExpr;
@@ -38,15 +40,67 @@ typedef std::vector<NDecl*> DeclList;
 //     UNKNOWN
 // };
 
+// 类型 token 对应的关键字（int、float4 等），不是类型 token 时返回 NULL
+const char *typeName(int type);
+
+// 代码生成的显式栈帧，定义见 codegen.h
+struct CodeGenFrame;
+
+// print 的输出片段。节点按输出顺序登记文本和子节点，
+// 由 Node::print 用显式栈逐个处理，不随树的深度递归
+class PrintParts {
+public:
+    struct Item {
+        const Node *node;   // 非空时表示子节点
+        int indent;
+        std::string text;
+    };
+    std::vector<Item> items;
+
+    void text(const std::string& s) { items.push_back({NULL, 0, s}); }
+    void spaces(int count) { items.push_back({NULL, 0, std::string(count > 0 ? count : 0, ' ')}); }
+    void child(const Node& node, int indent = 0) { items.push_back({&node, indent, std::string()}); }
+};
+
+// generateDot 的输出片段。node() 为当前节点本身建 DOT 结点，
+// leaf() 和 child() 依次挂在它下面；不调用 node() 的节点直接把子节点挂到父结点上
+class DotParts {
+public:
+    struct Item {
+        const Node *node;   // 非空时表示子节点
+        std::string label;
+        const char *shape;
+        bool self;          // 当前节点自身
+    };
+    std::vector<Item> items;
+
+    void node(const std::string& label) { items.push_back({NULL, label, "rectangle", true}); }
+    void leaf(const std::string& label) { items.push_back({NULL, label, "ellipse", false}); }
+    void child(const Node& node) { items.push_back({&node, std::string(), NULL, false}); }
+};
+
 // 基类 Node
+// codeGen / print / generateDot 都是非递归的入口：用显式栈遍历整棵子树，
+// 每个节点只需实现单步的 codeGenStep / printParts / dotParts，
+// 因此任意深的树（例如机器生成的百万层表达式）也不会耗尽调用栈。
 class Node {
 public:
     Node() { }
     virtual ~Node() {}
-    virtual llvm::Value* codeGen(CodeGenContext& context) { return NULL; }
-    virtual void print(int indent = 0) const;
-    // 新增纯虚函数用于生成DOT
-    virtual int generateDot(std::ostream& out, int& currentId) const;
+    llvm::Value* codeGen(CodeGenContext& context);
+    void print(std::ostream& out, int indent = 0) const;
+    int generateDot(std::ostream& out, int& currentId) const;
+
+    // 推进一步：最多调度一个子节点（context.schedule）后返回 false，
+    // 子节点完成时它的值在值栈顶；全部完成后压入自己的值并返回 true
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame);
+    virtual void printParts(int indent, PrintParts& parts) const;
+    virtual void dotParts(DotParts& parts) const;
+
+    // 非递归地释放以 root 为根的整棵子树
+    static void deleteTree(Node *root);
+    // 把自己拥有的子节点交给 out，由 deleteTree 逐个释放
+    virtual void releaseChildren(std::vector<Node*>& out) { }
 };
 
 class NCompUnit : public Node {
@@ -60,9 +114,10 @@ public:
         decls.clear();
     }
     NCompUnit(NDecl& decl) { decls.push_back(&decl); }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NExpr : public Node {
@@ -77,15 +132,17 @@ class NDecl : public NStmt {
 class NVarDecl : public NDecl {
 public:
     bool isConst;
+    bool isExtern;          // extern 全局变量，只声明，由别的模块定义
     NIdent& id;
     NExpr *assignmentExpr;
     NVarDecl(bool isConst, NIdent& id) :
-        isConst(isConst), id(id) { assignmentExpr = NULL; }
+        isConst(isConst), isExtern(false), id(id) { assignmentExpr = NULL; }
     NVarDecl(bool isConst, NIdent& id, NExpr *assignmentExpr) :
-        isConst(isConst), id(id), assignmentExpr(assignmentExpr) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+        isConst(isConst), isExtern(false), id(id), assignmentExpr(assignmentExpr) { }
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NFuncDecl : public NDecl {
@@ -93,30 +150,32 @@ public:
     const NIdent& id;
     VariableList arguments;
     NBlock& block;
+    bool isPrototype;       // 只有原型没有函数体，block 为空
     NFuncDecl(const NIdent& id, 
             const VariableList& arguments, NBlock& block) :
-        id(id), arguments(arguments), block(block) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+        id(id), arguments(arguments), block(block), isPrototype(false) { }
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NInteger : public NExpr {
 public:
     long long value;
     NInteger(long long value) : value(value) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
 };
 
 class NFloat : public NExpr {
 public:
     double value;
     NFloat(double value) : value(value) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
 };
 
 class NIdent : public NExpr {
@@ -131,9 +190,9 @@ public:
     int type;
     NIdent(const std::string& name, int type) : name(name), type(type) { }
     NIdent(const std::string& name) : name(name), type(-1) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
 };
 
 class NMethodCall : public NExpr {
@@ -143,9 +202,10 @@ public:
     NMethodCall(const NIdent& id, ExprList& arguments) :
         id(id), arguments(arguments) { }
     NMethodCall(const NIdent& id) : id(id) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NBinaryExpr : public NExpr {
@@ -155,9 +215,10 @@ public:
     NExpr& rhs;
     NBinaryExpr(NExpr& lhs, int op, NExpr& rhs) :
         lhs(lhs), rhs(rhs), op(op) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NLogicalBinaryExpr : public NExpr {
@@ -170,9 +231,10 @@ public:
     NLogicalBinaryExpr(NExpr& lhs, int op, NExpr& rhs) :
         lhs(lhs), rhs(rhs), op(op) { }
 
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NUnaryExpr : public NExpr {
@@ -184,9 +246,10 @@ public:
     NUnaryExpr(int op, NExpr& expr) :
         op(op), expr(expr) { }
 
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NLogicalUnaryExpr : public NExpr {
@@ -197,9 +260,10 @@ public:
 
     NLogicalUnaryExpr(int op, NExpr &expr) : op(op), expr(expr) {}
 
-    virtual llvm::Value *codeGen(CodeGenContext &context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NAssignment : public NExpr {
@@ -208,9 +272,10 @@ public:
     NExpr& rhs;
     NAssignment(NIdent& lhs, NExpr& rhs) : 
         lhs(lhs), rhs(rhs) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NBlock : public NStmt {
@@ -218,9 +283,10 @@ public:
     StmtList statements;
     NBlock() { }
     NBlock(NStmt& statement) { statements.push_back(&statement); }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NExprStmt : public NStmt {
@@ -228,9 +294,10 @@ public:
     NExpr& expression;
     NExprStmt(NExpr& expression) : 
         expression(expression) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 class NReturnStmt : public NStmt {
@@ -238,9 +305,10 @@ public:
     NExpr& expression;
     NReturnStmt(NExpr& expression) : 
         expression(expression) { }
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-     virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
 };
 
 // class NVariableDeclaration : public NStmt {
@@ -293,34 +361,82 @@ public:
         condition(condition), trueBlock(trueBlock), falseBlock(&falseBlock) { };
     NIfStmt(NExpr& condition, NBlock& trueBlock) :
         condition(condition), trueBlock(trueBlock), falseBlock(nullptr) { };
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-    virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
+};
+
+// while 前 #pragma 给出的循环提示，代码生成时写成 llvm.loop 元数据
+//   #pragma unroll / unroll(N) / nounroll
+//   #pragma vectorize / vectorize(N) / novectorize
+struct LoopHints {
+    int unroll = 0;      // 0 未指定，-1 禁止展开，1 允许展开，大于 1 为展开次数
+    int vectorize = 0;   // 0 未指定，-1 禁止向量化，1 允许向量化，大于 1 为向量宽度
+    // 解析一行 "#pragma ..."，认不出时返回 false
+    bool parse(const std::string& pragma);
+    bool empty() const { return unroll == 0 && vectorize == 0; }
 };
 
 class NWhileStmt : public NStmt {
 public:
     NExpr& condition;
     NBlock& block;
+    std::vector<std::string> pragmas;   // 认出的 #pragma 原文，还原源码时原样输出
+    LoopHints hints;
     NWhileStmt(NExpr& condition, NBlock& block) :
         condition(condition), block(block) { };
-    virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-    virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
     
 };
 
+// parallel for 的 reduction(op: 变量) 子句，op 是 "+"、"*"、"min" 或 "max"
+struct Reduction {
+    std::string op;
+    std::string name;
+};
+
+// parallel for (i = a; i < b; i = i + c) reduction(+: s) { ... }
+// 条件只能是 < 或 <=，步长 c 是正的整数常量。循环体提出成单独的函数，
+// 迭代空间交给工作窃取线程池（parallel.cpp）并行执行：外层的局部变量按引用共享，
+// 循环变量和归约变量每个线程各有一份，归约变量在各自做完后原子地合并回去
+class NParallelFor : public NStmt {
+public:
+    NExpr& init;
+    NExpr& condition;
+    NExpr& step;
+    NBlock& block;
+    std::vector<Reduction> reductions;
+    // 规范形式的循环头：codeGenStep 在第一步检查并填好，之后各步直接使用
+    struct Header {
+        NIdent *var;
+        NExpr *start;
+        NExpr *bound;
+        bool inclusive;
+        long long step;
+    } header;
+    NParallelFor(NExpr& init, NExpr& condition, NExpr& step, NBlock& block) :
+        init(init), condition(condition), step(step), block(block), header() { }
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
+    virtual void releaseChildren(std::vector<Node*>& out) override;
+};
+
 class NBreakStmt : public NStmt {
 public:
     NBreakStmt() { }
-    //virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-    virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
 };
 class NContinueStmt : public NStmt {
 public:
     NContinueStmt() { }
-    //virtual llvm::Value* codeGen(CodeGenContext& context);
-    virtual void print(int indent = 0) const override;
-    virtual int generateDot(std::ostream& out, int& currentId) const override;
+    virtual bool codeGenStep(CodeGenContext& context, CodeGenFrame& frame) override;
+    virtual void printParts(int indent, PrintParts& parts) const override;
+    virtual void dotParts(DotParts& parts) const override;
 };
\ No newline at end of file
@@ -0,0 +1,175 @@
+// parallel.cpp: parallel for 的运行时，由 NParallelFor 生成的代码调用，见 node.h
+// 工作窃取：迭代空间先平均分给各线程，每个线程从自己区间的前端按 grain 取活，
+// 自己的做完了就从别的线程剩下的区间里偷走后一半。
+// 线程数取环境变量 SYSY_THREADS，默认是 CPU 数；循环体里嵌套的 parallel for 在当前线程串行执行。
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// 提出的循环体：执行第 lo 到 hi - 1 次迭代
+typedef void (*Body)(void **env, long long lo, long long hi);
+
+// 每个线程待做的迭代区间，独占一条缓存行
+struct alignas(64) Range {
+    std::mutex lock;
+    long long lo = 0;
+    long long hi = 0;
+};
+
+thread_local bool insideLoop = false;
+
+class Pool {
+public:
+    explicit Pool(unsigned threads) : ranges(threads) {
+        for (unsigned i = 1; i < threads; i++) {
+            // 线程池活到进程结束，退出时不等工作线程
+            std::thread(&Pool::worker, this, i).detach();
+        }
+    }
+
+    unsigned size() const { return ranges.size(); }
+
+    // 调用者自己当 0 号线程，全部迭代做完后返回
+    void run(Body body, void **env, long long count) {
+        unsigned threads = size();
+        for (unsigned i = 0; i < threads; i++) {
+            std::lock_guard<std::mutex> guard(ranges[i].lock);
+            ranges[i].lo = count * i / threads;
+            ranges[i].hi = count * (i + 1) / threads;
+        }
+        remaining = count;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            this->body = body;
+            this->env = env;
+            // 每个线程分到的区间再切成约 16 块，块越小负载越均衡，取活的开销也越大
+            grain = std::max(1LL, count / (threads * 16LL));
+            busy = threads - 1;
+            generation++;
+        }
+        wake.notify_all();
+        work(0);
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this] { return busy == 0; });
+    }
+
+private:
+    std::vector<Range> ranges;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    unsigned long generation = 0;
+    unsigned busy = 0;              // 还没做完当前任务的工作线程
+    Body body = nullptr;
+    void **env = nullptr;
+    long long grain = 1;
+    std::atomic<long long> remaining{0};
+
+    void worker(unsigned self) {
+        insideLoop = true;
+        unsigned long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return generation != seen; });
+                seen = generation;
+            }
+            work(self);
+            std::lock_guard<std::mutex> guard(lock);
+            if (--busy == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+
+    void work(unsigned self) {
+        unsigned seed = self * 2654435761u + 1;
+        long long lo, hi;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (take(self, lo, hi) || steal(self, seed, lo, hi)) {
+                body(env, lo, hi);
+                remaining.fetch_sub(hi - lo, std::memory_order_acq_rel);
+            }
+            else {
+                // 没有可偷的，别的线程还在做最后几块
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // 从自己区间的前端取一块
+    bool take(unsigned self, long long& lo, long long& hi) {
+        Range& own = ranges[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.lo >= own.hi) {
+            return false;
+        }
+        lo = own.lo;
+        hi = std::min(own.hi, lo + grain);
+        own.lo = hi;
+        return true;
+    }
+
+    // 从随机挑的起点开始找有剩余的线程，偷走它剩下的后一半，先做其中的一块
+    bool steal(unsigned self, unsigned& seed, long long& lo, long long& hi) {
+        unsigned threads = size();
+        seed = seed * 1103515245u + 12345u;
+        for (unsigned i = 0; i < threads; i++) {
+            unsigned victim = (seed / 65536 + i) % threads;
+            if (victim == self) {
+                continue;
+            }
+            long long from, to;
+            {
+                std::lock_guard<std::mutex> guard(ranges[victim].lock);
+                Range& range = ranges[victim];
+                if (range.lo >= range.hi) {
+                    continue;
+                }
+                from = range.lo + (range.hi - range.lo) / 2;
+                to = range.hi;
+                range.hi = from;
+            }
+            std::lock_guard<std::mutex> guard(ranges[self].lock);
+            lo = from;
+            hi = std::min(to, from + grain);
+            ranges[self].lo = hi;
+            ranges[self].hi = to;
+            return true;
+        }
+        return false;
+    }
+};
+
+unsigned configuredThreads() {
+    const char *text = getenv("SYSY_THREADS");
+    int threads = text ? atoi(text) : 0;
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return threads > 0 ? threads : 1;
+}
+
+} // namespace
+
+extern "C"
+void sysy_parallel_for(Body body, void **env, long long count)
+{
+    if (count <= 0) {
+        return;
+    }
+    static Pool *pool = new Pool(configuredThreads());
+    if (insideLoop || pool->size() == 1 || count == 1) {
+        body(env, 0, count);
+        return;
+    }
+    insideLoop = true;
+    pool->run(body, env, count);
+    insideLoop = false;
+}
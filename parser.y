@@ -3,14 +3,52 @@
     #include <cstdio>
     #include <cstdlib>
 	#define PRINT_PROD(name) fprintf(stderr, "%s\n", #name)
+	/* machine-generated inputs nest far deeper than bison's default limit of 10000 */
+	#define YYMAXDEPTH 50000000
 
 	NCompUnit *programCompUnit; /* the top level root node of our final AST */
 
+	/* called with each completed top-level declaration, see main.cpp */
+	void (*topLevelDeclHook)(NDecl *decl) = NULL;
+	/* false in streaming mode: the hook takes ownership of each declaration
+	   and comp_unit does not keep the whole file alive */
+	bool keepTopLevelDecls = true;
+
 	extern int yylex();
+	extern bool hasError;
+
+	static void emitTopLevelDecl(NCompUnit *unit, NDecl *decl) {
+		if (keepTopLevelDecls) {
+			unit->decls.push_back(decl);
+		}
+		// declarations reduced after a syntax error may hold garbage from error recovery
+		if (topLevelDeclHook && !hasError) {
+			topLevelDeclHook(decl);
+		}
+	}
 
 	
 
 	void yyerror(const char *s);
+	void printDiagnostic(FILE *stream, const std::string& text);
+	extern long long lineCount;
+
+	/* a function prototype keeps an empty body so every walker can treat it like a definition */
+	static NFuncDecl *newPrototype(NIdent *id, VariableList *arguments) {
+		NFuncDecl *decl = new NFuncDecl(*id, *arguments, *new NBlock());
+		decl->isPrototype = true;
+		delete arguments;
+		return decl;
+	}
+
+	/* pragmas are reduced innermost first, so each one goes in front of those already seen */
+	static void addLoopPragma(NWhileStmt *loop, std::string *pragma) {
+		if (pragma) {
+			loop->hints.parse(*pragma);
+			loop->pragmas.insert(loop->pragmas.begin(), *pragma);
+			delete pragma;
+		}
+	}
 %}
 
 /* Represents the many different ways we can access our data */
@@ -25,6 +63,7 @@
 	NVarDecl *var_decl;
 	std::vector<NVarDecl*> *varvec;
 	std::vector<NExpr*> *exprvec;
+	std::vector<Reduction> *reductions;
 	std::string *string;
 	long long number_int;
 	double number_float;
@@ -38,13 +77,14 @@
 %debug
 %token <number_int> TINTEGER
 %token <number_float> TFLOAT
-%token <string> TIDENTIFIER 
+%token <string> TIDENTIFIER TPRAGMA
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
-%token <token> TLPAREN TRPAREN TLBRACKET TRBRACKET TLBRACE TRBRACE TCOMMA TSEMICOLON TDOT
+%token <token> TLPAREN TRPAREN TLBRACKET TRBRACKET TLBRACE TRBRACE TCOMMA TSEMICOLON TCOLON TDOT
 %token <token> TPLUS TMINUS TMUL TDIV TMOD TNOT
-%token <token> TRETURN TCONST TIF TELSE TWHILE TBREAK TCONTINUE
+%token <token> TRETURN TCONST TEXTERN TIF TELSE TWHILE TBREAK TCONTINUE TPARALLEL TFOR TREDUCTION
 %token <token> TOR TAND
 %token <token> TINTTYPE TFLOATTYPE TVOIDTYPE
+%token <token> TINT4TYPE TINT8TYPE TFLOAT4TYPE TFLOAT8TYPE
 %token <token> YYERRORSYMBOL
 
 /* Define the type of node our nonterminal symbols represent.
@@ -55,28 +95,38 @@
 %type <comp_unit> comp_unit
 %type <ident> ident
 %type <expr> numeric expr
-%type <varvec> func_decl_args
-%type <exprvec> call_args
+%type <varvec> func_decl_args func_decl_list
+%type <exprvec> call_args call_list
 %type <block> stmts block
-%type <var_decl> var_decl
-%type <func_decl> func_decl
-%type <stmt> stmt ifstmt whilestmt
+%type <var_decl> var_decl extern_decl
+%type <func_decl> func_decl func_proto
+%type <stmt> stmt ifstmt whilestmt parallelstmt
+%type <reductions> reductions reduction_vars
+%type <string> reduction_op
+%type <string> loop_pragma
+%type <token> value_type vector_type
 
 /* Solve IF-ELSE conflict */
 %nonassoc IFX
 %nonassoc TELSE
 
-/* Operator precedence for mathematical operators */
-%left TPLUS TMINUS
-%left TMUL TDIV TMOD
-%nonassoc TCEQ TCNE TCLT TCLE TCGT TCGE
+/* Operator precedence, loosest first, the same as C and rdparser.cpp */
+%right TEQUAL
 %left TOR
 %left TAND
-%nonassoc TNOT
+%left TCEQ TCNE
+%left TCLT TCLE TCGT TCGE
+%left TPLUS TMINUS
+%left TMUL TDIV TMOD
+%right TNOT UMINUS
 
-%left TEQUAL
+/* no shift/reduce or reduce/reduce conflicts: a rule that brings one back (as the parallel for,
+   pragma and vector rules once did through a duplicated error rule) stops the build */
+%expect 0
 
 %define parse.error verbose
+/* yyparse() for whole files, yypush_parse() for input fed token by token */
+%define api.push-pull both
 
 %start program
 
@@ -85,28 +135,51 @@
 program	: comp_unit { programCompUnit = $1; }
 		;
 		
-comp_unit	: var_decl TSEMICOLON { $$ = new NCompUnit(); $$->decls.push_back($1);}
-	  		| func_decl { $$ = new NCompUnit(); $$->decls.push_back($1); }
-	  		| comp_unit var_decl TSEMICOLON { $1->decls.push_back($2); }
-	  		| comp_unit func_decl { $1->decls.push_back($2); }
+comp_unit	: var_decl TSEMICOLON { $$ = new NCompUnit(); emitTopLevelDecl($$, $1); }
+	  		| func_decl { $$ = new NCompUnit(); emitTopLevelDecl($$, $1); }
+	  		| comp_unit var_decl TSEMICOLON { emitTopLevelDecl($1, $2); }
+	  		| comp_unit func_decl { emitTopLevelDecl($1, $2); }
+	  		| extern_decl TSEMICOLON { $$ = new NCompUnit(); emitTopLevelDecl($$, $1); }
+	  		| func_proto { $$ = new NCompUnit(); emitTopLevelDecl($$, $1); }
+	  		| comp_unit extern_decl TSEMICOLON { emitTopLevelDecl($1, $2); }
+	  		| comp_unit func_proto { emitTopLevelDecl($1, $2); }
 	  		;
 
 var_decl	: TCONST TINTTYPE ident TEQUAL expr { $3->type = $2; $$ = new NVarDecl(true, *$3, $5); }
 			| TCONST TFLOATTYPE ident TEQUAL expr { $3->type = $2; $$ = new NVarDecl(true, *$3, $5); }
-			| TINTTYPE ident { $2->type = $1; $$ = new NVarDecl(false, *$2); }
-			| TFLOATTYPE ident { $2->type = $1; $$ = new NVarDecl(false, *$2); }
-			| TINTTYPE ident TEQUAL expr { $2->type = $1; $$ = new NVarDecl(false, *$2, $4); }
-			| TFLOATTYPE ident TEQUAL expr { $2->type = $1; $$ = new NVarDecl(false, *$2, $4); }
+			| value_type ident { $2->type = $1; $$ = new NVarDecl(false, *$2); }
+			| value_type ident TEQUAL expr { $2->type = $1; $$ = new NVarDecl(false, *$2, $4); }
+			;
+
+/* types a variable, a parameter or a return value can have; void is only a return type,
+   and const only takes the scalar types */
+value_type : TINTTYPE | TFLOATTYPE | vector_type
+		   ;
+
+/* SIMD vectors: int4 / int8 hold 32-bit ints, float4 / float8 hold 32-bit floats.
+   Kept apart from value_type because a vector type name also starts a vector literal */
+vector_type : TINT4TYPE | TINT8TYPE | TFLOAT4TYPE | TFLOAT8TYPE
 			;
 
 func_decl : TVOIDTYPE ident TLPAREN func_decl_args TRPAREN block { $2->type = $1; $$ = new NFuncDecl(*$2, *$4, *$6); delete $4; }
-		  | TINTTYPE ident TLPAREN func_decl_args TRPAREN block { $2->type = $1; $$ = new NFuncDecl(*$2, *$4, *$6); delete $4; }
-		  | TFLOATTYPE ident TLPAREN func_decl_args TRPAREN block { $2->type = $1; $$ = new NFuncDecl(*$2, *$4, *$6); delete $4; }
+		  | value_type ident TLPAREN func_decl_args TRPAREN block { $2->type = $1; $$ = new NFuncDecl(*$2, *$4, *$6); delete $4; }
 		  ;
 
+/* 只在顶层出现：定义在别的文件里、链接时才合并进来的函数和全局变量 */
+func_proto : TVOIDTYPE ident TLPAREN func_decl_args TRPAREN TSEMICOLON { $2->type = $1; $$ = newPrototype($2, $4); }
+		   | value_type ident TLPAREN func_decl_args TRPAREN TSEMICOLON { $2->type = $1; $$ = newPrototype($2, $4); }
+		   | TEXTERN func_proto { $$ = $2; }
+		   ;
+
+extern_decl : TEXTERN value_type ident { $3->type = $2; $$ = new NVarDecl(false, *$3); $$->isExtern = true; }
+			;
+
 func_decl_args : /*blank*/  { $$ = new VariableList(); }
-		  | var_decl { $$ = new VariableList(); $$->push_back($1); }
-		  | func_decl_args TCOMMA var_decl { $1->push_back($3); }
+		  | func_decl_list
+		  ;
+
+func_decl_list : var_decl { $$ = new VariableList(); $$->push_back($1); }
+		  | func_decl_list TCOMMA var_decl { $1->push_back($3); }
 		  ;
 
 block : TLBRACE stmts TRBRACE { $$ = $2; }
@@ -114,11 +187,13 @@ block : TLBRACE stmts TRBRACE { $$ = $2; }
 	  | error TRBRACE { yyclearin; yyerrok; }
 	  ;
 
+/* a nested block is a statement with its own scope, also when it comes first.
+   Recovery from an error up to the closing brace goes through block's error rule;
+   a second copy here would be a reduce/reduce conflict on every token that can start a statement */
 stmts : stmt { $$ = new NBlock(); $$->statements.push_back($1); }
-	  | block { $$ = $1; }
+	  | block { $$ = new NBlock(); $$->statements.push_back($1); }
 	  | stmts stmt { $1->statements.push_back($2); }
 	  | stmts block { $$->statements.push_back($2); }
-	  | error TRBRACE { yyclearin; yyerrok; }
 	  ;
 
 stmt : var_decl TSEMICOLON { $$ = $1; }
@@ -127,6 +202,7 @@ stmt : var_decl TSEMICOLON { $$ = $1; }
 	 | TRETURN expr TSEMICOLON { $$ = new NReturnStmt(*$2); }
 	 | ifstmt { $$ = $1; }
 	 | whilestmt { $$ = $1; }
+	 | parallelstmt { $$ = $1; }
 	 | TBREAK TSEMICOLON { $$ = new NBreakStmt(); }
 	 | TCONTINUE TSEMICOLON { $$ = new NContinueStmt(); }
 	 | error TSEMICOLON { yyclearin; yyerrok; }
@@ -142,6 +218,52 @@ ifstmt	: TIF TLPAREN expr TRPAREN block %prec IFX { $$ = new NIfStmt(*$3, *$5);
 
 whilestmt	: TWHILE TLPAREN expr TRPAREN block { $$ = new NWhileStmt(*$3, *$5); }
 			| TWHILE TLPAREN expr TRPAREN stmt { $$ = new NWhileStmt(*$3, *(new NBlock(*$5))); }
+			| loop_pragma whilestmt { $$ = $2; addLoopPragma(static_cast<NWhileStmt*>($2), $1); }
+			;
+
+parallelstmt : TPARALLEL TFOR TLPAREN expr TSEMICOLON expr TSEMICOLON expr TRPAREN reductions block {
+				NParallelFor *loop = new NParallelFor(*$4, *$6, *$8, *$11);
+				loop->reductions = *$10;
+				delete $10;
+				$$ = loop;
+			}
+			;
+
+reductions : /* empty */ { $$ = new std::vector<Reduction>(); }
+		   | reductions TREDUCTION TLPAREN reduction_op TCOLON reduction_vars TRPAREN {
+				for (auto& reduction : *$6) {
+					reduction.op = *$4;
+					$1->push_back(reduction);
+				}
+				delete $4;
+				delete $6;
+			}
+		   ;
+
+reduction_op : TPLUS { $$ = new std::string("+"); }
+			 | TMUL { $$ = new std::string("*"); }
+			 | TIDENTIFIER {
+				if (*$1 != "min" && *$1 != "max") {
+					yyerror("reduction operator must be +, *, min or max");
+				}
+				$$ = $1;
+			}
+			 ;
+
+reduction_vars : TIDENTIFIER { $$ = new std::vector<Reduction>(); $$->push_back({std::string(), *$1}); delete $1; }
+			   | reduction_vars TCOMMA TIDENTIFIER { $1->push_back({std::string(), *$3}); delete $3; }
+			   ;
+
+/* checked while the lexer is still on the next line, so the warning points near the pragma */
+loop_pragma : TPRAGMA {
+				if (LoopHints().parse(*$1)) {
+					$$ = $1;
+				} else {
+					printDiagnostic(stderr, "Warning at line " + std::to_string(lineCount) + ": ignoring unknown pragma: " + *$1 + "\n");
+					delete $1;
+					$$ = NULL;
+				}
+			}
 			;
 
 ident : TIDENTIFIER { $$ = new NIdent(*$1); delete $1; }
@@ -153,6 +275,7 @@ numeric : TINTEGER { $$ = new NInteger($1); }
 	
 expr : ident TEQUAL expr { $$ = new NAssignment(*$1, *$3); }
 	 | ident TLPAREN call_args TRPAREN { $$ = new NMethodCall(*$1, *$3); delete $3; }
+	 | vector_type TLPAREN call_args TRPAREN { $$ = new NMethodCall(*(new NIdent(typeName($1))), *$3); delete $3; }
 	 | ident { $$ = $1; }
 	 | numeric { $$ = $1; }
      | expr TMUL expr { $$ = new NBinaryExpr(*$1, $2, *$3); }
@@ -168,14 +291,17 @@ expr : ident TEQUAL expr { $$ = new NAssignment(*$1, *$3); }
 	 | expr TCGE expr { $$ = new NLogicalBinaryExpr(*$1, $2, *$3); }
 	 | expr TAND expr { $$ = new NLogicalBinaryExpr(*$1, $2, *$3); }
 	 | expr TOR expr { $$ = new NLogicalBinaryExpr(*$1, $2, *$3); }
-	 | TMINUS expr { $$ = new NUnaryExpr($1, *$2); }
+	 | TMINUS expr %prec UMINUS { $$ = new NUnaryExpr($1, *$2); }
 	 | TNOT expr { $$ = new NLogicalUnaryExpr($1, *$2); }
      | TLPAREN expr TRPAREN { $$ = $2; }
 	 ;
 	
 call_args : /*blank*/  { $$ = new ExprList(); }
-		  | expr { $$ = new ExprList(); $$->push_back($1); }
-		  | call_args TCOMMA expr  { $1->push_back($3); }
+		  | call_list
+		  ;
+
+call_list : expr { $$ = new ExprList(); $$->push_back($1); }
+		  | call_list TCOMMA expr  { $1->push_back($3); }
 		  ;
 
 %%
@@ -184,11 +310,29 @@ call_args : /*blank*/  { $$ = new ExprList(); }
 	extern long long lineCount;
 	extern YYSTYPE yylval;
 
-	extern bool hasError;
+	/* set by the language server to collect errors instead of printing them */
+	void (*syntaxErrorHook)(long long line, const char *message) = NULL;
+
+	/* set by the pipelined driver: messages from the parse thread are handed to the code
+	   generation thread and printed there, in declaration order with its own output */
+	void (*diagnosticHook)(FILE *stream, const std::string& text) = NULL;
+
+	/* every error and warning found while lexing or parsing is printed through here */
+	void printDiagnostic(FILE *stream, const std::string& text) {
+		if (diagnosticHook) {
+			diagnosticHook(stream, text);
+			return;
+		}
+		std::fputs(text.c_str(), stream);
+	}
 
 	void yyerror(const char *s) {
 		hasError = true;
-		std::printf("Error at line %lld: %s\n", lineCount, s);
+		if (syntaxErrorHook) {
+			syntaxErrorHook(lineCount, s);
+			return;
+		}
+		printDiagnostic(stdout, "Error at line " + std::to_string(lineCount) + ": " + s + "\n");
 		// yyclearin;
 		// skip until next } or ;
 		/* while (yylex() != 0) {
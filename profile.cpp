@@ -0,0 +1,66 @@
+// profile.cpp
+#include "profile.h"
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <vector>
+
+using namespace llvm;
+
+void instrumentProfile(Module& module) {
+    LLVMContext& context = module.getContext();
+    Type *voidType = Type::getVoidTy(context);
+    Type *idType = Type::getInt32Ty(context);
+    Type *stringType = Type::getInt8PtrTy(context);
+
+    std::vector<Function*> functions;
+    for (Function& function : module) {
+        if (!function.isDeclaration()) {
+            functions.push_back(&function);
+        }
+    }
+    if (functions.empty()) {
+        return;
+    }
+
+    FunctionCallee enter = module.getOrInsertFunction("sysy_profile_enter", voidType, idType);
+    FunctionCallee exit = module.getOrInsertFunction("sysy_profile_exit", voidType);
+    FunctionCallee begin = module.getOrInsertFunction("sysy_profile_begin", voidType,
+        PointerType::getUnqual(stringType), idType);
+    FunctionCallee report = module.getOrInsertFunction("sysy_profile_report", voidType);
+
+    // 函数名表，下标就是函数的编号
+    IRBuilder<> builder(context);
+    std::vector<Constant*> names;
+    for (Function *function : functions) {
+        names.push_back(builder.CreateGlobalStringPtr(function->getName(), "prof.name", 0, &module));
+    }
+    ArrayType *tableType = ArrayType::get(stringType, names.size());
+    GlobalVariable *table = new GlobalVariable(module, tableType, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(tableType, names), "prof.names");
+
+    for (unsigned id = 0; id < functions.size(); id++) {
+        Function *function = functions[id];
+        bool isMain = function->getName() == "main";
+        Value *idValue = ConstantInt::get(idType, id);
+
+        builder.SetInsertPoint(&*function->getEntryBlock().getFirstInsertionPt());
+        if (isMain) {
+            builder.CreateCall(begin, { builder.CreateConstInBoundsGEP2_32(tableType, table, 0, 0), ConstantInt::get(idType, names.size()) });
+        }
+        builder.CreateCall(enter, idValue);
+
+        std::vector<ReturnInst*> returns;
+        for (BasicBlock& block : *function) {
+            if (ReturnInst *ret = dyn_cast_or_null<ReturnInst>(block.getTerminator())) {
+                returns.push_back(ret);
+            }
+        }
+        for (ReturnInst *ret : returns) {
+            builder.SetInsertPoint(ret);
+            builder.CreateCall(exit);
+            if (isMain) {
+                builder.CreateCall(report);
+            }
+        }
+    }
+}
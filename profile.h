@@ -0,0 +1,11 @@
+#pragma once
+
+namespace llvm {
+class Module;
+}
+
+// --profile 的插桩：每个有函数体的函数入口调用 sysy_profile_enter(编号)，
+// 每个 ret 之前调用 sysy_profile_exit()（退出的总是栈顶的帧，不用传编号）；main 入口先用函数名表调用
+// sysy_profile_begin，返回前调用 sysy_profile_report 打印报告。
+// 运行时在 profrt.cpp，JIT 运行时由编译器进程提供，生成目标文件时要一起链接。
+void instrumentProfile(llvm::Module& module);
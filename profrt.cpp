@@ -0,0 +1,210 @@
+// profrt.cpp: --profile 的运行时，由插桩后的代码调用，见 profile.h
+// 只为单线程程序设计：状态都是全局的，入口 / 出口各一次计时和几次数组访问，
+// 调用处换了被调函数时再查一次哈希表。
+// 调用边只记真正出现过的 (调用者, 被调者)，内存随边数而不是函数数的平方增长。
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+// 计时用的刻度：x86 上是 TSC，其他平台是纳秒
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+uint64_t nanoseconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+struct EdgeStats {
+    uint64_t calls = 0;
+    uint64_t total = 0;
+};
+
+struct FunctionStats {
+    uint64_t calls = 0;
+    uint64_t self = 0;      // 不含被调函数的刻度
+    uint64_t total = 0;     // 含被调函数；递归时只算最外层
+    uint32_t active = 0;    // 当前在栈上的帧数
+    // 这个函数上一次调用的函数和那条边：同一处反复调用（循环、递归）时不必查表
+    uint32_t lastCallee = UINT32_MAX;
+    EdgeStats *lastEdge = nullptr;
+};
+
+struct Frame {
+    uint32_t function;
+    uint64_t start;
+    uint64_t children;
+    EdgeStats *edge;        // 调用者到这一帧的边，出口时不用再查
+};
+
+const char **names;
+uint32_t count;
+// 多出的一个编号表示“程序外”，main 的调用者，也用来测插桩开销
+uint32_t outside;
+std::vector<FunctionStats> functions;
+// 键是 caller << 32 | callee；unordered_map 插入时不会让已有元素的指针失效
+std::unordered_map<uint64_t, EdgeStats> edges;
+std::vector<Frame> stack;
+uint64_t startTicks, startNanos;
+
+uint64_t edgeKey(uint32_t caller, uint32_t callee) {
+    return (uint64_t)caller << 32 | callee;
+}
+
+EdgeStats *edge(uint32_t caller, uint32_t callee) {
+    FunctionStats& stats = functions[caller];
+    if (stats.lastCallee != callee) {
+        stats.lastCallee = callee;
+        stats.lastEdge = &edges[edgeKey(caller, callee)];
+    }
+    return stats.lastEdge;
+}
+
+void printEdge(FILE *out, const EdgeStats& e, double nanosPerTick, const char *name) {
+    fprintf(out, "        %12llu %12.3f ms  %s\n", (unsigned long long)e.calls,
+            e.total * nanosPerTick / 1e6, name);
+}
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+} // namespace
+
+extern "C" {
+
+void sysy_profile_begin(const char **functionNames, int32_t functionCount) {
+    names = functionNames;
+    count = functionCount;
+    outside = count;
+    functions.assign(count + 1, FunctionStats());
+    edges.clear();
+    stack.clear();
+    stack.push_back({outside, 0, 0, nullptr});
+    startNanos = nanoseconds();
+    startTicks = ticks();
+}
+
+void sysy_profile_enter(int32_t function) {
+    FunctionStats& stats = functions[function];
+    stats.calls++;
+    stats.active++;
+    EdgeStats *e = edge(stack.back().function, function);
+    e->calls++;
+    stack.push_back({(uint32_t)function, ticks(), 0, e});
+}
+
+void sysy_profile_exit() {
+    uint64_t now = ticks();
+    Frame frame = stack.back();
+    stack.pop_back();
+    uint64_t elapsed = now - frame.start;
+    FunctionStats& stats = functions[frame.function];
+    stats.self += elapsed - std::min(elapsed, frame.children);
+    stack.back().children += elapsed;
+    // 递归时内层帧的时间已包含在最外层帧里，只有最外层才计入累计时间
+    if (--stats.active == 0) {
+        stats.total += elapsed;
+        frame.edge->total += elapsed;
+    }
+}
+
+void sysy_profile_report() {
+    uint64_t elapsedTicks = ticks() - startTicks;
+    uint64_t elapsedNanos = nanoseconds() - startNanos;
+    double nanosPerTick = elapsedTicks ? (double)elapsedNanos / elapsedTicks : 1.0;
+
+    // 用“程序外”这个编号空跑一批入口 / 出口，估计每次调用的插桩开销
+    std::vector<FunctionStats> saved = functions;
+    std::vector<Frame> savedStack = stack;
+    auto probed = edges.find(edgeKey(outside, outside));
+    EdgeStats savedEdge = probed == edges.end() ? EdgeStats() : probed->second;
+    bool hadEdge = probed != edges.end();
+    const int probes = 100000;
+    uint64_t probeStart = ticks();
+    for (int i = 0; i < probes; i++) {
+        sysy_profile_enter(outside);
+        sysy_profile_exit();
+    }
+    double overhead = (double)(ticks() - probeStart) / probes;
+    functions = saved;
+    stack = savedStack;
+    if (hadEdge) {
+        edges[edgeKey(outside, outside)] = savedEdge;
+    } else {
+        // saved 里的缓存不会指向这条边，删掉是安全的
+        edges.erase(edgeKey(outside, outside));
+    }
+
+    uint64_t calls = 0;
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < count; i++) {
+        calls += functions[i].calls;
+        if (functions[i].calls) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) {
+        return functions[a].self > functions[b].self;
+    });
+
+    FILE *out = stderr;
+    fprintf(out, "\n平坦剖析（总计 %.3f ms，%llu 次调用）:\n", elapsedNanos / 1e6, (unsigned long long)calls);
+    fprintf(out, "%7s %12s %12s %12s %14s  %s\n", "self%", "self ms", "total ms", "calls", "self ns/call", "name");
+    for (uint32_t i : order) {
+        const FunctionStats& stats = functions[i];
+        fprintf(out, "%6.2f%% %12.3f %12.3f %12llu %14.1f  %s\n",
+                percent(stats.self, elapsedTicks), stats.self * nanosPerTick / 1e6,
+                stats.total * nanosPerTick / 1e6, (unsigned long long)stats.calls,
+                stats.self * nanosPerTick / stats.calls, names[i]);
+    }
+
+    fprintf(out, "\n调用关系（方括号里的函数上面是它的调用者，下面是它调用的函数；时间是这条边上的累计时间）:\n");
+    fprintf(out, "        %12s %15s\n", "calls", "total ms");
+    // 调用者和被调者都按编号从小到大列出，输出不随哈希表的遍历顺序变化
+    std::vector<std::pair<uint64_t, const EdgeStats*>> sorted;
+    for (auto& entry : edges) {
+        if (entry.second.calls) {
+            sorted.emplace_back(entry.first, &entry.second);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::vector<std::pair<uint32_t, const EdgeStats*>>> callers(count + 1), callees(count + 1);
+    for (auto& entry : sorted) {
+        uint32_t caller = entry.first >> 32, callee = (uint32_t)entry.first;
+        callers[callee].emplace_back(caller, entry.second);
+        callees[caller].emplace_back(callee, entry.second);
+    }
+    for (uint32_t i : order) {
+        for (auto& caller : callers[i]) {
+            printEdge(out, *caller.second, nanosPerTick, caller.first == outside ? "<程序入口>" : names[caller.first]);
+        }
+        fprintf(out, "    [%s]\n", names[i]);
+        for (auto& callee : callees[i]) {
+            printEdge(out, *callee.second, nanosPerTick, names[callee.first]);
+        }
+        fprintf(out, "\n");
+    }
+
+    double cost = overhead * calls;
+    fprintf(out, "插桩开销约 %.1f ns/次调用，合计约 %.3f ms（占 %.2f%%），已计入上面的时间\n",
+            overhead * nanosPerTick, cost * nanosPerTick / 1e6, percent((uint64_t)cost, elapsedTicks));
+}
+
+}
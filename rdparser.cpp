@@ -0,0 +1,808 @@
+// rdparser.cpp
+#include "rdparser.h"
+#include "node.h"
+#include "parser.hpp" // 包含 token 定义
+#include <cstdio>
+#include <string>
+#include <vector>
+
+extern int yylex();
+extern bool hasError;
+extern long long lineCount;
+extern NCompUnit *programCompUnit;
+extern void (*topLevelDeclHook)(NDecl *decl);
+extern bool keepTopLevelDecls;
+void yyerror(const char *s);
+void printDiagnostic(FILE *stream, const std::string& text);
+
+namespace {
+
+// 二元运算符的绑定强度，越大结合越紧，都是左结合；0 表示不是二元运算符
+int infixPower(int token) {
+    switch (token) {
+        case TOR: return 1;
+        case TAND: return 2;
+        case TCEQ: case TCNE: return 3;
+        case TCLT: case TCLE: case TCGT: case TCGE: return 4;
+        case TPLUS: case TMINUS: return 5;
+        case TMUL: case TDIV: case TMOD: return 6;
+    }
+    return 0;
+}
+
+// 前缀 - 和 ! 的操作数只能是更紧的东西：-a * b 是 (-a) * b
+const int PREFIX_POWER = 7;
+
+bool isVectorType(int token) {
+    return token == TINT4TYPE || token == TINT8TYPE || token == TFLOAT4TYPE || token == TFLOAT8TYPE;
+}
+
+bool isArithmetic(int op) {
+    return op == TPLUS || op == TMINUS || op == TMUL || op == TDIV || op == TMOD;
+}
+
+bool isScalarType(int token) {
+    return token == TINTTYPE || token == TFLOATTYPE;
+}
+
+// 与 bison 报错时用的名字相同
+const char *tokenName(int token) {
+    switch (token) {
+#define TOKEN_NAME(t) case t: return #t;
+        TOKEN_NAME(TINTEGER) TOKEN_NAME(TFLOAT) TOKEN_NAME(TIDENTIFIER) TOKEN_NAME(TPRAGMA)
+        TOKEN_NAME(TCEQ) TOKEN_NAME(TCNE) TOKEN_NAME(TCLT) TOKEN_NAME(TCLE) TOKEN_NAME(TCGT)
+        TOKEN_NAME(TCGE) TOKEN_NAME(TEQUAL) TOKEN_NAME(TLPAREN) TOKEN_NAME(TRPAREN)
+        TOKEN_NAME(TLBRACKET) TOKEN_NAME(TRBRACKET) TOKEN_NAME(TLBRACE) TOKEN_NAME(TRBRACE)
+        TOKEN_NAME(TCOMMA) TOKEN_NAME(TSEMICOLON) TOKEN_NAME(TCOLON) TOKEN_NAME(TDOT)
+        TOKEN_NAME(TPLUS) TOKEN_NAME(TMINUS) TOKEN_NAME(TMUL) TOKEN_NAME(TDIV) TOKEN_NAME(TMOD)
+        TOKEN_NAME(TNOT) TOKEN_NAME(TRETURN) TOKEN_NAME(TCONST) TOKEN_NAME(TEXTERN) TOKEN_NAME(TIF)
+        TOKEN_NAME(TELSE) TOKEN_NAME(TWHILE) TOKEN_NAME(TBREAK) TOKEN_NAME(TCONTINUE)
+        TOKEN_NAME(TPARALLEL) TOKEN_NAME(TFOR) TOKEN_NAME(TREDUCTION) TOKEN_NAME(TOR) TOKEN_NAME(TAND)
+        TOKEN_NAME(TINTTYPE) TOKEN_NAME(TFLOATTYPE) TOKEN_NAME(TVOIDTYPE) TOKEN_NAME(TINT4TYPE)
+        TOKEN_NAME(TINT8TYPE) TOKEN_NAME(TFLOAT4TYPE) TOKEN_NAME(TFLOAT8TYPE)
+#undef TOKEN_NAME
+        case 0: return "end of file";
+    }
+    return "invalid token";
+}
+
+NIdent *newIdent(std::string *name) {
+    NIdent *id = new NIdent(*name);
+    delete name;
+    return id;
+}
+
+// 表达式栈上的一项：等右操作数的二元运算、等操作数的前缀运算、等右边的赋值、
+// 等右括号的括号，以及正在收集实参的调用。power 是这一项外面的绑定强度，完成后恢复
+struct ExprFrame {
+    enum Kind { Binary, Prefix, Assign, Paren, Call } kind;
+    int op;
+    int power;
+    Node *node;     // Binary 的左操作数，Assign 的左边，Call 的调用
+};
+
+// 语句栈上的一项：正在收集语句的块，等 then / else 分支或循环体的 if / while，
+// 以及函数体、parallel for 的循环体读完后要交出去的函数和循环
+struct StmtFrame {
+    enum Kind { Block, Then, Else, While, Parallel, Function } kind;
+    NBlock *block;          // Block 收集语句的块，Else 的 then 分支
+    NExpr *condition;       // Then / Else / While
+    NStmt *stmt;            // Parallel 的循环，Function 的函数
+    std::vector<std::string> pragmas;   // While 前面认出的 #pragma，按源码顺序
+};
+
+StmtFrame frame(StmtFrame::Kind kind, NBlock *block, NExpr *condition = NULL, NStmt *stmt = NULL) {
+    return {kind, block, condition, stmt, std::vector<std::string>()};
+}
+
+class Parser {
+public:
+    int parse();
+
+private:
+    int lookahead = -1;     // 已经读入、还没用掉的 token，-1 表示没有
+    YYSTYPE value;          // 它的语义值
+    bool failed = false;    // 刚报告了语法错误，还没有恢复
+    // 两个栈在整次分析中反复使用，不为每个表达式、每个函数重新分配
+    std::vector<ExprFrame> exprs;
+    std::vector<StmtFrame> stmts;
+
+    // 只在需要时才向词法分析器要下一个 token：声明读完时不会多读，流式编译不必等下一行
+    int peek() {
+        if (lookahead < 0) {
+            lookahead = yylex();
+            value = yylval;
+        }
+        return lookahead;
+    }
+
+    // 用掉向前看的 token，返回它的语义值
+    YYSTYPE next() {
+        peek();
+        lookahead = -1;
+        return value;
+    }
+
+    bool accept(int token) {
+        if (peek() != token) {
+            return false;
+        }
+        next();
+        return true;
+    }
+
+    bool expect(int token) {
+        if (accept(token)) {
+            return true;
+        }
+        syntaxError(token);
+        return false;
+    }
+
+    void syntaxError(int expected = -1, int alternative = -1);
+    void discard();
+    bool recover();
+    NExpr *dropExprs(size_t base, NExpr *operand);
+    void dropStmts(size_t base);
+    int abandon(NCompUnit *unit);
+    void emit(NCompUnit *unit, NDecl *decl);
+
+    NExpr *parseExpr(int vectorType = 0);
+    NVarDecl *parseVarDeclRest(bool isConst, NIdent *id);
+    NVarDecl *parseParameter();
+    bool parseParameters(VariableList& arguments);
+    NDecl *parseDeclaration(bool topLevel, int type, bool& hasBody);
+    NStmt *parseStatement();
+    bool parseReductions(NParallelFor& loop);
+    NFuncDecl *parseFunctionBody(NFuncDecl *func);
+};
+
+// 与 bison 的 parse.error verbose 格式相同
+void Parser::syntaxError(int expected, int alternative) {
+    std::string message = std::string("syntax error, unexpected ") + tokenName(peek());
+    if (expected >= 0) {
+        message += std::string(", expecting ") + tokenName(expected);
+        if (alternative >= 0) {
+            message += std::string(" or ") + tokenName(alternative);
+        }
+    }
+    yyerror(message.c_str());
+    failed = true;
+}
+
+// 丢掉向前看的 token 和它带的字符串
+void Parser::discard() {
+    int token = peek();
+    YYSTYPE dropped = next();
+    if (token == TIDENTIFIER || token == TPRAGMA) {
+        delete dropped.string;
+    }
+}
+
+// 出错时释放表达式栈上 base 以上各项已经建好的节点和手里的操作数，返回 NULL
+NExpr *Parser::dropExprs(size_t base, NExpr *operand) {
+    for (size_t i = base; i < exprs.size(); i++) {
+        Node::deleteTree(exprs[i].node);
+    }
+    exprs.resize(base);
+    Node::deleteTree(operand);
+    return NULL;
+}
+
+// 出错时释放语句栈上 base 以上各项还没接到树上的节点：条件、读完了的 then 分支、
+// 嵌套的块、等语句体的循环和函数。函数体和 parallel for 的循环体建节点时已经接在
+// 下面那一项的节点上，随它一起释放
+void Parser::dropStmts(size_t base) {
+    for (size_t i = stmts.size(); i-- > base; ) {
+        StmtFrame& top = stmts[i];
+        switch (top.kind) {
+            case StmtFrame::Block:
+                if (i == 0 || (stmts[i - 1].kind != StmtFrame::Function && stmts[i - 1].kind != StmtFrame::Parallel)) {
+                    Node::deleteTree(top.block);
+                }
+                break;
+            case StmtFrame::Else:
+                Node::deleteTree(top.block);
+                // fall through
+            case StmtFrame::Then:
+            case StmtFrame::While:
+                Node::deleteTree(top.condition);
+                break;
+            case StmtFrame::Parallel:
+            case StmtFrame::Function:
+                Node::deleteTree(top.stmt);
+                break;
+        }
+    }
+    stmts.resize(base, frame(StmtFrame::Block, NULL));
+}
+
+// 函数体里出错后跳到下一个 ; 或 }，与 parser.y 里 error TSEMICOLON / error TRBRACE 的恢复相当：
+// ; 被丢掉，} 留给最内层的块结束自己；没读完的 if、while 随之放弃并释放。
+// 到了文件末尾时返回 false
+bool Parser::recover() {
+    failed = false;
+    dropExprs(0, NULL);
+    for (;;) {
+        int token = peek();
+        if (token == 0) {
+            return false;
+        }
+        if (token == TRBRACE) {
+            break;
+        }
+        discard();
+        if (token == TSEMICOLON) {
+            break;
+        }
+    }
+    size_t block = stmts.size();
+    while (stmts[block - 1].kind != StmtFrame::Block) {
+        block--;
+    }
+    dropStmts(block);
+    return true;
+}
+
+void Parser::emit(NCompUnit *unit, NDecl *decl) {
+    if (keepTopLevelDecls) {
+        unit->decls.push_back(decl);
+    }
+    // 出过错的文件里后面的声明也不再交出去，与 parser.y 的 emitTopLevelDecl 相同
+    if (topLevelDeclHook && !hasError) {
+        topLevelDeclHook(decl);
+    }
+}
+
+// Pratt 分析：前缀位置读操作数，中缀位置比较运算符的绑定强度与当前的下限，
+// 更紧就压栈去读右操作数，否则用手里的操作数完成栈顶的一项。
+// vectorType 不为 0 时调用者已经读了表达式开头的向量类型名
+NExpr *Parser::parseExpr(int vectorType) {
+    size_t base = exprs.size();
+    int power = 0;
+    NExpr *operand = NULL;
+    for (;;) {
+        if (!operand) {
+            int token = vectorType ? vectorType : peek();
+            NMethodCall *call = NULL;
+            if (token == TMINUS || token == TNOT) {
+                next();
+                exprs.push_back({ExprFrame::Prefix, token, power, NULL});
+                power = PREFIX_POWER;
+                continue;
+            }
+            else if (token == TLPAREN) {
+                next();
+                exprs.push_back({ExprFrame::Paren, 0, power, NULL});
+                power = 0;
+                continue;
+            }
+            else if (token == TINTEGER) {
+                operand = new NInteger(next().number_int);
+            }
+            else if (token == TFLOAT) {
+                operand = new NFloat(next().number_float);
+            }
+            else if (token == TIDENTIFIER) {
+                NIdent *id = newIdent(next().string);
+                // 赋值的左边只能是名字，右边是完整的表达式：a + b = c 是 a + (b = c)
+                if (accept(TEQUAL)) {
+                    exprs.push_back({ExprFrame::Assign, 0, power, id});
+                    power = 0;
+                    continue;
+                }
+                if (accept(TLPAREN)) {
+                    call = new NMethodCall(*id);
+                }
+                else {
+                    operand = id;
+                }
+            }
+            else if (isVectorType(token)) {
+                // 向量的构造：int4(a, b, c, d)
+                if (vectorType) {
+                    vectorType = 0;
+                }
+                else {
+                    next();
+                }
+                if (!expect(TLPAREN)) {
+                    return dropExprs(base, NULL);
+                }
+                call = new NMethodCall(*new NIdent(typeName(token)));
+            }
+            else {
+                syntaxError();
+                return dropExprs(base, NULL);
+            }
+            if (call) {
+                if (accept(TRPAREN)) {
+                    operand = call;
+                }
+                else {
+                    exprs.push_back({ExprFrame::Call, 0, power, call});
+                    power = 0;
+                    continue;
+                }
+            }
+        }
+
+        int op = peek();
+        int opPower = infixPower(op);
+        if (opPower > power) {
+            next();
+            exprs.push_back({ExprFrame::Binary, op, power, operand});
+            power = opPower;
+            operand = NULL;
+            continue;
+        }
+        if (exprs.size() == base) {
+            return operand;
+        }
+        ExprFrame top = exprs.back();
+        switch (top.kind) {
+            case ExprFrame::Binary: {
+                NExpr& lhs = *static_cast<NExpr*>(top.node);
+                if (isArithmetic(top.op)) {
+                    operand = new NBinaryExpr(lhs, top.op, *operand);
+                }
+                else {
+                    operand = new NLogicalBinaryExpr(lhs, top.op, *operand);
+                }
+                break;
+            }
+            case ExprFrame::Prefix:
+                if (top.op == TMINUS) {
+                    operand = new NUnaryExpr(top.op, *operand);
+                }
+                else {
+                    operand = new NLogicalUnaryExpr(top.op, *operand);
+                }
+                break;
+            case ExprFrame::Assign:
+                operand = new NAssignment(*static_cast<NIdent*>(top.node), *operand);
+                break;
+            case ExprFrame::Paren:
+                if (!expect(TRPAREN)) {
+                    return dropExprs(base, operand);
+                }
+                break;
+            case ExprFrame::Call: {
+                NMethodCall *call = static_cast<NMethodCall*>(top.node);
+                call->arguments.push_back(operand);
+                if (accept(TCOMMA)) {
+                    operand = NULL;
+                    power = 0;
+                    continue;
+                }
+                if (!expect(TRPAREN)) {
+                    // 实参已经接在调用上，随栈上的调用一起释放
+                    return dropExprs(base, NULL);
+                }
+                operand = call;
+                break;
+            }
+        }
+        exprs.pop_back();
+        power = top.power;
+    }
+}
+
+// 变量名之后的部分：const 必须有初值，其余的初值可有可无。出错时 id 也已释放
+NVarDecl *Parser::parseVarDeclRest(bool isConst, NIdent *id) {
+    if (isConst && !expect(TEQUAL)) {
+        delete id;
+        return NULL;
+    }
+    if (isConst || accept(TEQUAL)) {
+        NExpr *init = parseExpr();
+        if (!init) {
+            delete id;
+            return NULL;
+        }
+        return new NVarDecl(isConst, *id, init);
+    }
+    return new NVarDecl(false, *id);
+}
+
+// 形参与变量声明的写法相同（parser.y 的 func_decl_args 由 var_decl 组成）
+NVarDecl *Parser::parseParameter() {
+    bool isConst = accept(TCONST);
+    int type = peek();
+    if (!(isScalarType(type) || (!isConst && isVectorType(type)))) {
+        syntaxError();
+        return NULL;
+    }
+    next();
+    if (peek() != TIDENTIFIER) {
+        syntaxError(TIDENTIFIER);
+        return NULL;
+    }
+    NIdent *id = newIdent(next().string);
+    id->type = type;
+    return parseVarDeclRest(isConst, id);
+}
+
+// 读到 ( 之后，直到 ) 为止
+bool Parser::parseParameters(VariableList& arguments) {
+    if (accept(TRPAREN)) {
+        return true;
+    }
+    do {
+        NVarDecl *argument = parseParameter();
+        if (!argument) {
+            return false;
+        }
+        arguments.push_back(argument);
+    } while (accept(TCOMMA));
+    return expect(TRPAREN);
+}
+
+// 以 extern、const 或类型名开头的声明。变量声明和函数原型连同结尾的分号一起读完；
+// 函数定义读到 { 为止，hasBody 置为 true，函数体由调用者读。
+// type 不为 0 时调用者已经读了类型名；extern 和原型只能出现在顶层
+NDecl *Parser::parseDeclaration(bool topLevel, int type, bool& hasBody) {
+    hasBody = false;
+    int externs = 0;
+    bool isConst = false;
+    if (!type) {
+        // parser.y 里 func_proto 可以带任意多个 extern，变量只能带一个
+        while (topLevel && accept(TEXTERN)) {
+            externs++;
+        }
+        isConst = !externs && accept(TCONST);
+        type = peek();
+        bool valid = isConst ? isScalarType(type)
+                             : isScalarType(type) || isVectorType(type) || type == TVOIDTYPE;
+        if (!valid) {
+            syntaxError();
+            return NULL;
+        }
+        next();
+    }
+    if (peek() != TIDENTIFIER) {
+        syntaxError(TIDENTIFIER);
+        return NULL;
+    }
+    NIdent *id = newIdent(next().string);
+    id->type = type;
+
+    if (!isConst && accept(TLPAREN)) {
+        // 参数直接放进函数节点；原型的函数体留空，与 parser.y 的 newPrototype 相同
+        NFuncDecl *func = new NFuncDecl(*id, VariableList(), *new NBlock());
+        if (!parseParameters(func->arguments)) {
+            Node::deleteTree(func);
+            return NULL;
+        }
+        if (topLevel && accept(TSEMICOLON)) {
+            func->isPrototype = true;
+            return func;
+        }
+        if (externs) {
+            syntaxError(TSEMICOLON);
+            Node::deleteTree(func);
+            return NULL;
+        }
+        if (peek() != TLBRACE) {
+            topLevel ? syntaxError(TLBRACE, TSEMICOLON) : syntaxError(TLBRACE);
+            Node::deleteTree(func);
+            return NULL;
+        }
+        next();
+        hasBody = true;
+        return func;
+    }
+    if (type == TVOIDTYPE || externs > 1) {
+        syntaxError(TLPAREN);
+        delete id;
+        return NULL;
+    }
+    NVarDecl *decl;
+    if (externs) {
+        decl = new NVarDecl(false, *id);
+        decl->isExtern = true;
+    }
+    else if (!(decl = parseVarDeclRest(isConst, id))) {
+        return NULL;
+    }
+    if (!expect(TSEMICOLON)) {
+        Node::deleteTree(decl);
+        return NULL;
+    }
+    return decl;
+}
+
+// parallel for 头部之后零个或多个 reduction(op: a, b)，直接加到循环上
+bool Parser::parseReductions(NParallelFor& loop) {
+    while (accept(TREDUCTION)) {
+        if (!expect(TLPAREN)) {
+            return false;
+        }
+        std::string op;
+        int token = peek();
+        if (token == TPLUS || token == TMUL) {
+            next();
+            op = token == TPLUS ? "+" : "*";
+        }
+        else if (token == TIDENTIFIER) {
+            std::string *name = next().string;
+            op = *name;
+            delete name;
+            if (op != "min" && op != "max") {
+                yyerror("reduction operator must be +, *, min or max");
+            }
+        }
+        else {
+            syntaxError();
+            return false;
+        }
+        if (!expect(TCOLON)) {
+            return false;
+        }
+        do {
+            if (peek() != TIDENTIFIER) {
+                syntaxError(TIDENTIFIER);
+                return false;
+            }
+            std::string *name = next().string;
+            loop.reductions.push_back({op, *name});
+            delete name;
+        } while (accept(TCOMMA));
+        if (!expect(TRPAREN)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 读一条语句。简单语句读完直接返回；if、while、parallel for 和嵌套的函数定义
+// 读完头部后把自己压进语句栈等语句体，返回 NULL。出错时返回 NULL 并置 failed，
+// 已经建好的节点都已释放
+NStmt *Parser::parseStatement() {
+    int token = peek();
+    switch (token) {
+        case TINT4TYPE: case TINT8TYPE: case TFLOAT4TYPE: case TFLOAT8TYPE:
+            next();
+            if (peek() == TLPAREN) {
+                NExpr *expr = parseExpr(token);
+                if (!expr || !expect(TSEMICOLON)) {
+                    Node::deleteTree(expr);
+                    return NULL;
+                }
+                return new NExprStmt(*expr);
+            }
+            // fall through
+        case TCONST: case TINTTYPE: case TFLOATTYPE: case TVOIDTYPE: {
+            bool hasBody;
+            NDecl *decl = parseDeclaration(false, isVectorType(token) ? token : 0, hasBody);
+            if (decl && hasBody) {
+                NFuncDecl *func = static_cast<NFuncDecl*>(decl);
+                stmts.push_back(frame(StmtFrame::Function, NULL, NULL, func));
+                stmts.push_back(frame(StmtFrame::Block, &func->block));
+                return NULL;
+            }
+            return decl;
+        }
+        case TRETURN: {
+            next();
+            NExpr *expr = parseExpr();
+            if (!expr || !expect(TSEMICOLON)) {
+                Node::deleteTree(expr);
+                return NULL;
+            }
+            return new NReturnStmt(*expr);
+        }
+        case TBREAK:
+            next();
+            return expect(TSEMICOLON) ? new NBreakStmt() : NULL;
+        case TCONTINUE:
+            next();
+            return expect(TSEMICOLON) ? new NContinueStmt() : NULL;
+        case TIF: {
+            next();
+            NExpr *condition = NULL;
+            if (!expect(TLPAREN) || !(condition = parseExpr()) || !expect(TRPAREN)) {
+                Node::deleteTree(condition);
+                return NULL;
+            }
+            stmts.push_back(frame(StmtFrame::Then, NULL, condition));
+            return NULL;
+        }
+        case TPRAGMA:
+        case TWHILE: {
+            StmtFrame loop = frame(StmtFrame::While, NULL);
+            while (peek() == TPRAGMA) {
+                // 趁词法分析器还在下一行之前检查，警告的行号就是 #pragma 所在的行
+                std::string *pragma = next().string;
+                if (LoopHints().parse(*pragma)) {
+                    loop.pragmas.push_back(*pragma);
+                }
+                else {
+                    printDiagnostic(stderr, "Warning at line " + std::to_string(lineCount) + ": ignoring unknown pragma: " + *pragma + "\n");
+                }
+                delete pragma;
+            }
+            if (!expect(TWHILE) || !expect(TLPAREN) || !(loop.condition = parseExpr()) || !expect(TRPAREN)) {
+                Node::deleteTree(loop.condition);
+                return NULL;
+            }
+            stmts.push_back(std::move(loop));
+            return NULL;
+        }
+        case TPARALLEL: {
+            next();
+            NExpr *init = NULL, *condition = NULL, *step = NULL;
+            if (!expect(TFOR) || !expect(TLPAREN) ||
+                !(init = parseExpr()) || !expect(TSEMICOLON) ||
+                !(condition = parseExpr()) || !expect(TSEMICOLON) ||
+                !(step = parseExpr()) || !expect(TRPAREN)) {
+                Node::deleteTree(init);
+                Node::deleteTree(condition);
+                Node::deleteTree(step);
+                return NULL;
+            }
+            NBlock *body = new NBlock();
+            NParallelFor *loop = new NParallelFor(*init, *condition, *step, *body);
+            if (!parseReductions(*loop) || !expect(TLBRACE)) {
+                Node::deleteTree(loop);
+                return NULL;
+            }
+            stmts.push_back(frame(StmtFrame::Parallel, NULL, NULL, loop));
+            stmts.push_back(frame(StmtFrame::Block, body));
+            return NULL;
+        }
+        default: {
+            NExpr *expr = parseExpr();
+            if (!expr || !expect(TSEMICOLON)) {
+                Node::deleteTree(expr);
+                return NULL;
+            }
+            return new NExprStmt(*expr);
+        }
+    }
+}
+
+// 读到函数体的 { 之后，直到与之配对的 }。嵌套的块、分支、循环体和函数都在语句栈上，
+// 一个结构读完就交给栈里外面一层；整个函数读完时栈为空。只在文件提前结束时返回 NULL，
+// 这时 func 和栈上没读完的部分都已释放
+NFuncDecl *Parser::parseFunctionBody(NFuncDecl *func) {
+    stmts.clear();
+    stmts.push_back(frame(StmtFrame::Function, NULL, NULL, func));
+    stmts.push_back(frame(StmtFrame::Block, &func->block));
+    for (;;) {
+        NStmt *done = NULL;
+        bool isBlock = false;
+        if (stmts.back().kind == StmtFrame::Block) {
+            int token = peek();
+            if (token == TRBRACE) {
+                next();
+                done = stmts.back().block;
+                isBlock = true;
+                stmts.pop_back();
+            }
+            else if (token == TLBRACE) {
+                next();
+                stmts.push_back(frame(StmtFrame::Block, new NBlock()));
+                continue;
+            }
+            else if (token == 0) {
+                syntaxError();
+                dropStmts(0);
+                return NULL;
+            }
+            else {
+                done = parseStatement();
+            }
+        }
+        // 分支和 while 的循环体可以是块，也可以是单条语句
+        else if (accept(TLBRACE)) {
+            stmts.push_back(frame(StmtFrame::Block, new NBlock()));
+            continue;
+        }
+        else {
+            done = parseStatement();
+        }
+        if (failed) {
+            if (!recover()) {
+                dropStmts(0);
+                return NULL;
+            }
+            continue;
+        }
+
+        // 逐层向外交：块收下语句，if / while 收下语句体后自己也读完了
+        while (done) {
+            StmtFrame& top = stmts.back();
+            NBlock *body = NULL;
+            if (top.kind == StmtFrame::Then || top.kind == StmtFrame::Else || top.kind == StmtFrame::While) {
+                body = isBlock ? static_cast<NBlock*>(done) : new NBlock(*done);
+            }
+            switch (top.kind) {
+                case StmtFrame::Block:
+                    top.block->statements.push_back(done);
+                    done = NULL;
+                    break;
+                case StmtFrame::Then:
+                    // 悬空的 else 属于最近的 if
+                    if (accept(TELSE)) {
+                        top.kind = StmtFrame::Else;
+                        top.block = body;
+                        done = NULL;
+                        break;
+                    }
+                    done = new NIfStmt(*top.condition, *body);
+                    stmts.pop_back();
+                    break;
+                case StmtFrame::Else:
+                    done = new NIfStmt(*top.condition, *top.block, *body);
+                    stmts.pop_back();
+                    break;
+                case StmtFrame::While: {
+                    NWhileStmt *loop = new NWhileStmt(*top.condition, *body);
+                    // parser.y 里 #pragma 由内向外归约，后面的先解析，这里保持同样的覆盖顺序
+                    for (size_t i = top.pragmas.size(); i-- > 0; ) {
+                        loop->hints.parse(top.pragmas[i]);
+                    }
+                    loop->pragmas.swap(top.pragmas);
+                    done = loop;
+                    stmts.pop_back();
+                    break;
+                }
+                case StmtFrame::Parallel:
+                case StmtFrame::Function:
+                    // 读完的是循环体或函数体，它们在建节点时已经接上
+                    done = top.stmt;
+                    stmts.pop_back();
+                    if (stmts.empty()) {
+                        return func;
+                    }
+                    break;
+            }
+            isBlock = false;
+        }
+    }
+}
+
+// 顶层出错时放弃：没读完的声明已经释放，向前看的标识符也不再留着；
+// 已经读完的声明照样放进 programCompUnit，由调用者决定是否释放
+int Parser::abandon(NCompUnit *unit) {
+    if (peek() != 0) {
+        discard();
+    }
+    programCompUnit = unit;
+    return 1;
+}
+
+int Parser::parse() {
+    NCompUnit *unit = NULL;
+    do {
+        int token = peek();
+        if (unit && !(token == TEXTERN || token == TCONST || token == TVOIDTYPE ||
+                      isScalarType(token) || isVectorType(token))) {
+            syntaxError(0);
+            return abandon(unit);
+        }
+        bool hasBody = false;
+        NDecl *decl = parseDeclaration(true, 0, hasBody);
+        if (decl && hasBody) {
+            decl = parseFunctionBody(static_cast<NFuncDecl*>(decl));
+        }
+        // 顶层没有错误恢复，与 parser.y 相同
+        if (!decl) {
+            return abandon(unit);
+        }
+        if (!unit) {
+            unit = new NCompUnit();
+        }
+        emit(unit, decl);
+    } while (peek() != 0);
+    programCompUnit = unit;
+    return 0;
+}
+
+} // namespace
+
+int rdParse() {
+    Parser parser;
+    return parser.parse();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// 手写的递归下降语法分析器，默认代替 bison 生成的 yyparse（--bison 换回去对比）。
+//
+// 接受的语言和建出的语法树与 parser.y 相同，节点直接建在 node.h 的类里，
+// 参数表和实参直接放进 NFuncDecl / NMethodCall，不经过中间的 VariableList / ExprList。
+// 表达式按 Pratt 的方法用绑定强度表处理优先级，与 C 相同，从松到紧依次是
+//   =（右结合）  ||  &&  == !=  < <= > >=  + -  * / %  前缀 - !
+// 下降的递归都换成了显式栈（与 print / codeGen 相同），10^6 层的嵌套也不会爆栈。
+//
+// 与 yyparse 的约定一样：整个文件的结果放在 programCompUnit，每个顶层声明一读完就交给
+// topLevelDeclHook（不多读下一个 token，--stream 下照样边读边编译），错误经 yyerror 报告。
+// 函数体里出错后跳过到下一个 ; 或 } 继续分析，顶层出错时放弃。成功返回 0，放弃返回 1。
+// 出错的语句和没读完的声明建出的节点都会释放；放弃时已经读完的声明仍在 programCompUnit
+// 里（可能为 NULL），它们是完整的树，调用者可以用 Node::deleteTree 释放。
+int rdParse();
@@ -0,0 +1,92 @@
+// reach.cpp
+#include "reach.h"
+#include "flatast.h"
+#include <algorithm>
+
+// 把 [begin, end) 这一段节点里引用到的名字（标识符、被调用的函数和 reduction 变量）
+// 的 names 下标追加到 refs。节点按先序编号，一棵子树正好是连续的一段，顺序扫过即可
+static void collectReferences(const FlatAST& ast, uint32_t begin, uint32_t end, std::vector<uint32_t>& refs) {
+    // 局部变量声明自己的名字不算引用，它是声明节点之后紧跟的那个 Ident
+    uint32_t declared = FlatNone;
+    for (uint32_t n = begin; n < end; n++) {
+        switch (ast.kind[n]) {
+            case FlatKind::Ident:
+                if (n != declared) {
+                    refs.push_back(ast.a[n]);
+                }
+                break;
+            case FlatKind::VarDecl:
+                declared = ast.a[n];
+                break;
+            case FlatKind::ParallelFor:
+                if (ast.c[n] != FlatNone) {
+                    for (uint32_t i = 1; i < ast.listCount(ast.c[n]); i += 2) {
+                        refs.push_back(ast.listItem(ast.c[n], i));
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+std::vector<uint32_t> reachableDecls(const FlatAST& ast) {
+    uint32_t list = ast.a[ast.root];
+    uint32_t count = ast.listCount(list);
+    // 同名的顶层声明可能不止一个，都算可达；名字已经在 names 里去重，按下标分组
+    std::vector<std::vector<uint32_t> > byName(ast.names.size());
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t decl = ast.listItem(list, i);
+        if (ast.kind[decl] == FlatKind::FuncDecl || ast.kind[decl] == FlatKind::VarDecl) {
+            byName[ast.a[ast.a[decl]]].push_back(i);
+        }
+    }
+    std::vector<uint32_t> all(count);
+    for (uint32_t i = 0; i < count; i++) {
+        all[i] = i;
+    }
+    auto main = std::find(ast.names.begin(), ast.names.end(), "main");
+    if (main == ast.names.end() || byName[main - ast.names.begin()].empty()) {
+        return all;
+    }
+
+    std::vector<bool> reached(count, false);
+    std::vector<uint32_t> work;
+    for (uint32_t i : byName[main - ast.names.begin()]) {
+        reached[i] = true;
+        work.push_back(i);
+    }
+    std::vector<uint32_t> refs;
+    while (!work.empty()) {
+        uint32_t i = work.back();
+        work.pop_back();
+        uint32_t decl = ast.listItem(list, i);
+        uint32_t end = i + 1 < count ? ast.listItem(list, i + 1) : ast.size();
+        // 声明自身的名字和函数的形参不算引用：函数只看函数体，变量只看初始化表达式
+        uint32_t begin = FlatNone;
+        if (ast.kind[decl] == FlatKind::FuncDecl || ast.kind[decl] == FlatKind::VarDecl) {
+            begin = ast.b[decl];
+        }
+        refs.clear();
+        if (begin != FlatNone) {
+            collectReferences(ast, begin, end, refs);
+        }
+        for (uint32_t name : refs) {
+            for (uint32_t j : byName[name]) {
+                if (!reached[j]) {
+                    reached[j] = true;
+                    work.push_back(j);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < count; i++) {
+        if (reached[i]) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
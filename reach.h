@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class FlatAST;
+
+// 从 main 出发沿函数调用和全局变量引用求可达的顶层声明，按源文件顺序返回。
+// 局部变量与全局变量同名时也按引用了全局变量处理，结果只会多留不会漏。
+// 文件中没有 main 时无从判断，返回全部声明。
+// 在扁平 AST（flatast.h）上求，返回可达的顶层声明在 CompUnit 声明列表里的位置
+std::vector<uint32_t> reachableDecls(const FlatAST& ast);
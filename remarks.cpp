@@ -0,0 +1,194 @@
+// remarks.cpp
+#include "remarks.h"
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <llvm/IR/DiagnosticHandler.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+// 汇总里每类没做的优化最多列出几个函数
+static const size_t SUMMARY_FUNCTIONS = 3;
+
+// 接在 LLVMContext 上的诊断处理器：优化备注记进 RemarkLog 并吞掉，
+// 其余诊断返回 false，交还 LLVM 按默认方式打印
+class RemarkLog::Handler : public DiagnosticHandler {
+public:
+    explicit Handler(RemarkLog& log) : log(log) { }
+
+    bool handleDiagnostics(const DiagnosticInfo& info) override {
+        RemarkLog::Kind kind;
+        if (isa<OptimizationRemark>(info)) {
+            kind = RemarkLog::Passed;
+        } else if (isa<OptimizationRemarkMissed>(info)) {
+            kind = RemarkLog::Missed;
+        } else if (isa<OptimizationRemarkAnalysis>(info) || isa<OptimizationRemarkAnalysisFPCommute>(info) ||
+                   isa<OptimizationRemarkAnalysisAliasing>(info)) {
+            kind = RemarkLog::Analysis;
+        } else {
+            return false;
+        }
+        auto& remark = cast<DiagnosticInfoIROptimization>(info);
+        if (!log.wanted(remark.getPassName())) {
+            return true;
+        }
+        RemarkLog::Remark entry;
+        entry.kind = kind;
+        entry.pass = remark.getPassName().str();
+        entry.name = remark.getRemarkName().str();
+        for (const DiagnosticInfoOptimizationBase::Argument& arg : remark.getArgs()) {
+            entry.message += arg.Val;
+            if (arg.Key == "String") {
+                entry.pattern += arg.Val;
+            } else {
+                entry.pattern += "<" + arg.Key + ">";
+                entry.args.emplace_back(arg.Key, arg.Val);
+            }
+        }
+        log.functions[remark.getFunction().getName().str()].push_back(std::move(entry));
+        return true;
+    }
+
+    bool isAnalysisRemarkEnabled(StringRef pass) const override { return log.wanted(pass); }
+    bool isMissedOptRemarkEnabled(StringRef pass) const override { return log.wanted(pass); }
+    bool isPassedOptRemarkEnabled(StringRef pass) const override { return log.wanted(pass); }
+    bool isAnyRemarkEnabled() const override { return true; }
+
+private:
+    RemarkLog& log;
+};
+
+RemarkLog::RemarkLog(const std::string& passes) : filter(passes), passes(passes) { }
+
+bool RemarkLog::valid(std::string& error) const {
+    return filter.empty() || passes.isValid(error);
+}
+
+bool RemarkLog::wanted(StringRef pass) const {
+    return filter.empty() || passes.match(pass);
+}
+
+std::unique_ptr<DiagnosticHandler> RemarkLog::handler() {
+    return std::unique_ptr<DiagnosticHandler>(new Handler(*this));
+}
+
+static const char *kindName(RemarkLog::Kind kind) {
+    switch (kind) {
+        case RemarkLog::Passed: return "Passed";
+        case RemarkLog::Missed: return "Missed";
+        default: return "Analysis";
+    }
+}
+
+// YAML 的双引号字符串：函数名和说明里可能有冒号、引号等有特殊含义的字符
+static std::string quote(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void RemarkLog::writeYAML(std::ostream& out) const {
+    for (auto& function : functions) {
+        out << quote(function.first) << ":\n";
+        for (const Remark& remark : function.second) {
+            out << "  - Kind: " << kindName(remark.kind) << "\n"
+                << "    Pass: " << quote(remark.pass) << "\n"
+                << "    Name: " << quote(remark.name) << "\n"
+                << "    Message: " << quote(remark.message) << "\n";
+            if (!remark.args.empty()) {
+                out << "    Args:\n";
+                for (auto& arg : remark.args) {
+                    out << "      " << quote(arg.first) << ": " << quote(arg.second) << "\n";
+                }
+            }
+        }
+    }
+}
+
+void RemarkLog::writeJSON(std::ostream& out) const {
+    json::Object root;
+    for (auto& function : functions) {
+        json::Array remarks;
+        for (const Remark& remark : function.second) {
+            json::Object args;
+            for (auto& arg : remark.args) {
+                args[arg.first] = arg.second;
+            }
+            remarks.push_back(json::Object{
+                {"kind", kindName(remark.kind)},
+                {"pass", remark.pass},
+                {"name", remark.name},
+                {"message", remark.message},
+                {"args", std::move(args)}});
+        }
+        root[function.first] = std::move(remarks);
+    }
+    std::string text;
+    raw_string_ostream stream(text);
+    stream << formatv("{0:2}", json::Value(std::move(root))) << "\n";
+    stream.flush();
+    out << text;
+}
+
+void RemarkLog::printSummary(std::ostream& out) const {
+    // 同一个 pass 的同一种说明算一类，记下出现次数和涉及的函数
+    struct Group {
+        size_t count = 0;
+        std::set<std::string> functions;
+    };
+    std::map<std::pair<std::string, std::string>, Group> groups;
+    size_t counts[3] = {0, 0, 0};
+    for (auto& function : functions) {
+        for (const Remark& remark : function.second) {
+            counts[remark.kind]++;
+            if (remark.kind == Missed) {
+                Group& group = groups[{remark.pass, remark.pattern}];
+                group.count++;
+                group.functions.insert(function.first);
+            }
+        }
+    }
+    out << "optimization remarks: " << counts[Passed] << " passed, " << counts[Missed] << " missed, "
+        << counts[Analysis] << " analysis in " << functions.size() << " functions\n";
+    if (groups.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<std::pair<std::string, std::string>, Group>> sorted(groups.begin(), groups.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<std::pair<std::string, std::string>, Group>& a,
+                                                      const std::pair<std::pair<std::string, std::string>, Group>& b) {
+        return a.second.count > b.second.count;
+    });
+    out << "\nmissed optimizations by frequency\n";
+    out << std::right << std::setw(8) << "count" << std::setw(11) << "functions" << "  "
+        << std::left << std::setw(20) << "pass" << "remark\n";
+    for (auto& entry : sorted) {
+        const Group& group = entry.second;
+        out << std::right << std::setw(8) << group.count << std::setw(11) << group.functions.size() << "  "
+            << std::left << std::setw(20) << entry.first.first << entry.first.second << "\n";
+        out << std::setw(41) << "" << "in ";
+        size_t listed = 0;
+        for (auto& name : group.functions) {
+            if (listed == SUMMARY_FUNCTIONS) {
+                out << ", ...";
+                break;
+            }
+            out << (listed++ ? ", " : "") << name;
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <llvm/Support/Regex.h>
+
+namespace llvm {
+struct DiagnosticHandler;
+}
+
+// 优化备注：-fsave-optimization-record / -fremarks-summary 时，optimize() 在跑流水线期间
+// 把 LLVM 的诊断处理器换成 handler()，收下各个 pass 发出的优化备注（做了的 passed、
+// 没做的 missed 和解释原因的 analysis），按所在函数分组。
+// 这个编译器不生成调试信息，备注里通常没有源码位置，只能靠函数名定位。
+class RemarkLog {
+public:
+    enum Kind { Passed, Missed, Analysis };
+    struct Remark {
+        Kind kind;
+        std::string pass;      // 发出备注的 pass，例如 inline、loop-vectorize
+        std::string name;      // pass 给这类备注起的名字，例如 NotInlined
+        std::string message;   // 各参数拼成的完整说明
+        // 说明里代入的值，例如 Callee=f；纯文字的片段不在这里
+        std::vector<std::pair<std::string, std::string>> args;
+        std::string pattern;   // 代入的值换成 <参数名> 的说明，汇总时按它归类
+    };
+
+    // passes 非空时只收下 pass 名与这个正则匹配的备注
+    explicit RemarkLog(const std::string& passes = "");
+
+    // pass 名过滤的正则写错时返回 false，error 里是原因
+    bool valid(std::string& error) const;
+    // 交给 LLVMContext::setDiagnosticHandler，别的诊断仍按 LLVM 默认的方式处理
+    std::unique_ptr<llvm::DiagnosticHandler> handler();
+
+    // 按函数名分组写出：YAML 每个函数一个键，JSON 是函数名到备注数组的对象
+    void writeYAML(std::ostream& out) const;
+    void writeJSON(std::ostream& out) const;
+    // 各类备注的个数，以及没做的优化按“pass + 说明模板”归类、按出现次数从多到少排列
+    void printSummary(std::ostream& out) const;
+
+private:
+    class Handler;
+    bool wanted(llvm::StringRef pass) const;
+
+    std::string filter;
+    llvm::Regex passes;
+    std::map<std::string, std::vector<Remark>> functions;
+};
@@ -0,0 +1,55 @@
+// target.cpp
+#include "target.h"
+#include <iostream>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+using namespace llvm;
+
+void resolveCpuTarget(const CpuTarget& target, std::string& cpu, std::string& features) {
+    SubtargetFeatures list;
+    if (target.cpu == "native") {
+        cpu = sys::getHostCPUName().str();
+        StringMap<bool> host;
+        if (sys::getHostCPUFeatures(host)) {
+            for (auto& feature : host) {
+                list.AddFeature(feature.first(), feature.second);
+            }
+        }
+    } else {
+        cpu = target.cpu.empty() ? "generic" : target.cpu;
+    }
+    if (!target.features.empty()) {
+        SubtargetFeatures extra(target.features);
+        for (const std::string& feature : extra.getFeatures()) {
+            list.AddFeature(feature);
+        }
+    }
+    features = list.getString();
+}
+
+std::unique_ptr<TargetMachine> createTargetMachine(const CpuTarget& target) {
+    std::string triple = sys::getDefaultTargetTriple();
+    std::string message;
+    const Target *found = TargetRegistry::lookupTarget(triple, message);
+    if (!found) {
+        std::cerr << message << std::endl;
+        return NULL;
+    }
+    std::string cpu, features;
+    resolveCpuTarget(target, cpu, features);
+    // 先用 generic 的子目标检查 CPU 名，免得 LLVM 自己打印警告后照样继续
+    std::unique_ptr<MCSubtargetInfo> generic(found->createMCSubtargetInfo(triple, "", ""));
+    if (generic && !generic->isCPUStringValid(cpu)) {
+        std::cerr << "未知的 CPU: " << cpu << std::endl;
+        return NULL;
+    }
+    TargetOptions options;
+    return std::unique_ptr<TargetMachine>(found->createTargetMachine(
+        triple, cpu, features, options, Optional<Reloc::Model>(Reloc::PIC_)));
+}
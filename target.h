@@ -0,0 +1,19 @@
+#pragma once
+#include <memory>
+#include <string>
+
+namespace llvm {
+class TargetMachine;
+}
+
+// 生成代码的目标 CPU，来自 -march / -mcpu / -mattr。
+// cpu 为空表示 generic，"native" 表示本机的 CPU 和特性
+struct CpuTarget {
+    std::string cpu;
+    std::string features;   // 逗号分隔的 +特性 / -特性，加在 CPU 自带的特性之后
+};
+
+// 展开 "native"，得到实际的 CPU 名和完整的特性串
+void resolveCpuTarget(const CpuTarget& target, std::string& cpu, std::string& features);
+// 本机三元组上按 target 创建 TargetMachine，失败时打印原因并返回空
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const CpuTarget& target);